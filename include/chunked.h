@@ -0,0 +1,36 @@
+// include/chunked.h
+#ifndef CHUNKED_H
+#define CHUNKED_H
+
+#include <stddef.h>
+
+// Responses produced while they are sent, with chunked transfer encoding.
+// Output is gathered in a fixed buffer and each fill goes out as one chunk,
+// so memory stays the same however long the body is. HTTP/1.0 clients do
+// not know chunked encoding; they get the body as it is, ended by closing
+// the connection.
+
+#define CHUNKED_BUF_SIZE (64 * 1024)
+
+struct chunked_writer {
+  int fd;
+  int failed;  // the client went away; further output is dropped
+  int chunked; // 0: close-delimited body for an HTTP/1.0 client
+  size_t len;
+  char buf[CHUNKED_BUF_SIZE];
+};
+
+// Sends the status line and headers for a request made with HTTP
+// `version` (e.g. "HTTP/1.1"). Returns 0 on success.
+int chunked_begin(struct chunked_writer *w, int fd, const char *content_type,
+                  const char *version);
+
+// Appends to the body. Data larger than the buffer is sent without copying.
+void chunked_write(struct chunked_writer *w, const char *data, size_t len);
+
+// Flushes the buffer and sends the final chunk (if chunked). Returns 0 if
+// the whole response was sent. Without a final chunk a chunked client sees
+// the response as cut short; a close-delimited one cannot tell.
+int chunked_end(struct chunked_writer *w);
+
+#endif
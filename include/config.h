@@ -1,6 +1,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stddef.h>
+
 struct server_config {
     int port;
     char host[256];
@@ -11,6 +13,16 @@ struct server_config {
     char blog_description[512];
     char blog_author[256];
     int posts_per_page;
+    int embed_override; // serve disk files over the embedded site image
+    size_t zerocopy_threshold; // MSG_ZEROCOPY for bodies this large, 0 = off
+    size_t page_cache_mb; // rendered response cache size, 0 = off
+    int prerender_posts; // warm every post into the page cache at startup
+    int prerender_pages; // warm this many listing pages at startup
+    char warm_log[256];  // warm the pages most requested in this log first
+    char snapshot_path[256]; // warm-restart snapshot file, "" = off
+    int snapshot_interval;   // seconds between snapshot saves, 0 = on exit
+    char post_pack[256]; // posts served from this pack, "" = blog_dir
+    size_t stream_threshold; // stream posts this large uncached, 0 = off
 };
 
 struct server_config load_config(const char* filename);
@@ -2,7 +2,45 @@
 #ifndef ERROR_PAGES_H
 #define ERROR_PAGES_H
 
+#include <stddef.h>
+
 // Function to send styled error pages
 void send_error_page(int client_fd, int status_code, const char* message);
 
+// Formats a complete styled error response (headers and body) into `out`.
+// Returns its length, or 0 if it does not fit.
+size_t format_error_page(char* out, size_t size, int status_code,
+                         const char* message);
+
+// Fixed responses serialized once (headers and body) into a read-only table
+enum canned_response {
+    CANNED_HEALTH_OK,
+    CANNED_NOT_READY,
+    CANNED_NOT_FOUND_PLAIN,
+    CANNED_SERVER_ERROR_PLAIN,
+    CANNED_FILE_NOT_FOUND,
+    CANNED_PAGE_NOT_FOUND,
+    CANNED_MALFORMED_REQUEST,
+    CANNED_INVALID_PATH,
+    CANNED_HEADERS_TOO_LARGE,
+    CANNED_INTERNAL_ERROR,
+    CANNED_INDEX_FAILED,
+    CANNED_POSTS_FAILED,
+    CANNED_PAGINATION_FAILED,
+    CANNED_PAGE_FAILED,
+    CANNED_ABOUT_FAILED,
+    CANNED_COUNT
+};
+
+// Builds the canned table from templates_dir/error.html (or the built-in
+// page). Returns 0 on success.
+int canned_init(const char* templates_dir);
+
+// Rebuilds the table if the error template changed (checked at most once
+// per second).
+void canned_refresh(void);
+
+// Sends a canned response with a single write.
+void send_canned(int client_fd, enum canned_response id);
+
 #endif
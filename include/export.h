@@ -0,0 +1,25 @@
+// include/export.h
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include "config.h"
+
+// Static site export (`blog_server --export <dir>`). Every route is
+// rendered through the same functions the server uses and written as a
+// file a static server can map back to the URL:
+//
+//   /                  index.html (also blog.html and blog/page/1.html)
+//   /blog?page=N       blog/page/N.html
+//   /about             about.html
+//   /post/<slug>       post/<slug>.html
+//   /<asset>           <asset>, copied from static_dir
+//   (not found)        404.html
+//
+// Compressible files get a .gz sibling. A manifest (.export-manifest)
+// records a fingerprint of each file's inputs, so a re-export only
+// renders and writes what changed and deletes files whose route is gone.
+
+// Returns 0 if every file was written.
+int export_site(struct server_config *config, const char *out_dir);
+
+#endif
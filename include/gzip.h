@@ -0,0 +1,18 @@
+// include/gzip.h
+#ifndef GZIP_H
+#define GZIP_H
+
+#include <stddef.h>
+
+// Minimal gzip (RFC 1952) writer: LZ77 with hash chains and the fixed
+// DEFLATE Huffman code. Used for the precompressed .gz files of a site
+// export, where any standard gzip reader must be able to decode them.
+
+// Worst-case gzip size for `len` input bytes.
+size_t gzip_bound(size_t len);
+
+// Compresses `src` into `dst` (at least gzip_bound(len) bytes). Returns
+// the gzip member size, or 0 if working memory could not be allocated.
+size_t gzip_compress(const unsigned char *src, size_t len, unsigned char *dst);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdbool.h>  // Add this for bool type
+#include <stddef.h>
 
 #ifndef HTTP_H
 #define HTTP_H
@@ -7,9 +8,13 @@ struct http_request {
     char method[16];
     char path[256];
     char version[16];
+    char if_none_match[128]; // conditional GET validator, if sent
 };
 
 bool parse_http_request(char* request_line, struct http_request* req);
+// Copies the value of header `name` from a raw request into `out`.
+bool http_get_header(const char* request, const char* name, char* out,
+                     size_t out_size);
 const char* get_content_type(const char* path);
 // In include/http.h
 // Add these function declarations:
@@ -0,0 +1,21 @@
+// include/lz.h
+#ifndef LZ_H
+#define LZ_H
+
+#include <stddef.h>
+
+// Small LZ77 block codec (LZ4-style sequences) used for embedded assets.
+
+// Worst-case compressed size for `len` input bytes.
+size_t lz_bound(size_t len);
+
+// Compresses `src` into `dst` (at least lz_bound(len) bytes).
+// Returns the compressed size.
+size_t lz_compress(const unsigned char *src, size_t len, unsigned char *dst);
+
+// Decompresses exactly `dst_len` bytes. Returns 0 on success, -1 on
+// malformed input.
+int lz_decompress(const unsigned char *src, size_t src_len,
+                  unsigned char *dst, size_t dst_len);
+
+#endif
@@ -1,8 +1,45 @@
 #ifndef MARKDOWN_H
 #define MARKDOWN_H
 
+#include <stddef.h>
+
 //convet markdown to html
 char *markdown_to_html(const char *markdown_content);
+//convert markdown[0..len) without building the document: html is passed
+//to `emit` piece by piece as it is produced. returns 0 on success
+int markdown_stream(const char *markdown, size_t len,
+                    void (*emit)(const char *text, size_t size, void *arg),
+                    void *arg);
+//what markdown_analyze() derives, besides the word count
+#define MARKDOWN_HTML 0x1
+#define MARKDOWN_TEXT 0x2
+#define MARKDOWN_EXCERPT 0x4
+#define MARKDOWN_OUTLINE 0x8
+#define MARKDOWN_TOC 0x10 //with MARKDOWN_HTML
+
+struct markdown_heading {
+  int level;
+  char *text;
+};
+
+//outputs of one parse; what was not asked for is left NULL
+struct markdown_doc {
+  char *html;
+  size_t html_len;
+  char *toc; //nested <ul> linking the headings by id, "" without headings
+  char *text; //plain text for search, a line per block, without code
+  size_t text_len;
+  char *excerpt; //opening paragraphs as plain text, cut at a word
+  struct markdown_heading *outline;
+  int heading_count;
+  int words;
+  int reading_minutes;
+};
+//parse markdown[0..len) once into an AST and derive every output in
+//`what` from it. returns 0 on success
+int markdown_analyze(const char *markdown, size_t len, unsigned what,
+                     struct markdown_doc *doc);
+void markdown_doc_free(struct markdown_doc *doc);
 //read and parse markdown file
 char *load_markdown_file(const char *filepath);
 //free generated html
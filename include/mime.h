@@ -0,0 +1,38 @@
+// include/mime.h
+#ifndef MIME_H
+#define MIME_H
+
+#include <stdint.h>
+
+// Entry of the MIME registry (see include/mime_types.def)
+struct mime_type {
+  const char *extension;    // without the dot, lowercase
+  const char *type;         // e.g. "text/html"
+  const char *charset;      // NULL for binary types
+  const char *content_type; // header value, charset included
+  int compressible;         // worth gzip/brotli
+  int max_age;              // Cache-Control max-age in seconds, 0 = no-cache
+};
+
+// Looks up the type for a path by its extension with a single probe of a
+// perfect hash. Never returns NULL: unknown extensions get text/plain.
+const struct mime_type *mime_lookup(const char *path);
+
+// Content-Type of rendered pages: the registry's type for .html, so they
+// are sent the same as .html files.
+const char *mime_html(void);
+
+// Hash shared with tools/mkmime.c (case-insensitive FNV-1a).
+static inline uint32_t mime_hash(const char *ext, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  for (; *ext; ext++) {
+    unsigned char c = (unsigned char)*ext;
+    if (c >= 'A' && c <= 'Z')
+      c = (unsigned char)(c - 'A' + 'a');
+    h ^= c;
+    h *= 16777619u;
+  }
+  return h ^ (h >> 15);
+}
+
+#endif
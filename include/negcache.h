@@ -0,0 +1,34 @@
+// include/negcache.h
+#ifndef NEGCACHE_H
+#define NEGCACHE_H
+
+#include "config.h"
+#include <stdbool.h>
+
+// Negative lookup cache for bot probes (/wp-login.php, /.env, ...).
+// A Bloom filter holds every servable static file and post path; requests
+// that miss it, or that recently 404'd, are answered from the canned 404
+// without touching the filesystem or allocating.
+
+#define NEGCACHE_LRU_SIZE 64
+
+// Builds the filter from static_dir and blog_dir. Returns 0 on success.
+int negcache_rebuild(struct server_config *config);
+
+// Rebuilds the filter if either tree changed on disk (checked at most
+// once per second).
+void negcache_refresh(struct server_config *config);
+
+// Drops the filter and recent misses so the next refresh rebuilds.
+void negcache_invalidate(void);
+
+// True if `path` (the request path without query) is known not to exist.
+bool negcache_is_miss(const char *path);
+
+// Records a path that turned out not to exist despite passing the filter.
+void negcache_remember_miss(const char *path);
+
+// Sends the canned 404 response.
+void negcache_send_404(int client_fd);
+
+#endif
@@ -0,0 +1,66 @@
+// include/pack.h
+#ifndef PACK_H
+#define PACK_H
+
+#include "config.h"
+#include "vfs.h"
+#include <stdint.h>
+
+// Post pack: blog_dir compiled into one file (`blog_server --pack <file>`)
+// that the server can mmap instead of reading posts one by one (see
+// post_pack in config.json). It holds, in index order (newest first), each
+// post's frontmatter fields and the markdown after the frontmatter, plus a
+// slug hash table, so listing pages and post lookups work directly on the
+// mapping. Packed with --pack-html, it also carries every post body already
+// converted to HTML.
+//
+// Replace a served pack by renaming a new file over it (--pack does this);
+// it is reloaded without a restart. Overwriting it in place is not safe.
+
+struct pack;
+
+// One post as stored in a pack; strings point into the mapping and stay
+// valid while the pack is held.
+struct pack_entry {
+  const char *slug;
+  const char *title;
+  const char *date;
+  const char *preview;
+  int64_t date_key;
+  struct vfs_identity id; // of the markdown file when it was packed
+  int untitled;           // no frontmatter: pages use the default title
+  const char *markdown;   // after the frontmatter
+  const char *html;       // converted body, NULL unless packed with HTML
+};
+
+// Writes the posts of the current post index (built from blog_dir) to
+// `path`, atomically. Returns 0 on success.
+int pack_write(struct server_config *config, const char *path, int with_html);
+
+// Maps `path` as the current pack. Returns 0 on success.
+int pack_init(const char *path);
+
+// Maps the pack again if its file was replaced. Returns 1 if a new pack is
+// current, 0 if nothing changed and -1 if the new file is unusable (the
+// previous pack stays current).
+int pack_reload(void);
+
+// Path of the current pack, or "" when posts are read from blog_dir.
+const char *pack_path(void);
+
+// Returns the current pack with a reference held, or NULL. Call from the
+// main thread; a held reference may be released from any thread.
+struct pack *pack_acquire(void);
+void pack_release(struct pack *pack);
+
+int pack_count(const struct pack *pack);
+
+// Fills `out` with the listed fields of post `i` in index order (markdown
+// and html are left NULL). Returns 0 on success.
+int pack_get(const struct pack *pack, int i, struct pack_entry *out);
+
+// Looks up a post by slug, bodies included. Returns 0 if found.
+int pack_find(const struct pack *pack, const char *slug,
+              struct pack_entry *out);
+
+#endif
@@ -0,0 +1,100 @@
+// include/page_cache.h
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "vfs.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Bounded LRU cache of fully rendered, wire-ready responses (headers and
+// body in one buffer), keyed by normalized route ("post:<slug>", "blog:2",
+// "about"). Each entry records what it was rendered from:
+//  - sources: files whose identity is rechecked lazily (templates, posts)
+//  - tags: names like ("meta", slug) or ("index", "") that are invalidated
+//    explicitly when the post index changes
+// so a change evicts exactly the pages that used it.
+
+#define PAGE_CACHE_MAX_SOURCES 4
+
+struct page_source {
+  char path[512];
+  struct vfs_identity id;
+};
+
+struct page_deps {
+  struct page_source sources[PAGE_CACHE_MAX_SOURCES];
+  int source_count;
+  uint64_t *tags; // hashed ("kind", "name") pairs
+  size_t tag_count, tag_cap;
+  int failed; // a dependency could not be recorded; do not cache
+};
+
+struct page_entry {
+  char key[320];
+  uint64_t hash;
+  char etag[24]; // quoted strong validator of the body
+  struct page_source sources[PAGE_CACHE_MAX_SOURCES];
+  int source_count;
+  const uint64_t *tags;
+  size_t tag_count;
+  time_t checked; // last time sources were compared against the files
+  int refcount;   // cache reference + readers / in-flight sends
+  int cached;     // still reachable from the table
+  size_t header_len;
+  size_t len; // headers + body
+  struct page_entry *hash_next;
+  struct page_entry *lru_prev, *lru_next;
+  char *data; // response bytes, allocated with the entry
+};
+
+// Limits the cache to `max_bytes` of responses; 0 disables caching.
+void page_cache_init(size_t max_bytes);
+
+// Returns a fresh entry with a reference held, or NULL on a miss.
+struct page_entry *page_cache_get(const char *key);
+void page_cache_release(struct page_entry *entry);
+
+// Stores a 200 response for `body`, rendered from `deps`. Returns the
+// new entry with a reference held (NULL if it could not be built). Pages
+// with failed deps are returned uncached.
+struct page_entry *page_cache_put(const char *key, const char *content_type,
+                                  const char *body, size_t body_len,
+                                  const struct page_deps *deps);
+
+// Evicts every entry tagged with (kind, name).
+void page_cache_invalidate(const char *kind, const char *name);
+
+struct page_tag {
+  const char *kind;
+  const char *name;
+};
+
+// Evicts every entry tagged with any of `tags`, in one pass over the cache.
+void page_cache_invalidate_tags(const struct page_tag *tags, size_t count);
+
+void page_deps_init(struct page_deps *deps);
+void page_deps_free(struct page_deps *deps);
+// Records the current identity of `path`; take it before reading the file.
+void page_deps_source(struct page_deps *deps, const char *path);
+void page_deps_tag(struct page_deps *deps, const char *kind, const char *name);
+
+// Returns non-zero if `entry` was rendered with tag (kind, name).
+int page_entry_has_tag(const struct page_entry *entry, const char *kind,
+                       const char *name);
+
+// Optional second level consulted on a miss (see snapshot.h). It returns
+// an entry with a reference held, typically via page_cache_put(), or NULL.
+typedef struct page_entry *(*page_loader_fn)(const char *key);
+void page_cache_set_loader(page_loader_fn loader);
+
+// Calls `fn` for every cached entry, most recently used first.
+void page_cache_foreach(void (*fn)(struct page_entry *entry, void *arg),
+                        void *arg);
+
+// Sends an entry (304 Not Modified if `if_none_match` carries its ETag).
+// Consumes the caller's reference.
+void page_cache_send(int client_fd, struct page_entry *entry,
+                     const char *if_none_match);
+
+#endif
@@ -2,6 +2,10 @@
 #define POST_H
 
 #include "config.h"
+#include "error_pages.h"
+#include "vfs.h"
+#include <stddef.h>
+#include <stdint.h>
 
 struct post_metadata {
     char title[256];
@@ -9,24 +13,96 @@ struct post_metadata {
     char preview[512];
 };
 
-#define MAX_POSTS 100
+// Frontmatter values as slices of the parsed buffer (not NUL-terminated)
+struct post_field {
+    const char* data;
+    size_t len;
+};
+
+struct post_frontmatter {
+    struct post_field title;
+    struct post_field date;
+    struct post_field preview;
+};
 
+// Compact index record; strings are interned in the index's arena
 struct blog_post {
-    char filename[256];
-    struct post_metadata metadata;
+    const char* filename; // slug, without .md
+    const char* title;
+    const char* date;
+    const char* preview;
+    int64_t date_key; // date as epoch seconds, INT64_MIN if unparseable
+    struct vfs_identity id; // of the file the metadata was read from
 };
 
+struct string_arena;
+struct pack;
+
+// Posts sorted newest first
 struct blog_index {
-    struct blog_post posts[MAX_POSTS];
+    struct blog_post* posts;
     int post_count;
+    int post_cap;
+    struct string_arena* arena; // may be shared with other index versions
+    struct pack* pack;          // mapping the strings point into, if any
+    uint64_t fingerprint;       // hash of every listed field, in order
 };
 
 // Function declarations
 int parse_post_metadata(const char* content, struct post_metadata* metadata);
-void handle_markdown_post(int client_fd, const char* path, struct server_config* config);
+// Parses the frontmatter at the start of buf[0..len) in place. Returns the
+// offset just past the closing delimiter, 0 if `buf` does not start with
+// frontmatter, or -1 if the closing delimiter is not within `len` bytes.
+long parse_frontmatter(const char* buf, size_t len,
+                       struct post_frontmatter* fm);
+// Splits a post file into its page metadata (defaults when there is no
+// frontmatter; *has_metadata tells which) and returns where the markdown
+// after the frontmatter starts.
+const char* post_split(const char* content, struct post_metadata* metadata,
+                       int* has_metadata);
+// Listing text for a post without a `preview`: the opening of its body,
+// HTML-escaped, from content[0..len) (the whole post file). NULL if the
+// body has no prose.
+char* post_excerpt(const char* content, size_t len);
+// File a post page is rendered from: blog_dir/<slug>.md, or the post pack.
+void post_source_path(const struct server_config* config, const char* slug,
+                      char* out, size_t size);
+// Returns -1 (after sending a 404) if the post does not exist.
+// Rendered pages are cached; `if_none_match` may be NULL. `version` is the
+// request's HTTP version, for posts streamed without being cached.
+int handle_markdown_post(int client_fd, const char* path,
+                         const char* version, const char* if_none_match,
+                         struct server_config* config);
+struct page_entry;
+
+// Return the listing or post page (from the page cache or freshly
+// rendered) with a reference held, or NULL with `*error` set to the
+// response to send instead. A missing post reports CANNED_NOT_FOUND_PLAIN.
+struct page_entry* render_blog_page(struct server_config* config, int page,
+                                    enum canned_response* error);
+struct page_entry* render_post_page(struct server_config* config,
+                                    const char* slug,
+                                    enum canned_response* error);
+
+// Receives a window of rendered posts; entries[i] is NULL where posts[i]
+// failed. References are released after the callback returns.
+typedef void (*post_batch_fn)(const struct blog_post* posts,
+                              struct page_entry** entries, int count,
+                              void* arg);
+
+// Renders every post of `index` not rejected by `skip`, converting
+// markdown on all cores, and stores the pages in the page cache. Returns
+// the number rendered.
+int post_render_all(struct server_config* config,
+                    const struct blog_index* index,
+                    int (*skip)(const struct blog_post* post, void* arg),
+                    post_batch_fn emit, void* arg);
+
 struct blog_index* build_post_index(const char* content_dir);
 void free_post_index(struct blog_index* index);
-void handle_index_page(int client_fd, struct server_config* config);
-void handle_blog_page(int client_fd, struct server_config* config, int page);
+void handle_index_page(int client_fd, struct server_config* config,
+                       const char* if_none_match);
+void handle_blog_page(int client_fd, struct server_config* config, int page,
+                      const char* if_none_match);
 
 #endif
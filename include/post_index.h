@@ -0,0 +1,41 @@
+// include/post_index.h
+#ifndef POST_INDEX_H
+#define POST_INDEX_H
+
+#include "post.h"
+
+// Persistent post index: built once at startup and kept current from
+// inotify events on blog_dir, so listing pages need no filesystem access.
+// Each update publishes a fresh, immutable index through an atomic pointer.
+// Readers take no locks or references: a replaced index is freed once every
+// reader thread has passed a quiescent state (see rcu.h). Full rebuilds
+// (directories changing, a new post pack) run on a background thread while
+// the previous index keeps serving.
+
+int post_index_init(const char *content_dir);
+
+// Returns the current index, or NULL before init. It stays valid until the
+// calling thread's next quiescent state; post_index_release() marks where
+// its use ends and frees nothing.
+struct blog_index *post_index_acquire(void);
+void post_index_release(struct blog_index *index);
+
+// Supplies metadata recorded for `slug` by an earlier run, if the file
+// still has identity `id`; values must outlive the index. Lets startup skip
+// reading unchanged posts. Called from indexing threads.
+typedef int (*post_hint_fn)(const char *slug, const struct vfs_identity *id,
+                            struct post_frontmatter *out);
+void post_index_set_hint(post_hint_fn hint);
+
+// inotify descriptor to poll for changes, or -1 if nothing is watched.
+int post_index_watch_fd(void);
+
+// Descriptor that becomes readable when a background rebuild finishes, or
+// -1.
+int post_index_rebuild_fd(void);
+
+// Applies pending change events and publishes finished rebuilds. Returns
+// the number of posts that were added, updated or removed.
+int post_index_process_events(void);
+
+#endif
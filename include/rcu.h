@@ -0,0 +1,24 @@
+// include/rcu.h
+#ifndef RCU_H
+#define RCU_H
+
+// Quiescent-state-based reclamation for data published through an atomic
+// pointer. Readers load the pointer and use the object without locks or
+// reference counts. A replaced object is retired, and freed only once
+// every registered reader thread has passed a quiescent state (a point
+// where it holds no published pointers) after the replacement.
+
+// Registers the calling thread as a reader. Returns 0 on success.
+int rcu_register_thread(void);
+void rcu_unregister_thread(void);
+
+// Declares that the calling reader holds no published pointers, and frees
+// retired objects that no reader can still see. Cheap when nothing is
+// waiting to be freed.
+void rcu_quiescent(void);
+
+// Frees `ptr` with `free_fn` once no reader can still see it. Call after
+// the published pointer no longer refers to it.
+void rcu_retire(void *ptr, void (*free_fn)(void *));
+
+#endif
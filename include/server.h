@@ -2,9 +2,17 @@
 #define SERVER_H
 
 #include "config.h"
+#include "error_pages.h"
+
+struct page_entry;
 
 int start_server(struct server_config* config);
 void handle_client(int client_fd, struct server_config* config);
 void handle_signal(int signal);
 
+// Returns the about page with a reference held, or NULL with `*error` set
+// (see render_blog_page()).
+struct page_entry* render_about_page(struct server_config* config,
+                                     enum canned_response* error);
+
 #endif
@@ -0,0 +1,33 @@
+// include/snapshot.h
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+// Warm restarts. The post index and the page cache are written to a
+// versioned, checksummed snapshot file periodically and on shutdown. At
+// startup the file is mmapped:
+//  - indexing reuses the recorded metadata of every post whose file
+//    identity (inode, mtime, size) is unchanged instead of reading it
+//  - cached pages are restored one by one on their first request, after
+//    checking their source files and, for listing pages, the post index
+// so nothing stale is ever served and startup cost does not grow with the
+// number of pages.
+
+// Maps `path` if it holds a valid snapshot and remembers where to save.
+// `interval` is the seconds between periodic saves (0 = only on shutdown).
+// A missing or invalid file is not an error. Call before post_index_init().
+void snapshot_init(const char *path, int interval);
+
+// Writes a new snapshot on the calling thread, after waiting for a
+// background save, unless nothing changed since the last one. Returns 0 on
+// success.
+int snapshot_save(void);
+
+// Milliseconds until the next periodic save, or -1 if none is scheduled.
+int snapshot_timeout(void);
+
+// Starts a save on a background thread if the periodic interval has
+// elapsed and something changed, and reaps a finished one. The pages to
+// save are collected here; only compressing and writing run on the thread.
+void snapshot_tick(void);
+
+#endif
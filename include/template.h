@@ -18,6 +18,18 @@ struct template_kv {
 int render_template_file(const char *filepath, const struct template_kv *vars,
                          size_t nvars, char **out);
 
+// Renders like render_template_file(), but leaves the {{{slot}}} placeholder
+// empty and stores its offset in `*slot_at`, so a caller can send the text
+// before and after it around content produced separately. Without the
+// placeholder `*slot_at` is the end of the output.
+int render_template_split(const char *filepath,
+                          const struct template_kv *vars, size_t nvars,
+                          const char *slot, char **out, size_t *slot_at);
+
+// Returns an allocated copy of `s` with &, <, >, " and ' escaped, as
+// {{KEY}} values are.
+char *html_escape(const char *s);
+
 // Utility to free the rendered buffer (alias to free for clarity).
 void free_rendered_template(char *buf);
 
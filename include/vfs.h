@@ -0,0 +1,90 @@
+// include/vfs.h
+#ifndef VFS_H
+#define VFS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+// Site files are looked up by their path relative to the working directory
+// ("./static/styles.css" and "static/styles.css" are the same file). When the
+// binary is built with `make embed`, static/, templates/, content/ and
+// config.json are linked in and served from memory; otherwise every lookup
+// goes to disk.
+
+struct vfs_file {
+  const char *data; // NUL-terminated, except from vfs_map()
+  size_t len;
+  time_t mtime;
+  int owned;  // data was read from disk and must be released
+  int mapped; // data is a mapping of a disk file
+};
+
+// Entry of the generated site image (see tools/mkembed.c).
+struct vfs_embedded_file {
+  const char *path;
+  size_t offset;   // into the compressed blob
+  size_t size;     // stored size
+  size_t raw_size; // size == raw_size means stored uncompressed
+  long long mtime;
+};
+
+// Decompresses the embedded image. Call before anything is looked up.
+int vfs_init(void);
+
+// With override set, files present on disk take precedence over embedded
+// ones and disk directories are listed too.
+void vfs_set_disk_override(int enabled);
+int vfs_disk_override(void);
+
+// Non-zero when the binary carries an embedded site image.
+int vfs_is_embedded(void);
+
+// Opens `path` from the image or disk. Returns 0 on success.
+int vfs_open(const char *path, struct vfs_file *out);
+void vfs_close(struct vfs_file *file);
+
+// Like vfs_open(), but maps a disk file instead of reading it, so only the
+// pages touched are loaded. The data is not NUL-terminated.
+int vfs_map(const char *path, struct vfs_file *out);
+
+// Copies up to `size` bytes of `path`, starting at `offset`, into `buf`
+// without loading the rest of the file. Returns the number of bytes copied
+// (short only at end of file) or -1 if the file does not exist.
+ssize_t vfs_pread(const char *path, void *buf, size_t size, size_t offset);
+
+// Looks up size/mtime without reading data. Returns 0 on success.
+int vfs_stat(const char *path, size_t *size, time_t *mtime);
+
+// Identity of a file's current contents; embedded files use their index
+// in the image as the inode.
+struct vfs_identity {
+  unsigned long long ino;
+  time_t mtime;
+  size_t size;
+};
+
+// Returns 0 and fills `id` if `path` exists.
+int vfs_identity(const char *path, struct vfs_identity *id);
+
+// Non-zero if `dir` exists on disk or in the embedded image.
+int vfs_dir_exists(const char *dir);
+
+// Calls `cb` with the name of every regular file directly under `dir`.
+// Stops early and returns the callback's value if it is non-zero.
+int vfs_list(const char *dir, int (*cb)(const char *name, void *arg),
+             void *arg);
+
+struct vfs_entry {
+  const char *path; // relative to the walked directory, e.g. "images/a.png"
+  int is_dir;       // directories are only reported for on-disk trees
+};
+
+// Recursively reports every file (and on-disk directory, before its
+// contents) under `dir`. Disk trees are read in large directory batches
+// without a stat per file; use vfs_stat() for sizes. Stops early and
+// returns the callback's value if it is non-zero.
+int vfs_walk(const char *dir,
+             int (*cb)(const struct vfs_entry *entry, void *arg), void *arg);
+
+#endif
@@ -0,0 +1,26 @@
+// include/warm.h
+#ifndef WARM_H
+#define WARM_H
+
+#include "config.h"
+
+// Page cache warming after startup. The plan, in order:
+//  1. the URLs most requested in a previous access log (warm_log)
+//  2. the first prerender_pages listing pages
+//  3. every post (prerender_posts)
+// It runs in steps between requests, so /health answers from the start
+// while /health/ready reports 503 until the plan is done. Posts are
+// converted on all cores; pages already cached (or restored from a
+// snapshot) are skipped.
+
+// Builds the plan. Warming is done at once if there is nothing to warm or
+// the page cache is off.
+void warm_init(struct server_config *config);
+
+// Renders the next batch of the plan.
+void warm_step(void);
+
+// Non-zero once the plan has been worked through.
+int warm_done(void);
+
+#endif
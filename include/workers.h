@@ -0,0 +1,25 @@
+// include/workers.h
+#ifndef WORKERS_H
+#define WORKERS_H
+
+#include <stddef.h>
+
+// Fork-join helper for startup work (indexing, pre-rendering) that is
+// independent per item. Items are handed out in batches from a shared
+// counter, so uneven item costs still balance across threads. The helper
+// threads persist between runs, so per-thread state survives from one run
+// to the next; a run started while another holds the pool gets threads of
+// its own.
+
+// Called once per item; `worker` is in [0, workers_for(total)) and lets
+// callers keep per-thread state such as allocators.
+typedef void (*worker_fn)(size_t item, int worker, void *arg);
+
+// Number of threads workers_run() will use for `total` items.
+int workers_for(size_t total);
+
+// Runs `fn` over items [0, total) and returns once all are done. Falls back
+// to the calling thread when threads are unavailable or not worth it.
+void workers_run(size_t total, worker_fn fn, void *arg);
+
+#endif
@@ -0,0 +1,34 @@
+// include/zerocopy.h
+#ifndef ZEROCOPY_H
+#define ZEROCOPY_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Opt-in MSG_ZEROCOPY transmission for large in-memory bodies (Linux).
+// The kernel sends straight from the caller's pages, so a body must not be
+// freed or modified until its completion arrives on the socket error queue.
+// Connections with sends in flight are kept open until then, after which
+// their release hooks run.
+
+typedef void (*zc_release_fn)(void *arg);
+
+// Bodies of at least `threshold` bytes use zero-copy; 0 disables it.
+void zerocopy_init(size_t threshold);
+
+// Sends `len` bytes of `data`. Large bodies go out with MSG_ZEROCOPY and
+// `release(arg)` runs once the kernel is done with them; otherwise the data
+// is copied and `release` runs before returning. Returns bytes sent or -1.
+ssize_t zerocopy_send(int fd, const void *data, size_t len,
+                      zc_release_fn release, void *arg);
+
+// Closes a client socket, deferring the close while zero-copy sends on it
+// are still in flight.
+void zerocopy_close(int fd);
+
+// Handles completion notifications and closes finished connections.
+// Returns the poll timeout (ms) the caller should use, or -1 when nothing
+// is pending.
+int zerocopy_reap(void);
+
+#endif
@@ -26,18 +26,39 @@
 #ifndef MD4C_ENTITY_H
 #define MD4C_ENTITY_H
 
+#include <stdint.h>
 #include <stdlib.h>
 
 
-/* Most entities are formed by single Unicode codepoint, few by two codepoints.
- * Single-codepoint entities have codepoints[1] set to zero. */
-typedef struct ENTITY_tag ENTITY;
-struct ENTITY_tag {
-    const char* name;
-    unsigned codepoints[2];
-};
+/* Looks up a named entity, '&' and ';' included (e.g. "&nbsp;"), with one
+ * probe of a minimal perfect hash (see tools/mkentity.c). Returns zero if
+ * there is no such entity.
+ *
+ * Most entities are formed by single Unicode codepoint, few by two
+ * codepoints. Single-codepoint entities have codepoints[1] set to zero. */
+int entity_lookup(const char* name, size_t name_size, unsigned codepoints[2]);
+
+/* Hash shared with tools/mkentity.c (FNV-1a), over the name without the
+ * '&' and ';'. */
+static inline uint32_t
+entity_hash(const char* name, size_t name_size, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+    size_t i;
+
+    for(i = 0; i < name_size; i++) {
+        h ^= (unsigned char) name[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+}
 
-const ENTITY* entity_lookup(const char* name, size_t name_size);
+/* Maps a hash onto [0, n) without a division. */
+static inline uint32_t
+entity_reduce(uint32_t h, uint32_t n)
+{
+    return (uint32_t) (((uint64_t) h * n) >> 32);
+}
 
 
 #endif  /* MD4C_ENTITY_H */
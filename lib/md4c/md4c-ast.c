@@ -0,0 +1,424 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2024 Martin Mitáš
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "md4c-ast.h"
+
+
+/* Detail structures and copied text live in chunks of this size (or one
+ * larger allocation each, if bigger). */
+#define MD_AST_CHUNK_SIZE       (16 * 1024)
+#define MD_AST_ALIGN            sizeof(void*)
+#define MD_AST_ROUND(sz)        (((sz) + MD_AST_ALIGN - 1) & ~(size_t)(MD_AST_ALIGN - 1))
+
+typedef struct MD_AST_CHUNK_tag MD_AST_CHUNK;
+struct MD_AST_CHUNK_tag {
+    MD_AST_CHUNK* next;
+    size_t used;
+    size_t size;
+};
+
+#define MD_AST_HEADER           MD_AST_ROUND(sizeof(MD_AST_CHUNK))
+
+struct MD_AST_tag {
+    MD_AST_NODE* nodes;
+    unsigned n_nodes;
+    unsigned alloc_nodes;
+    MD_AST_CHUNK* chunks;   /* Newest first. */
+
+    /* Used only while parsing. */
+    const MD_CHAR* input;
+    MD_SIZE input_size;
+    unsigned* open;         /* Enter nodes not left yet, innermost last. */
+    unsigned n_open;
+    unsigned alloc_open;
+};
+
+
+/*************************
+ ***  Arena of an AST  ***
+ *************************/
+
+static void*
+md_ast_alloc(MD_AST* ast, size_t size)
+{
+    MD_AST_CHUNK* chunk = ast->chunks;
+    void* ptr;
+
+    size = MD_AST_ROUND(size);
+    if(chunk == NULL  ||  chunk->size - chunk->used < size) {
+        size_t chunk_size = (size > MD_AST_CHUNK_SIZE ? size : MD_AST_CHUNK_SIZE);
+
+        chunk = (MD_AST_CHUNK*) malloc(MD_AST_HEADER + chunk_size);
+        if(chunk == NULL)
+            return NULL;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        chunk->next = ast->chunks;
+        ast->chunks = chunk;
+    }
+
+    ptr = (char*) chunk + MD_AST_HEADER + chunk->used;
+    chunk->used += size;
+    return ptr;
+}
+
+/* Text in the input is referenced; anything else (strings md4c built for
+ * the callback only) is copied. */
+static const MD_CHAR*
+md_ast_keep_text(MD_AST* ast, const MD_CHAR* text, MD_SIZE size)
+{
+    MD_CHAR* copy;
+
+    if(size == 0  ||  (text >= ast->input  &&  text + size <= ast->input + ast->input_size))
+        return text;
+
+    copy = (MD_CHAR*) md_ast_alloc(ast, size * sizeof(MD_CHAR));
+    if(copy != NULL)
+        memcpy(copy, text, size * sizeof(MD_CHAR));
+    return copy;
+}
+
+static int
+md_ast_copy_attribute(MD_AST* ast, MD_ATTRIBUTE* attr)
+{
+    MD_TEXTTYPE* types;
+    MD_OFFSET* offsets;
+    unsigned n = 0;
+
+    /* Absent attributes (e.g. no info string) have no text and no arrays. */
+    if(attr->substr_offsets == NULL)
+        return 0;
+
+    /* The substring arrays are often temporaries of the parser. */
+    while(attr->substr_offsets[n] < attr->size)
+        n++;
+    types = (MD_TEXTTYPE*) md_ast_alloc(ast, n * sizeof(MD_TEXTTYPE));
+    offsets = (MD_OFFSET*) md_ast_alloc(ast, (n+1) * sizeof(MD_OFFSET));
+    if(types == NULL  ||  offsets == NULL)
+        return -1;
+    memcpy(types, attr->substr_types, n * sizeof(MD_TEXTTYPE));
+    memcpy(offsets, attr->substr_offsets, (n+1) * sizeof(MD_OFFSET));
+    attr->substr_types = types;
+    attr->substr_offsets = offsets;
+
+    attr->text = md_ast_keep_text(ast, attr->text, attr->size);
+    return (attr->text != NULL || attr->size == 0) ? 0 : -1;
+}
+
+/* Copies the detail structure of a block (is_block) or span of 'type'.
+ * Stores NULL into 'copy' for types which have none. */
+static int
+md_ast_copy_detail(MD_AST* ast, int is_block, int type, const void* detail, void** copy)
+{
+    size_t size = 0;
+    int ret = 0;
+
+    *copy = NULL;
+    if(detail == NULL)
+        return 0;
+
+    if(is_block) {
+        switch(type) {
+            case MD_BLOCK_UL:       size = sizeof(MD_BLOCK_UL_DETAIL); break;
+            case MD_BLOCK_OL:       size = sizeof(MD_BLOCK_OL_DETAIL); break;
+            case MD_BLOCK_LI:       size = sizeof(MD_BLOCK_LI_DETAIL); break;
+            case MD_BLOCK_H:        size = sizeof(MD_BLOCK_H_DETAIL); break;
+            case MD_BLOCK_CODE:     size = sizeof(MD_BLOCK_CODE_DETAIL); break;
+            case MD_BLOCK_TABLE:    size = sizeof(MD_BLOCK_TABLE_DETAIL); break;
+            case MD_BLOCK_TH:       /* Pass through. */
+            case MD_BLOCK_TD:       size = sizeof(MD_BLOCK_TD_DETAIL); break;
+            default:                return 0;
+        }
+    } else {
+        switch(type) {
+            case MD_SPAN_A:         size = sizeof(MD_SPAN_A_DETAIL); break;
+            case MD_SPAN_IMG:       size = sizeof(MD_SPAN_IMG_DETAIL); break;
+            case MD_SPAN_WIKILINK:  size = sizeof(MD_SPAN_WIKILINK_DETAIL); break;
+            default:                return 0;
+        }
+    }
+
+    *copy = md_ast_alloc(ast, size);
+    if(*copy == NULL)
+        return -1;
+    memcpy(*copy, detail, size);
+
+    if(is_block  &&  type == MD_BLOCK_CODE) {
+        MD_BLOCK_CODE_DETAIL* det = (MD_BLOCK_CODE_DETAIL*) *copy;
+        if(md_ast_copy_attribute(ast, &det->info) != 0  ||  md_ast_copy_attribute(ast, &det->lang) != 0)
+            ret = -1;
+    } else if(!is_block  &&  type == MD_SPAN_A) {
+        MD_SPAN_A_DETAIL* det = (MD_SPAN_A_DETAIL*) *copy;
+        if(md_ast_copy_attribute(ast, &det->href) != 0  ||  md_ast_copy_attribute(ast, &det->title) != 0)
+            ret = -1;
+    } else if(!is_block  &&  type == MD_SPAN_IMG) {
+        MD_SPAN_IMG_DETAIL* det = (MD_SPAN_IMG_DETAIL*) *copy;
+        if(md_ast_copy_attribute(ast, &det->src) != 0  ||  md_ast_copy_attribute(ast, &det->title) != 0)
+            ret = -1;
+    } else if(!is_block  &&  type == MD_SPAN_WIKILINK) {
+        MD_SPAN_WIKILINK_DETAIL* det = (MD_SPAN_WIKILINK_DETAIL*) *copy;
+        ret = md_ast_copy_attribute(ast, &det->target);
+    }
+    return ret;
+}
+
+
+/*****************************
+ ***  Recording the parse  ***
+ *****************************/
+
+static MD_AST_NODE*
+md_ast_push_node(MD_AST* ast, MD_AST_EVENT event, int type)
+{
+    MD_AST_NODE* node;
+
+    if(ast->n_nodes >= ast->alloc_nodes) {
+        MD_AST_NODE* new_nodes;
+        unsigned new_alloc = (ast->alloc_nodes > 0 ? ast->alloc_nodes + ast->alloc_nodes / 2 : 256);
+
+        new_nodes = (MD_AST_NODE*) realloc(ast->nodes, new_alloc * sizeof(MD_AST_NODE));
+        if(new_nodes == NULL)
+            return NULL;
+        ast->nodes = new_nodes;
+        ast->alloc_nodes = new_alloc;
+    }
+
+    node = &ast->nodes[ast->n_nodes++];
+    node->event = (unsigned char) event;
+    node->type = (unsigned char) type;
+    node->size = 0;
+    node->end = 0;
+    node->data = NULL;
+    return node;
+}
+
+static int
+md_ast_enter(MD_AST* ast, MD_AST_EVENT event, int type, void* detail)
+{
+    MD_AST_NODE* node;
+    void* copy;
+
+    if(ast->n_open >= ast->alloc_open) {
+        unsigned* new_open;
+        unsigned new_alloc = (ast->alloc_open > 0 ? ast->alloc_open * 2 : 16);
+
+        new_open = (unsigned*) realloc(ast->open, new_alloc * sizeof(unsigned));
+        if(new_open == NULL)
+            return -1;
+        ast->open = new_open;
+        ast->alloc_open = new_alloc;
+    }
+
+    if(md_ast_copy_detail(ast, (event == MD_AST_ENTER_BLOCK), type, detail, &copy) != 0)
+        return -1;
+    node = md_ast_push_node(ast, event, type);
+    if(node == NULL)
+        return -1;
+    node->data = copy;
+    ast->open[ast->n_open++] = ast->n_nodes - 1;
+    return 0;
+}
+
+static int
+md_ast_leave(MD_AST* ast, MD_AST_EVENT event, int type)
+{
+    MD_AST_EVENT enter_event = (event == MD_AST_LEAVE_BLOCK ? MD_AST_ENTER_BLOCK : MD_AST_ENTER_SPAN);
+    MD_AST_NODE* node;
+    const void* detail = NULL;
+    unsigned leave = ast->n_nodes;
+    unsigned i;
+
+    node = md_ast_push_node(ast, event, type);
+    if(node == NULL)
+        return -1;
+
+    /* Find the node being left. The parser can leave a span it never
+     * entered (e.g. a stray strikethrough closer), which is just recorded;
+     * anything still open inside the one left ends here too. */
+    for(i = ast->n_open; i > 0; i--) {
+        const MD_AST_NODE* enter = &ast->nodes[ast->open[i-1]];
+        if(enter->event == enter_event  &&  enter->type == type)
+            break;
+    }
+    if(i > 0) {
+        /* Leave callbacks get the same detail as the enter one. */
+        detail = ast->nodes[ast->open[i-1]].data;
+        while(ast->n_open >= i)
+            ast->nodes[ast->open[--ast->n_open]].end = leave;
+    }
+
+    ast->nodes[leave].data = detail;
+    return 0;
+}
+
+static int
+md_ast_enter_block(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    return md_ast_enter((MD_AST*) userdata, MD_AST_ENTER_BLOCK, type, detail);
+}
+
+static int
+md_ast_leave_block(MD_BLOCKTYPE type, void* detail, void* userdata)
+{
+    (void) detail;
+    return md_ast_leave((MD_AST*) userdata, MD_AST_LEAVE_BLOCK, type);
+}
+
+static int
+md_ast_enter_span(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    return md_ast_enter((MD_AST*) userdata, MD_AST_ENTER_SPAN, type, detail);
+}
+
+static int
+md_ast_leave_span(MD_SPANTYPE type, void* detail, void* userdata)
+{
+    (void) detail;
+    return md_ast_leave((MD_AST*) userdata, MD_AST_LEAVE_SPAN, type);
+}
+
+static int
+md_ast_text(MD_TEXTTYPE type, const MD_CHAR* text, MD_SIZE size, void* userdata)
+{
+    MD_AST* ast = (MD_AST*) userdata;
+    MD_AST_NODE* node;
+
+    text = md_ast_keep_text(ast, text, size);
+    if(text == NULL  &&  size > 0)
+        return -1;
+    node = md_ast_push_node(ast, MD_AST_TEXT, type);
+    if(node == NULL)
+        return -1;
+    node->size = size;
+    node->data = text;
+    return 0;
+}
+
+
+/********************
+ ***  Public API  ***
+ ********************/
+
+MD_AST*
+md_ast_parse(const MD_CHAR* text, MD_SIZE size, unsigned parser_flags,
+             MD_PARSE_CONTEXT* pc)
+{
+    MD_PARSER parser = {
+        0,
+        parser_flags,
+        md_ast_enter_block,
+        md_ast_leave_block,
+        md_ast_enter_span,
+        md_ast_leave_span,
+        md_ast_text,
+        NULL,
+        NULL
+    };
+    MD_AST* ast;
+    int ret;
+
+    ast = (MD_AST*) calloc(1, sizeof(MD_AST));
+    if(ast == NULL)
+        return NULL;
+    ast->input = text;
+    ast->input_size = size;
+
+    ret = md_parse_ex(text, size, &parser, (void*) ast, pc);
+
+    /* Nodes the parser never left end with the document. */
+    while(ast->n_open > 0)
+        ast->nodes[ast->open[--ast->n_open]].end = ast->n_nodes;
+    free(ast->open);
+    ast->open = NULL;
+    ast->n_open = 0;
+    ast->alloc_open = 0;
+    if(ret != 0) {
+        md_ast_free(ast);
+        return NULL;
+    }
+    return ast;
+}
+
+void
+md_ast_free(MD_AST* ast)
+{
+    MD_AST_CHUNK* chunk;
+
+    if(ast == NULL)
+        return;
+
+    chunk = ast->chunks;
+    while(chunk != NULL) {
+        MD_AST_CHUNK* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(ast->open);
+    free(ast->nodes);
+    free(ast);
+}
+
+const MD_AST_NODE*
+md_ast_nodes(const MD_AST* ast, unsigned* n_nodes)
+{
+    *n_nodes = ast->n_nodes;
+    return ast->nodes;
+}
+
+int
+md_ast_walk(const MD_AST* ast, const MD_PARSER* parser, void* userdata)
+{
+    unsigned i;
+    int ret = 0;
+
+    for(i = 0; i < ast->n_nodes  &&  ret == 0; i++) {
+        const MD_AST_NODE* node = &ast->nodes[i];
+        void* detail = (void*) node->data;
+
+        switch(node->event) {
+            case MD_AST_ENTER_BLOCK:
+                ret = parser->enter_block((MD_BLOCKTYPE) node->type, detail, userdata);
+                break;
+            case MD_AST_LEAVE_BLOCK:
+                ret = parser->leave_block((MD_BLOCKTYPE) node->type, detail, userdata);
+                break;
+            case MD_AST_ENTER_SPAN:
+                ret = parser->enter_span((MD_SPANTYPE) node->type, detail, userdata);
+                break;
+            case MD_AST_LEAVE_SPAN:
+                ret = parser->leave_span((MD_SPANTYPE) node->type, detail, userdata);
+                break;
+            case MD_AST_TEXT:
+                ret = parser->text((MD_TEXTTYPE) node->type, (const MD_CHAR*) node->data,
+                                   node->size, userdata);
+                break;
+        }
+    }
+
+    return ret;
+}
@@ -0,0 +1,99 @@
+/*
+ * MD4C: Markdown parser for C
+ * (http://github.com/mity/md4c)
+ *
+ * Copyright (c) 2016-2024 Martin Mitáš
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef MD4C_AST_H
+#define MD4C_AST_H
+
+#include "md4c.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+
+/* Flat AST.
+ *
+ * md_ast_parse() runs md_parse() once and records every callback it makes
+ * as one node of a flat array, in document order. Detail structures and
+ * any text not lying in the input are copied into an arena owned by the
+ * AST, so the whole tree is freed at once by md_ast_free().
+ *
+ * The AST may then be walked directly (each enter node knows where its
+ * matching leave node is, so subtrees can be skipped), or replayed to any
+ * set of MD_PARSER callbacks with md_ast_walk() as many times as needed;
+ * md_html_ast() in md4c-html.h renders it as HTML. Several outputs of one
+ * document thus cost a single parse.
+ */
+
+typedef enum MD_AST_EVENT {
+    MD_AST_ENTER_BLOCK = 0,
+    MD_AST_LEAVE_BLOCK,
+    MD_AST_ENTER_SPAN,
+    MD_AST_LEAVE_SPAN,
+    MD_AST_TEXT
+} MD_AST_EVENT;
+
+typedef struct MD_AST_NODE {
+    unsigned char event;    /* MD_AST_EVENT */
+    unsigned char type;     /* MD_BLOCKTYPE, MD_SPANTYPE or MD_TEXTTYPE */
+    MD_SIZE size;           /* MD_AST_TEXT: size of the text. */
+    unsigned end;           /* MD_AST_ENTER_xxx: index of the leave node
+                             * closing it, or the node count if none does. */
+    const void* data;       /* MD_AST_TEXT: the text. Otherwise the detail
+                             * structure as passed to the callback, or NULL. */
+} MD_AST_NODE;
+
+typedef struct MD_AST_tag MD_AST;
+
+/* Parse the document into an AST. Param parser_flags are flags from md4c.h;
+ * 'pc' (may be NULL) is passed to md_parse_ex().
+ *
+ * Text nodes and attributes may point into 'text', which therefore has to
+ * stay valid for as long as the AST is used.
+ *
+ * Returns NULL on error.
+ */
+MD_AST* md_ast_parse(const MD_CHAR* text, MD_SIZE size, unsigned parser_flags,
+                     MD_PARSE_CONTEXT* pc);
+
+void md_ast_free(MD_AST* ast);
+
+/* Returns the nodes of the AST and stores their count into 'n_nodes'. */
+const MD_AST_NODE* md_ast_nodes(const MD_AST* ast, unsigned* n_nodes);
+
+/* Calls the callbacks of 'parser' for every node, as md_parse() would have
+ * called them for the original document. Members flags, debug_log and
+ * syntax of 'parser' are not used.
+ *
+ * Returns 0 on success, or the non-zero value a callback aborted with.
+ */
+int md_ast_walk(const MD_AST* ast, const MD_PARSER* parser, void* userdata);
+
+
+#ifdef __cplusplus
+    }  /* extern "C" { */
+#endif
+
+#endif  /* MD4C_AST_H */
@@ -24,6 +24,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "md4c-html.h"
@@ -47,6 +48,26 @@
 
 
 
+/* Output is gathered into a buffer of this size and handed to
+ * process_output() in batches rather than one fragment at a time. */
+#define OUTPUT_BATCH_SIZE    4096
+
+/* Growable buffer for output which cannot be passed on as it is made. */
+typedef struct MD_HTML_BUFFER_tag MD_HTML_BUFFER;
+struct MD_HTML_BUFFER_tag {
+    MD_CHAR* data;
+    MD_SIZE size;
+    MD_SIZE alloc;
+};
+
+/* Slot of the hash table of heading ids. An empty slot has size 0. */
+typedef struct MD_HTML_ID_tag MD_HTML_ID;
+struct MD_HTML_ID_tag {
+    MD_SIZE off;                    /* where the id starts in MD_HTML::ids */
+    MD_SIZE size;
+    unsigned next_suffix;           /* first "-N" to try for a duplicate */
+};
+
 typedef struct MD_HTML_tag MD_HTML;
 struct MD_HTML_tag {
     void (*process_output)(const MD_CHAR*, MD_SIZE, void*);
@@ -54,6 +75,27 @@ struct MD_HTML_tag {
     unsigned flags;
     int image_nesting_level;
     char escape_map[256];
+
+    /* With MD_HTML_FLAG_HEADING_IDS, the contents of a heading are held
+     * back until its text (and so its id) is known. */
+    MD_HTML_BUFFER* capture;        /* if set, output goes here instead */
+    MD_HTML_BUFFER heading_html;
+    MD_HTML_BUFFER heading_text;
+    MD_HTML_BUFFER ids;             /* ids given so far, '\0'-separated */
+    MD_HTML_ID* id_table;           /* the same ids, hashed */
+    unsigned id_table_size;         /* power of two */
+    unsigned id_count;
+
+    /* Table of contents, collected if process_toc is set. */
+    void (*process_toc)(const MD_CHAR*, MD_SIZE, void*);
+    void* toc_userdata;
+    MD_HTML_BUFFER toc;
+    int toc_levels[6];              /* heading level of each open list */
+    int toc_depth;
+
+    int failed;                     /* out of memory */
+    MD_SIZE output_size;
+    MD_CHAR output[OUTPUT_BATCH_SIZE];
 };
 
 #define NEED_HTML_ESC_FLAG   0x1
@@ -70,12 +112,180 @@ struct MD_HTML_tag {
 #define ISALNUM(ch)     (ISLOWER(ch) || ISUPPER(ch) || ISDIGIT(ch))
 
 
+static void
+buffer_append(MD_HTML* r, MD_HTML_BUFFER* buf, const MD_CHAR* text, MD_SIZE size)
+{
+    if(buf->size + size > buf->alloc) {
+        MD_SIZE alloc = (buf->alloc > 0 ? buf->alloc : 256);
+        MD_CHAR* data;
+
+        while(alloc < buf->size + size)
+            alloc *= 2;
+        data = (MD_CHAR*) realloc(buf->data, alloc * sizeof(MD_CHAR));
+        if(data == NULL) {
+            r->failed = 1;
+            return;
+        }
+        buf->data = data;
+        buf->alloc = alloc;
+    }
+
+    memcpy(buf->data + buf->size, text, size * sizeof(MD_CHAR));
+    buf->size += size;
+}
+
+static void
+flush_output(MD_HTML* r)
+{
+    if(r->output_size > 0) {
+        r->process_output(r->output, r->output_size, r->userdata);
+        r->output_size = 0;
+    }
+}
+
 static inline void
 render_verbatim(MD_HTML* r, const MD_CHAR* text, MD_SIZE size)
 {
-    r->process_output(text, size, r->userdata);
+    if(r->capture != NULL) {
+        buffer_append(r, r->capture, text, size);
+        return;
+    }
+
+    if(r->output_size + size > OUTPUT_BATCH_SIZE) {
+        flush_output(r);
+
+        /* Pass large fragments through without copying them. */
+        if(size >= OUTPUT_BATCH_SIZE) {
+            r->process_output(text, size, r->userdata);
+            return;
+        }
+    }
+
+    memcpy(r->output + r->output_size, text, size * sizeof(MD_CHAR));
+    r->output_size += size;
+}
+
+/* Vectorized scanning for the escaping renderers below: find the next byte
+ * which needs escaping 16 (SSE2, NEON) or 32 (AVX2) bytes at a time, so
+ * runs of plain text reach render_verbatim() as one long span. The byte
+ * sets mirror escape_map (see render_init()); whatever the vector loop leaves
+ * (short tails) goes through the scalar loops. */
+#if !defined MD4C_USE_UTF16  &&  defined __GNUC__
+    #if defined __AVX2__
+        #include <immintrin.h>
+        #define MD_HTML_SIMD    1
+        typedef __m256i md_vec;
+        #define VEC_WIDTH       32
+        #define VEC_LOAD(p)     _mm256_loadu_si256((const __m256i*) (p))
+        #define VEC_SET1(ch)    _mm256_set1_epi8((char) (ch))
+        #define VEC_EQ(a, b)    _mm256_cmpeq_epi8((a), (b))
+        #define VEC_OR(a, b)    _mm256_or_si256((a), (b))
+        #define VEC_AND(a, b)   _mm256_and_si256((a), (b))
+        #define VEC_MIN(a, b)   _mm256_min_epu8((a), (b))
+        #define VEC_MAX(a, b)   _mm256_max_epu8((a), (b))
+
+        static inline unsigned
+        vec_first_set(md_vec v)
+        {
+            unsigned mask = (unsigned) _mm256_movemask_epi8(v);
+            return (mask != 0) ? (unsigned) __builtin_ctz(mask) : VEC_WIDTH;
+        }
+    #elif defined __SSE2__
+        #include <emmintrin.h>
+        #define MD_HTML_SIMD    1
+        typedef __m128i md_vec;
+        #define VEC_WIDTH       16
+        #define VEC_LOAD(p)     _mm_loadu_si128((const __m128i*) (p))
+        #define VEC_SET1(ch)    _mm_set1_epi8((char) (ch))
+        #define VEC_EQ(a, b)    _mm_cmpeq_epi8((a), (b))
+        #define VEC_OR(a, b)    _mm_or_si128((a), (b))
+        #define VEC_AND(a, b)   _mm_and_si128((a), (b))
+        #define VEC_MIN(a, b)   _mm_min_epu8((a), (b))
+        #define VEC_MAX(a, b)   _mm_max_epu8((a), (b))
+
+        static inline unsigned
+        vec_first_set(md_vec v)
+        {
+            unsigned mask = (unsigned) _mm_movemask_epi8(v);
+            return (mask != 0) ? (unsigned) __builtin_ctz(mask) : VEC_WIDTH;
+        }
+    #elif defined __ARM_NEON  &&  defined __aarch64__
+        #include <arm_neon.h>
+        #define MD_HTML_SIMD    1
+        typedef uint8x16_t md_vec;
+        #define VEC_WIDTH       16
+        #define VEC_LOAD(p)     vld1q_u8((const uint8_t*) (p))
+        #define VEC_SET1(ch)    vdupq_n_u8((uint8_t) (ch))
+        #define VEC_EQ(a, b)    vceqq_u8((a), (b))
+        #define VEC_OR(a, b)    vorrq_u8((a), (b))
+        #define VEC_AND(a, b)   vandq_u8((a), (b))
+        #define VEC_MIN(a, b)   vminq_u8((a), (b))
+        #define VEC_MAX(a, b)   vmaxq_u8((a), (b))
+
+        static inline unsigned
+        vec_first_set(md_vec v)
+        {
+            /* Narrow each lane to 4 bits of a 64-bit mask. */
+            uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+                        vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+            return (mask != 0) ? (unsigned) __builtin_ctzll(mask) / 4 : VEC_WIDTH;
+        }
+    #endif
+#endif
+
+#ifdef MD_HTML_SIMD
+/* Lanes of 'v' within [lo, hi] (unsigned). */
+static inline md_vec
+vec_in_range(md_vec v, unsigned char lo, unsigned char hi)
+{
+    return VEC_AND(VEC_EQ(VEC_MAX(v, VEC_SET1(lo)), v),
+                   VEC_EQ(VEC_MIN(v, VEC_SET1(hi)), v));
+}
+
+/* Returns offset of the first byte in data[off..] needing HTML escaping, or
+ * where fewer than VEC_WIDTH bytes remain. */
+static MD_OFFSET
+skip_html_safe(const MD_CHAR* data, MD_OFFSET off, MD_SIZE size)
+{
+    while(off + VEC_WIDTH <= size) {
+        md_vec v = VEC_LOAD(data + off);
+        md_vec hit = VEC_OR(VEC_OR(VEC_EQ(v, VEC_SET1('&')), VEC_EQ(v, VEC_SET1('<'))),
+                            VEC_OR(VEC_OR(VEC_EQ(v, VEC_SET1('>')), VEC_EQ(v, VEC_SET1('"'))),
+                                   VEC_EQ(v, VEC_SET1('\0'))));
+        unsigned i = vec_first_set(hit);
+
+        if(i < VEC_WIDTH)
+            return off + i;
+        off += VEC_WIDTH;
+    }
+    return off;
 }
 
+/* Same for URL escaping: everything but alphanumerics, NUL and
+ * "~-_.+!*(),%#@?=;:/$". */
+static MD_OFFSET
+skip_url_safe(const MD_CHAR* data, MD_OFFSET off, MD_SIZE size)
+{
+    while(off + VEC_WIDTH <= size) {
+        md_vec v = VEC_LOAD(data + off);
+        md_vec hit = VEC_OR(VEC_OR(vec_in_range(v, 0x01, 0x20), vec_in_range(v, 0x7f, 0xff)),
+                     VEC_OR(VEC_OR(VEC_EQ(v, VEC_SET1('"')), vec_in_range(v, '&', '\'')),
+                     VEC_OR(VEC_OR(VEC_EQ(v, VEC_SET1('<')), VEC_EQ(v, VEC_SET1('>'))),
+                     VEC_OR(VEC_OR(vec_in_range(v, '[', '^'), VEC_EQ(v, VEC_SET1('`'))),
+                            vec_in_range(v, '{', '}')))));
+        unsigned i = vec_first_set(hit);
+
+        if(i < VEC_WIDTH)
+            return off + i;
+        off += VEC_WIDTH;
+    }
+    return off;
+}
+#else
+    #define skip_html_safe(data, off, size)     (off)
+    #define skip_url_safe(data, off, size)      (off)
+#endif
+
 /* Keep this as a macro. Most compiler should then be smart enough to replace
  * the strlen() call with a compile-time constant if the string is a C literal. */
 #define RENDER_VERBATIM(r, verbatim)                                    \
@@ -92,6 +302,8 @@ render_html_escaped(MD_HTML* r, const MD_CHAR* data, MD_SIZE size)
     #define NEED_HTML_ESC(ch)   (r->escape_map[(unsigned char)(ch)] & NEED_HTML_ESC_FLAG)
 
     while(1) {
+        off = skip_html_safe(data, off, size);
+
         /* Optimization: Use some loop unrolling. */
         while(off + 3 < size  &&  !NEED_HTML_ESC(data[off+0])  &&  !NEED_HTML_ESC(data[off+1])
                               &&  !NEED_HTML_ESC(data[off+2])  &&  !NEED_HTML_ESC(data[off+3]))
@@ -128,6 +340,7 @@ render_url_escaped(MD_HTML* r, const MD_CHAR* data, MD_SIZE size)
     #define NEED_URL_ESC(ch)    (r->escape_map[(unsigned char)(ch)] & NEED_URL_ESC_FLAG)
 
     while(1) {
+        off = skip_url_safe(data, off, size);
         while(off < size  &&  !NEED_URL_ESC(data[off]))
             off++;
         if(off > beg)
@@ -231,13 +444,12 @@ render_entity(MD_HTML* r, const MD_CHAR* text, MD_SIZE size,
         return;
     } else {
         /* Named entity (e.g. "&nbsp;"). */
-        const ENTITY* ent;
+        unsigned codepoints[2];
 
-        ent = entity_lookup(text, size);
-        if(ent != NULL) {
-            render_utf8_codepoint(r, ent->codepoints[0], fn_append);
-            if(ent->codepoints[1])
-                render_utf8_codepoint(r, ent->codepoints[1], fn_append);
+        if(entity_lookup(text, size, codepoints)) {
+            render_utf8_codepoint(r, codepoints[0], fn_append);
+            if(codepoints[1])
+                render_utf8_codepoint(r, codepoints[1], fn_append);
             return;
         }
     }
@@ -367,6 +579,238 @@ render_open_wikilink_span(MD_HTML* r, const MD_SPAN_WIKILINK_DETAIL* det)
 }
 
 
+/* Heading ids and the table of contents (MD_HTML_FLAG_HEADING_IDS).
+ *
+ * A heading's id is derived from its text: ASCII letters and digits are
+ * lowercased, runs of spaces and hyphens become one '-', other ASCII
+ * punctuation is dropped and anything else is kept as it is. A heading
+ * without any of those gets "section"; repeated ids get "-1", "-2", ...
+ */
+static void
+render_open_heading(MD_HTML* r)
+{
+    r->heading_html.size = 0;
+    r->heading_text.size = 0;
+    r->capture = &r->heading_html;
+}
+
+/* Adds the plain text of a heading's contents, which its id is made of.
+ * Image descriptions are left out. */
+static void
+collect_heading_text(MD_HTML* r, MD_TEXTTYPE type, const MD_CHAR* text, MD_SIZE size)
+{
+    r->capture = &r->heading_text;
+    switch(type) {
+        case MD_TEXT_NULLCHAR:  /* noop */ break;
+        case MD_TEXT_BR:        /* fall through */
+        case MD_TEXT_SOFTBR:    RENDER_VERBATIM(r, " "); break;
+        case MD_TEXT_HTML:      /* noop */ break;
+        case MD_TEXT_ENTITY:    render_entity(r, text, size, render_verbatim); break;
+        default:                render_verbatim(r, text, size); break;
+    }
+    r->capture = &r->heading_html;
+}
+
+static unsigned
+id_hash(const MD_CHAR* str, MD_SIZE size)
+{
+    unsigned hash = 2166136261u;
+    MD_SIZE i;
+
+    for(i = 0; i < size; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/* Returns the slot of the id r->ids[off..off+size), or the empty slot
+ * where it belongs. */
+static MD_HTML_ID*
+id_lookup(MD_HTML* r, MD_SIZE off, MD_SIZE size)
+{
+    unsigned mask = r->id_table_size - 1;
+    unsigned i = id_hash(r->ids.data + off, size) & mask;
+
+    while(r->id_table[i].size != 0) {
+        MD_HTML_ID* id = &r->id_table[i];
+        if(id->size == size  &&  memcmp(r->ids.data + id->off, r->ids.data + off, size) == 0)
+            break;
+        i = (i + 1) & mask;
+    }
+    return &r->id_table[i];
+}
+
+/* Makes sure one more id fits into the table without it getting more
+ * than half full. */
+static void
+id_table_reserve(MD_HTML* r)
+{
+    MD_HTML_ID* old_table = r->id_table;
+    unsigned old_size = r->id_table_size;
+    unsigned i;
+
+    if(2 * (r->id_count + 1) <= old_size)
+        return;
+
+    r->id_table_size = (old_size > 0 ? 2 * old_size : 64);
+    r->id_table = (MD_HTML_ID*) calloc(r->id_table_size, sizeof(MD_HTML_ID));
+    if(r->id_table == NULL) {
+        r->id_table = old_table;
+        r->id_table_size = old_size;
+        r->failed = 1;
+        return;
+    }
+
+    for(i = 0; i < old_size; i++) {
+        if(old_table[i].size != 0)
+            *id_lookup(r, old_table[i].off, old_table[i].size) = old_table[i];
+    }
+    free(old_table);
+}
+
+/* Appends the id of the current heading to r->ids. Returns its offset
+ * there, or -1 if out of memory.
+ *
+ * A duplicate gets the first free "-N" suffix. The table remembers where
+ * the search stopped for each id, so a run of identical headings does not
+ * retry the suffixes given before. */
+static long
+make_heading_id(MD_HTML* r)
+{
+    MD_SIZE beg = r->ids.size;
+    MD_SIZE base_end;
+    MD_SIZE i;
+    MD_HTML_ID* base;
+    MD_HTML_ID* slot;
+    unsigned n;
+
+    id_table_reserve(r);
+    if(r->failed)
+        return -1;
+
+    for(i = 0; i < r->heading_text.size; i++) {
+        MD_CHAR ch = r->heading_text.data[i];
+
+        if(ISUPPER(ch))
+            ch = ch - 'A' + 'a';
+        if(ISALNUM(ch)  ||  ch == '_'  ||  (unsigned char) ch >= 0x80) {
+            buffer_append(r, &r->ids, &ch, 1);
+        } else if(ch == ' '  ||  ch == '-') {
+            if(r->ids.size > beg  &&  r->ids.data[r->ids.size-1] != '-')
+                buffer_append(r, &r->ids, "-", 1);
+        }
+    }
+    if(r->ids.size > beg  &&  r->ids.data[r->ids.size-1] == '-')
+        r->ids.size--;
+    if(r->ids.size == beg)
+        buffer_append(r, &r->ids, "section", 7);
+    if(r->failed)
+        return -1;
+
+    base_end = r->ids.size;
+    base = id_lookup(r, beg, base_end - beg);
+    slot = base;
+    if(base->size != 0) {
+        for(n = base->next_suffix; ; n++) {
+            char suffix[16];
+            r->ids.size = base_end;
+            buffer_append(r, &r->ids, suffix, (MD_SIZE) snprintf(suffix, sizeof(suffix), "-%u", n));
+            if(r->failed)
+                return -1;
+            slot = id_lookup(r, beg, r->ids.size - beg);
+            if(slot->size == 0)
+                break;
+        }
+        base->next_suffix = n + 1;
+    }
+
+    slot->off = beg;
+    slot->size = r->ids.size - beg;
+    slot->next_suffix = 1;
+    r->id_count++;
+    buffer_append(r, &r->ids, "", 1);
+
+    return (r->failed ? -1 : (long) beg);
+}
+
+/* Adds a link to the heading to the table of contents. Each deeper level
+ * opens a nested list in the item before it. */
+static void
+add_toc_entry(MD_HTML* r, int level, const MD_CHAR* id)
+{
+    r->capture = &r->toc;
+    if(r->toc_depth == 0) {
+        RENDER_VERBATIM(r, "<ul>\n<li>");
+        r->toc_levels[r->toc_depth++] = level;
+    } else {
+        while(r->toc_depth > 1  &&  level <= r->toc_levels[r->toc_depth-2]) {
+            RENDER_VERBATIM(r, "</li>\n</ul>\n");
+            r->toc_depth--;
+        }
+        if(level > r->toc_levels[r->toc_depth-1]) {
+            RENDER_VERBATIM(r, "\n<ul>\n<li>");
+            r->toc_levels[r->toc_depth++] = level;
+        } else {
+            RENDER_VERBATIM(r, "</li>\n<li>");
+            r->toc_levels[r->toc_depth-1] = level;
+        }
+    }
+
+    RENDER_VERBATIM(r, "<a href=\"#");
+    render_verbatim(r, id, (MD_SIZE) strlen(id));
+    RENDER_VERBATIM(r, "\">");
+    if(r->heading_text.size > 0)
+        render_html_escaped(r, r->heading_text.data, r->heading_text.size);
+    RENDER_VERBATIM(r, "</a>");
+    r->capture = NULL;
+}
+
+static void
+render_close_heading(MD_HTML* r, int level)
+{
+    static const MD_CHAR* head[6] = { "</h1>\n", "</h2>\n", "</h3>\n", "</h4>\n", "</h5>\n", "</h6>\n" };
+    char open[16];
+    long id;
+
+    r->capture = NULL;
+    id = make_heading_id(r);
+    if(id < 0) {
+        snprintf(open, sizeof(open), "<h%d>", level);
+        render_verbatim(r, open, (MD_SIZE) strlen(open));
+    } else {
+        snprintf(open, sizeof(open), "<h%d id=\"", level);
+        render_verbatim(r, open, (MD_SIZE) strlen(open));
+        render_verbatim(r, r->ids.data + id, (MD_SIZE) strlen(r->ids.data + id));
+        RENDER_VERBATIM(r, "\">");
+    }
+    if(r->heading_html.size > 0)
+        render_verbatim(r, r->heading_html.data, r->heading_html.size);
+    RENDER_VERBATIM(r, head[level - 1]);
+
+    if(r->process_toc != NULL  &&  id >= 0)
+        add_toc_entry(r, level, r->ids.data + id);
+}
+
+/* Closes the lists left open in the table of contents and hands it over. */
+static void
+finish_toc(MD_HTML* r)
+{
+    if(r->process_toc == NULL)
+        return;
+
+    r->capture = &r->toc;
+    while(r->toc_depth > 0) {
+        RENDER_VERBATIM(r, "</li>\n</ul>\n");
+        r->toc_depth--;
+    }
+    r->capture = NULL;
+
+    if(!r->failed  &&  r->toc.size > 0)
+        r->process_toc(r->toc.data, r->toc.size, r->toc_userdata);
+}
+
+
 /**************************************
  ***  HTML renderer implementation  ***
  **************************************/
@@ -384,7 +828,12 @@ enter_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
         case MD_BLOCK_OL:       render_open_ol_block(r, (const MD_BLOCK_OL_DETAIL*)detail); break;
         case MD_BLOCK_LI:       render_open_li_block(r, (const MD_BLOCK_LI_DETAIL*)detail); break;
         case MD_BLOCK_HR:       RENDER_VERBATIM(r, (r->flags & MD_HTML_FLAG_XHTML) ? "<hr />\n" : "<hr>\n"); break;
-        case MD_BLOCK_H:        RENDER_VERBATIM(r, head[((MD_BLOCK_H_DETAIL*)detail)->level - 1]); break;
+        case MD_BLOCK_H:
+            if(r->flags & MD_HTML_FLAG_HEADING_IDS)
+                render_open_heading(r);
+            else
+                RENDER_VERBATIM(r, head[((MD_BLOCK_H_DETAIL*)detail)->level - 1]);
+            break;
         case MD_BLOCK_CODE:     render_open_code_block(r, (const MD_BLOCK_CODE_DETAIL*) detail); break;
         case MD_BLOCK_HTML:     /* noop */ break;
         case MD_BLOCK_P:        RENDER_VERBATIM(r, "<p>"); break;
@@ -412,7 +861,12 @@ leave_block_callback(MD_BLOCKTYPE type, void* detail, void* userdata)
         case MD_BLOCK_OL:       RENDER_VERBATIM(r, "</ol>\n"); break;
         case MD_BLOCK_LI:       RENDER_VERBATIM(r, "</li>\n"); break;
         case MD_BLOCK_HR:       /*noop*/ break;
-        case MD_BLOCK_H:        RENDER_VERBATIM(r, head[((MD_BLOCK_H_DETAIL*)detail)->level - 1]); break;
+        case MD_BLOCK_H:
+            if(r->flags & MD_HTML_FLAG_HEADING_IDS)
+                render_close_heading(r, (int) ((MD_BLOCK_H_DETAIL*)detail)->level);
+            else
+                RENDER_VERBATIM(r, head[((MD_BLOCK_H_DETAIL*)detail)->level - 1]);
+            break;
         case MD_BLOCK_CODE:     RENDER_VERBATIM(r, "</code></pre>\n"); break;
         case MD_BLOCK_HTML:     /* noop */ break;
         case MD_BLOCK_P:        RENDER_VERBATIM(r, "</p>\n"); break;
@@ -499,6 +953,9 @@ text_callback(MD_TEXTTYPE type, const MD_CHAR* text, MD_SIZE size, void* userdat
 {
     MD_HTML* r = (MD_HTML*) userdata;
 
+    if(r->capture == &r->heading_html  &&  r->image_nesting_level == 0)
+        collect_heading_text(r, type, text, size);
+
     switch(type) {
         case MD_TEXT_NULLCHAR:  render_utf8_codepoint(r, 0x0000, render_verbatim); break;
         case MD_TEXT_BR:        RENDER_VERBATIM(r, (r->image_nesting_level == 0
@@ -522,14 +979,55 @@ debug_log_callback(const char* msg, void* userdata)
         fprintf(stderr, "MD4C: %s\n", msg);
 }
 
-int
-md_html(const MD_CHAR* input, MD_SIZE input_size,
-        void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
-        void* userdata, unsigned parser_flags, unsigned renderer_flags)
+/* Set up the renderer, with the map of characters which need escaping. */
+static void
+render_init(MD_HTML* r, void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+            void* userdata, unsigned renderer_flags)
 {
-    MD_HTML render = { process_output, userdata, renderer_flags, 0, { 0 } };
     int i;
 
+    memset(r, 0, sizeof(MD_HTML));
+    r->process_output = process_output;
+    r->userdata = userdata;
+    r->flags = renderer_flags;
+
+    for(i = 0; i < 256; i++) {
+        unsigned char ch = (unsigned char) i;
+
+        if(strchr("\"&<>", ch) != NULL)
+            r->escape_map[i] |= NEED_HTML_ESC_FLAG;
+
+        if(!ISALNUM(ch)  &&  strchr("~-_.+!*(),%#@?=;:/,+$", ch) == NULL)
+            r->escape_map[i] |= NEED_URL_ESC_FLAG;
+    }
+}
+
+/* Flush what is left and free the buffers. Returns -1 if any allocation
+ * failed, 'ret' otherwise. */
+static int
+render_fini(MD_HTML* r, int ret)
+{
+    flush_output(r);
+    if(ret == 0)
+        finish_toc(r);
+
+    free(r->heading_html.data);
+    free(r->heading_text.data);
+    free(r->ids.data);
+    free(r->id_table);
+    free(r->toc.data);
+    return (ret == 0  &&  r->failed ? -1 : ret);
+}
+
+int
+md_html_ex(const MD_CHAR* input, MD_SIZE input_size,
+           void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+           void* userdata, unsigned parser_flags, unsigned renderer_flags,
+           MD_PARSE_CONTEXT* pc)
+{
+    MD_HTML render;
+    int ret;
+
     MD_PARSER parser = {
         0,
         parser_flags,
@@ -542,16 +1040,7 @@ md_html(const MD_CHAR* input, MD_SIZE input_size,
         NULL
     };
 
-    /* Build map of characters which need escaping. */
-    for(i = 0; i < 256; i++) {
-        unsigned char ch = (unsigned char) i;
-
-        if(strchr("\"&<>", ch) != NULL)
-            render.escape_map[i] |= NEED_HTML_ESC_FLAG;
-
-        if(!ISALNUM(ch)  &&  strchr("~-_.+!*(),%#@?=;:/,+$", ch) == NULL)
-            render.escape_map[i] |= NEED_URL_ESC_FLAG;
-    }
+    render_init(&render, process_output, userdata, renderer_flags);
 
     /* Consider skipping UTF-8 byte order mark (BOM). */
     if(renderer_flags & MD_HTML_FLAG_SKIP_UTF8_BOM  &&  sizeof(MD_CHAR) == 1) {
@@ -562,6 +1051,56 @@ md_html(const MD_CHAR* input, MD_SIZE input_size,
         }
     }
 
-    return md_parse(input, input_size, &parser, (void*) &render);
+    ret = md_parse_ex(input, input_size, &parser, (void*) &render, pc);
+    return render_fini(&render, ret);
+}
+
+int
+md_html_ast_toc(const MD_AST* ast,
+                void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                void* userdata,
+                void (*process_toc)(const MD_CHAR*, MD_SIZE, void*),
+                void* toc_userdata, unsigned renderer_flags)
+{
+    MD_HTML render;
+    int ret;
+
+    MD_PARSER parser = {
+        0,
+        0,
+        enter_block_callback,
+        leave_block_callback,
+        enter_span_callback,
+        leave_span_callback,
+        text_callback,
+        NULL,
+        NULL
+    };
+
+    render_init(&render, process_output, userdata, renderer_flags);
+    if(renderer_flags & MD_HTML_FLAG_HEADING_IDS) {
+        render.process_toc = process_toc;
+        render.toc_userdata = toc_userdata;
+    }
+    ret = md_ast_walk(ast, &parser, (void*) &render);
+    return render_fini(&render, ret);
+}
+
+int
+md_html_ast(const MD_AST* ast,
+            void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+            void* userdata, unsigned renderer_flags)
+{
+    return md_html_ast_toc(ast, process_output, userdata, NULL, NULL,
+                           renderer_flags);
+}
+
+int
+md_html(const MD_CHAR* input, MD_SIZE input_size,
+        void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+        void* userdata, unsigned parser_flags, unsigned renderer_flags)
+{
+    return md_html_ex(input, input_size, process_output, userdata,
+                      parser_flags, renderer_flags, NULL);
 }
 
@@ -27,6 +27,7 @@
 #define MD4C_HTML_H
 
 #include "md4c.h"
+#include "md4c-ast.h"
 
 #ifdef __cplusplus
     extern "C" {
@@ -38,6 +39,9 @@
 #define MD_HTML_FLAG_VERBATIM_ENTITIES      0x0002
 #define MD_HTML_FLAG_SKIP_UTF8_BOM          0x0004
 #define MD_HTML_FLAG_XHTML                  0x0008
+/* If set, headings get an id attribute made of their text (e.g. <h2
+ * id="getting-started">), unique within the document. */
+#define MD_HTML_FLAG_HEADING_IDS            0x0010
 
 
 /* Render Markdown into HTML.
@@ -53,13 +57,44 @@
  * Param parser_flags are flags from md4c.h propagated to md_parse().
  * Param render_flags is bitmask of MD_HTML_FLAG_xxxx.
  *
- * Returns -1 on error (if md_parse() fails.)
+ * Returns -1 on error (if md_parse() fails, or memory for heading ids runs
+ * out.)
  * Returns 0 on success.
  */
 int md_html(const MD_CHAR* input, MD_SIZE input_size,
             void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
             void* userdata, unsigned parser_flags, unsigned renderer_flags);
 
+/* Same as md_html(), parsing with the reusable working memory of 'pc'
+ * (see md_parse_context_new()).
+ */
+int md_html_ex(const MD_CHAR* input, MD_SIZE input_size,
+               void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+               void* userdata, unsigned parser_flags, unsigned renderer_flags,
+               MD_PARSE_CONTEXT* pc);
+
+/* Render a document parsed with md_ast_parse() into HTML. The AST is left
+ * unchanged, so it may be rendered again or walked for other outputs.
+ *
+ * MD_HTML_FLAG_SKIP_UTF8_BOM has no effect here: skip the BOM before
+ * md_ast_parse() instead. MD_HTML_FLAG_DEBUG has none either.
+ */
+int md_html_ast(const MD_AST* ast,
+                void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                void* userdata, unsigned renderer_flags);
+
+/* Same as md_html_ast(), also collecting a table of contents in the same
+ * pass when MD_HTML_FLAG_HEADING_IDS is set: a nested <ul> list linking
+ * every heading by its id, deeper levels nested in the item before them.
+ * It is passed to process_toc() once the document is rendered, and not at
+ * all if the document has no headings.
+ */
+int md_html_ast_toc(const MD_AST* ast,
+                    void (*process_output)(const MD_CHAR*, MD_SIZE, void*),
+                    void* userdata,
+                    void (*process_toc)(const MD_CHAR*, MD_SIZE, void*),
+                    void* toc_userdata, unsigned renderer_flags);
+
 
 #ifdef __cplusplus
     }  /* extern "C" { */
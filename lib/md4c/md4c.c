@@ -31,6 +31,20 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* SIMD scanning for inline mark characters (see md_skip_plain_xxx()) and
+ * for line ends and indentation (see md_lane_mask()). On x86 the mark char
+ * kernels are compiled for SSSE3 and AVX2 and picked at run time, as the
+ * baseline SSE2 has no byte shuffle. */
+#if !defined MD4C_USE_UTF16  &&  defined __GNUC__
+    #if defined __x86_64__  ||  defined __i386__
+        #include <immintrin.h>
+        #define MD_SIMD_X86     1
+    #elif defined __aarch64__  &&  defined __ARM_NEON
+        #include <arm_neon.h>
+        #define MD_SIMD_NEON    1
+    #endif
+#endif
+
 
 /*****************************
  ***  Miscellaneous Stuff  ***
@@ -162,6 +176,150 @@ struct MD_MARKSTACK_tag {
     int top;        /* -1 if empty. */
 };
 
+/* Arena for the short-lived allocations made while parsing one document
+ * (merged multi-line strings, attribute buffers, the ref. def. hashtable,
+ * table row scratch). Allocations are carved from chunks; freeing the
+ * allocation at the top of the arena gives its space back right away, any
+ * other is reclaimed by md_arena_reset() at the end of the document. A reset
+ * arena keeps a single chunk large enough for the last document, so
+ * parsing similar documents with a reused MD_PARSE_CONTEXT needs no new
+ * chunks. */
+#define MD_ARENA_ALIGN          16
+#define MD_ARENA_MIN_CHUNK      (64 * 1024)
+#define MD_ARENA_ROUND(sz)      (((sz) + MD_ARENA_ALIGN - 1) & ~(size_t)(MD_ARENA_ALIGN - 1))
+
+typedef struct MD_ARENA_CHUNK_tag MD_ARENA_CHUNK;
+struct MD_ARENA_CHUNK_tag {
+    MD_ARENA_CHUNK* prev;   /* Earlier chunks, still holding allocations. */
+    size_t size;            /* Usable bytes after the header. */
+};
+
+#define MD_ARENA_HEADER         MD_ARENA_ROUND(sizeof(MD_ARENA_CHUNK))
+
+typedef struct MD_ARENA_tag MD_ARENA;
+struct MD_ARENA_tag {
+    MD_ARENA_CHUNK* chunk;  /* Allocations come from here. */
+    size_t used;            /* Bytes used in 'chunk'. */
+};
+
+/* Each allocation is preceded by its (rounded) size. */
+#define MD_ARENA_PREFIX         MD_ARENA_ROUND(sizeof(size_t))
+
+static inline char*
+md_arena_top(MD_ARENA* arena)
+{
+    return (char*) arena->chunk + MD_ARENA_HEADER + arena->used;
+}
+
+static void*
+md_arena_alloc(MD_ARENA* arena, size_t size)
+{
+    char* ptr;
+
+    size = MD_ARENA_PREFIX + MD_ARENA_ROUND(size);
+    if(arena->chunk == NULL  ||  arena->used + size > arena->chunk->size) {
+        MD_ARENA_CHUNK* chunk;
+        size_t chunk_size = MD_ARENA_MIN_CHUNK;
+
+        if(arena->chunk != NULL  &&  chunk_size < 2 * arena->chunk->size)
+            chunk_size = 2 * arena->chunk->size;
+        while(chunk_size < size)
+            chunk_size *= 2;
+
+        chunk = (MD_ARENA_CHUNK*) malloc(MD_ARENA_HEADER + chunk_size);
+        if(chunk == NULL)
+            return NULL;
+        chunk->prev = arena->chunk;
+        chunk->size = chunk_size;
+        arena->chunk = chunk;
+        arena->used = 0;
+    }
+
+    ptr = md_arena_top(arena);
+    *(size_t*) ptr = size;
+    arena->used += size;
+    return ptr + MD_ARENA_PREFIX;
+}
+
+static inline size_t
+md_arena_size(void* ptr)
+{
+    return *(size_t*) ((char*) ptr - MD_ARENA_PREFIX);
+}
+
+static void
+md_arena_free(MD_ARENA* arena, void* ptr)
+{
+    /* Only the topmost allocation can be given back before the reset. */
+    if(ptr != NULL  &&  (char*) ptr - MD_ARENA_PREFIX + md_arena_size(ptr) == md_arena_top(arena))
+        arena->used -= md_arena_size(ptr);
+}
+
+static void*
+md_arena_realloc(MD_ARENA* arena, void* ptr, size_t size)
+{
+    size_t old_size;
+    void* new_ptr;
+
+    if(ptr == NULL)
+        return md_arena_alloc(arena, size);
+
+    /* The topmost allocation can grow in place. */
+    old_size = md_arena_size(ptr);
+    if((char*) ptr - MD_ARENA_PREFIX + old_size == md_arena_top(arena)) {
+        size_t new_size = MD_ARENA_PREFIX + MD_ARENA_ROUND(size);
+        if(arena->used - old_size + new_size <= arena->chunk->size) {
+            arena->used = arena->used - old_size + new_size;
+            *(size_t*) ((char*) ptr - MD_ARENA_PREFIX) = new_size;
+            return ptr;
+        }
+    }
+
+    new_ptr = md_arena_alloc(arena, size);
+    if(new_ptr != NULL)
+        memcpy(new_ptr, ptr, old_size - MD_ARENA_PREFIX);
+    return new_ptr;
+}
+
+static void
+md_arena_reset(MD_ARENA* arena)
+{
+    MD_ARENA_CHUNK* chunk = arena->chunk;
+    size_t total = 0;
+
+    if(chunk == NULL  ||  chunk->prev == NULL) {
+        arena->used = 0;
+        return;
+    }
+
+    /* The document needed several chunks. Replace them with one that holds
+     * as much; if that fails, the next document just starts from scratch. */
+    while(chunk != NULL) {
+        MD_ARENA_CHUNK* prev = chunk->prev;
+        total += chunk->size;
+        free(chunk);
+        chunk = prev;
+    }
+
+    chunk = (MD_ARENA_CHUNK*) malloc(MD_ARENA_HEADER + total);
+    if(chunk != NULL) {
+        chunk->prev = NULL;
+        chunk->size = total;
+    }
+    arena->chunk = chunk;
+    arena->used = 0;
+}
+
+static void
+md_arena_fini(MD_ARENA* arena)
+{
+    while(arena->chunk != NULL) {
+        MD_ARENA_CHUNK* prev = arena->chunk->prev;
+        free(arena->chunk);
+        arena->chunk = prev;
+    }
+}
+
 /* Context propagated through all the parsing. */
 typedef struct MD_CTX_tag MD_CTX;
 struct MD_CTX_tag {
@@ -174,6 +332,9 @@ struct MD_CTX_tag {
     /* When this is true, it allows some optimizations. */
     int doc_ends_with_newline;
 
+    /* Short-lived allocations. */
+    MD_ARENA* arena;
+
     /* Helper temporary growing buffer. */
     CHAR* buffer;
     unsigned alloc_buffer;
@@ -200,6 +361,14 @@ struct MD_CTX_tag {
     char mark_char_map[256];
 #endif
 
+    /* mark_char_map[] as nibble lookup tables for md_skip_plain_xxx():
+     * byte ch is a mark char iff (lo[ch & 0xf] & hi[ch >> 4]) != 0. */
+    unsigned char mark_nibbles_lo[16];
+    unsigned char mark_nibbles_hi[16];
+    OFF (*skip_plain)(const CHAR* /*text*/, OFF /*off*/, OFF /*end*/,
+                      const unsigned char* /*lo*/, const unsigned char* /*hi*/,
+                      int /*collapse*/);
+
     /* For resolving of inline spans. */
     MD_MARKSTACK opener_stacks[16];
 #define ASTERISK_OPENERS_oo_mod3_0      (ctx->opener_stacks[0])     /* Opener-only */
@@ -256,6 +425,14 @@ struct MD_CTX_tag {
     int n_containers;
     int alloc_containers;
 
+    /* Offsets of all '\r' and '\n' in the document, found in one pass by
+     * md_build_line_table(). line_end_next is the first entry not before
+     * the line being analyzed. */
+    OFF* line_ends;
+    int n_line_ends;
+    int alloc_line_ends;
+    int line_end_next;
+
     /* Minimal indentation to call the block "indented code block". */
     unsigned code_indent_offset;
 
@@ -1032,7 +1209,7 @@ md_merge_lines_alloc(MD_CTX* ctx, OFF beg, OFF end, const MD_LINE* lines, MD_SIZ
 {
     CHAR* buffer;
 
-    buffer = (CHAR*) malloc(sizeof(CHAR) * (end - beg));
+    buffer = (CHAR*) md_arena_alloc(ctx->arena, sizeof(CHAR) * (end - beg));
     if(buffer == NULL) {
         MD_LOG("malloc() failed.");
         return -1;
@@ -1434,18 +1611,17 @@ md_build_attr_append_substr(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build,
         build->substr_alloc = (build->substr_alloc > 0
                 ? build->substr_alloc + build->substr_alloc / 2
                 : 8);
-        new_substr_types = (MD_TEXTTYPE*) realloc(build->substr_types,
+        new_substr_types = (MD_TEXTTYPE*) md_arena_realloc(ctx->arena, build->substr_types,
                                     build->substr_alloc * sizeof(MD_TEXTTYPE));
         if(new_substr_types == NULL) {
             MD_LOG("realloc() failed.");
             return -1;
         }
         /* Note +1 to reserve space for final offset (== raw_size). */
-        new_substr_offsets = (OFF*) realloc(build->substr_offsets,
+        new_substr_offsets = (OFF*) md_arena_realloc(ctx->arena, build->substr_offsets,
                                     (build->substr_alloc+1) * sizeof(OFF));
         if(new_substr_offsets == NULL) {
             MD_LOG("realloc() failed.");
-            free(new_substr_types);
             return -1;
         }
 
@@ -1462,12 +1638,11 @@ md_build_attr_append_substr(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build,
 static void
 md_free_attribute(MD_CTX* ctx, MD_ATTRIBUTE_BUILD* build)
 {
-    MD_UNUSED(ctx);
-
+    /* In reverse order of allocation, so the arena can take them all back. */
     if(build->substr_alloc > 0) {
-        free(build->text);
-        free(build->substr_types);
-        free(build->substr_offsets);
+        md_arena_free(ctx->arena, build->substr_offsets);
+        md_arena_free(ctx->arena, build->substr_types);
+        md_arena_free(ctx->arena, build->text);
     }
 }
 
@@ -1502,7 +1677,7 @@ md_build_attribute(MD_CTX* ctx, const CHAR* raw_text, SZ raw_size,
         build->trivial_offsets[1] = raw_size;
         off = raw_size;
     } else {
-        build->text = (CHAR*) malloc(raw_size * sizeof(CHAR));
+        build->text = (CHAR*) md_arena_alloc(ctx->arena, raw_size * sizeof(CHAR));
         if(build->text == NULL) {
             MD_LOG("malloc() failed.");
             goto abort;
@@ -1746,7 +1921,7 @@ md_build_ref_def_hashtable(MD_CTX* ctx)
         return 0;
 
     ctx->ref_def_hashtable_size = (ctx->n_ref_defs * 5) / 4;
-    ctx->ref_def_hashtable = malloc(ctx->ref_def_hashtable_size * sizeof(void*));
+    ctx->ref_def_hashtable = md_arena_alloc(ctx->arena, ctx->ref_def_hashtable_size * sizeof(void*));
     if(ctx->ref_def_hashtable == NULL) {
         MD_LOG("malloc() failed.");
         goto abort;
@@ -1785,7 +1960,7 @@ md_build_ref_def_hashtable(MD_CTX* ctx)
             }
 
             /* Make the bucket complex, i.e. able to hold more ref. defs. */
-            list = (MD_REF_DEF_LIST*) malloc(sizeof(MD_REF_DEF_LIST) + 2 * sizeof(MD_REF_DEF*));
+            list = (MD_REF_DEF_LIST*) md_arena_alloc(ctx->arena, sizeof(MD_REF_DEF_LIST) + 2 * sizeof(MD_REF_DEF*));
             if(list == NULL) {
                 MD_LOG("malloc() failed.");
                 goto abort;
@@ -1807,7 +1982,7 @@ md_build_ref_def_hashtable(MD_CTX* ctx)
         list = (MD_REF_DEF_LIST*) bucket;
         if(list->n_ref_defs >= list->alloc_ref_defs) {
             int alloc_ref_defs = list->alloc_ref_defs + list->alloc_ref_defs / 2;
-            MD_REF_DEF_LIST* list_tmp = (MD_REF_DEF_LIST*) realloc(list,
+            MD_REF_DEF_LIST* list_tmp = (MD_REF_DEF_LIST*) md_arena_realloc(ctx->arena, list,
                         sizeof(MD_REF_DEF_LIST) + alloc_ref_defs * sizeof(MD_REF_DEF*));
             if(list_tmp == NULL) {
                 MD_LOG("realloc() failed.");
@@ -1863,10 +2038,10 @@ md_free_ref_def_hashtable(MD_CTX* ctx)
                 continue;
             if(ctx->ref_defs <= (MD_REF_DEF*) bucket  &&  (MD_REF_DEF*) bucket < ctx->ref_defs + ctx->n_ref_defs)
                 continue;
-            free(bucket);
+            md_arena_free(ctx->arena, bucket);
         }
 
-        free(ctx->ref_def_hashtable);
+        md_arena_free(ctx->arena, ctx->ref_def_hashtable);
     }
 }
 
@@ -2272,10 +2447,10 @@ md_is_link_reference_definition(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lin
 
 abort:
     /* Failure. */
-    if(def != NULL  &&  def->label_needs_free)
-        free(def->label);
     if(def != NULL  &&  def->title_needs_free)
-        free(def->title);
+        md_arena_free(ctx->arena, def->title);
+    if(def != NULL  &&  def->label_needs_free)
+        md_arena_free(ctx->arena, def->label);
     return ret;
 }
 
@@ -2321,7 +2496,7 @@ md_is_link_reference(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines,
     }
 
     if(is_multiline)
-        free(label);
+        md_arena_free(ctx->arena, label);
 
     if(def != NULL) {
         /* See https://github.com/mity/md4c/issues/238 */
@@ -2443,13 +2618,11 @@ md_free_ref_defs(MD_CTX* ctx)
     for(i = 0; i < ctx->n_ref_defs; i++) {
         MD_REF_DEF* def = &ctx->ref_defs[i];
 
-        if(def->label_needs_free)
-            free(def->label);
         if(def->title_needs_free)
-            free(def->title);
+            md_arena_free(ctx->arena, def->title);
+        if(def->label_needs_free)
+            md_arena_free(ctx->arena, def->label);
     }
-
-    free(ctx->ref_defs);
 }
 
 
@@ -2727,6 +2900,127 @@ md_rollback(MD_CTX* ctx, int opener_index, int closer_index, int how)
     }
 }
 
+/* Each md_skip_plain_xxx() returns the offset of the first mark char in
+ * text[off..end), or the offset where fewer bytes than one vector remain.
+ * Set membership is tested with two 16-entry nibble tables looked up by a
+ * byte shuffle; every high nibble of an 8-bit mark char (0x0 - 0x7) owns
+ * one bit, so the test is exact.
+ *
+ * With 'collapse' (MD_FLAG_COLLAPSEWHITESPACE), whitespace is in the set,
+ * but a lone ' ' followed by something else is left alone by
+ * md_collect_marks(), so it is skipped here too. Otherwise prose would stop
+ * the scan at every word. Looking at the byte after the vector needs one
+ * more byte before 'end'. */
+#ifdef MD_SIMD_X86
+__attribute__((target("ssse3")))
+static OFF
+md_skip_plain_ssse3(const CHAR* text, OFF off, OFF end,
+                    const unsigned char* lo, const unsigned char* hi, int collapse)
+{
+    const __m128i lo_table = _mm_loadu_si128((const __m128i*) lo);
+    const __m128i hi_table = _mm_loadu_si128((const __m128i*) hi);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i three = _mm_set1_epi8(3);
+    const OFF width = (collapse ? 17 : 16);
+
+    while(off + width <= end) {
+        __m128i v = _mm_loadu_si128((const __m128i*) (text + off));
+        __m128i m = _mm_and_si128(
+                _mm_shuffle_epi8(lo_table, _mm_and_si128(v, nibble)),
+                _mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+        unsigned mask;
+
+        if(collapse) {
+            /* Next byte is ' ' or in '\t'..'\f' ('\n' never is in a line). */
+            __m128i next = _mm_loadu_si128((const __m128i*) (text + off + 1));
+            __m128i t = _mm_sub_epi8(next, tab);
+            __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(next, space),
+                                      _mm_cmpeq_epi8(_mm_min_epu8(t, three), t));
+            m = _mm_andnot_si128(_mm_andnot_si128(ws, _mm_cmpeq_epi8(v, space)), m);
+        }
+        mask = ~(unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(m, zero)) & 0xffff;
+
+        if(mask != 0)
+            return off + (OFF) __builtin_ctz(mask);
+        off += 16;
+    }
+    return off;
+}
+
+__attribute__((target("avx2")))
+static OFF
+md_skip_plain_avx2(const CHAR* text, OFF off, OFF end,
+                   const unsigned char* lo, const unsigned char* hi, int collapse)
+{
+    const __m256i lo_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) lo));
+    const __m256i hi_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) hi));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i three = _mm256_set1_epi8(3);
+    const OFF width = (collapse ? 33 : 32);
+
+    while(off + width <= end) {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (text + off));
+        __m256i m = _mm256_and_si256(
+                _mm256_shuffle_epi8(lo_table, _mm256_and_si256(v, nibble)),
+                _mm256_shuffle_epi8(hi_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+        unsigned mask;
+
+        if(collapse) {
+            __m256i next = _mm256_loadu_si256((const __m256i*) (text + off + 1));
+            __m256i t = _mm256_sub_epi8(next, tab);
+            __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(next, space),
+                                         _mm256_cmpeq_epi8(_mm256_min_epu8(t, three), t));
+            m = _mm256_andnot_si256(_mm256_andnot_si256(ws, _mm256_cmpeq_epi8(v, space)), m);
+        }
+        mask = ~(unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(m, zero));
+
+        if(mask != 0)
+            return off + (OFF) __builtin_ctz(mask);
+        off += 32;
+    }
+    return off;
+}
+#endif
+
+#ifdef MD_SIMD_NEON
+static OFF
+md_skip_plain_neon(const CHAR* text, OFF off, OFF end,
+                   const unsigned char* lo, const unsigned char* hi, int collapse)
+{
+    const uint8x16_t lo_table = vld1q_u8(lo);
+    const uint8x16_t hi_table = vld1q_u8(hi);
+    const uint8x16_t nibble = vdupq_n_u8(0x0f);
+    const uint8x16_t space = vdupq_n_u8(' ');
+    const OFF width = (collapse ? 17 : 16);
+
+    while(off + width <= end) {
+        uint8x16_t v = vld1q_u8((const uint8_t*) (text + off));
+        uint8x16_t m = vandq_u8(vqtbl1q_u8(lo_table, vandq_u8(v, nibble)),
+                                vqtbl1q_u8(hi_table, vshrq_n_u8(v, 4)));
+        if(collapse) {
+            uint8x16_t next = vld1q_u8((const uint8_t*) (text + off + 1));
+            uint8x16_t ws = vorrq_u8(vceqq_u8(next, space),
+                                     vcleq_u8(vsubq_u8(next, vdupq_n_u8('\t')), vdupq_n_u8(3)));
+            m = vbicq_u8(m, vbicq_u8(vceqq_u8(v, space), ws));
+        }
+        /* Narrow each lane to 4 bits of a 64-bit mask. */
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(
+                    vshrn_n_u16(vreinterpretq_u16_u8(vtstq_u8(m, m)), 4)), 0);
+
+        if(mask != 0)
+            return off + (OFF) (__builtin_ctzll(mask) / 4);
+        off += 16;
+    }
+    return off;
+}
+#endif
+
 static void
 md_build_mark_char_map(MD_CTX* ctx)
 {
@@ -2771,6 +3065,31 @@ md_build_mark_char_map(MD_CTX* ctx)
                 ctx->mark_char_map[i] = 1;
         }
     }
+
+#if defined MD_SIMD_X86  ||  defined MD_SIMD_NEON
+    {
+        int i;
+
+        memset(ctx->mark_nibbles_lo, 0, sizeof(ctx->mark_nibbles_lo));
+        memset(ctx->mark_nibbles_hi, 0, sizeof(ctx->mark_nibbles_hi));
+        /* Mark chars are all ASCII; bytes >= 0x80 find a zero hi entry. */
+        for(i = 0; i < 8; i++)
+            ctx->mark_nibbles_hi[i] = (unsigned char) (1 << i);
+        for(i = 0; i < 128; i++) {
+            if(ctx->mark_char_map[i])
+                ctx->mark_nibbles_lo[i & 0xf] |= ctx->mark_nibbles_hi[i >> 4];
+        }
+    }
+#endif
+
+#if defined MD_SIMD_X86
+    if(__builtin_cpu_supports("avx2"))
+        ctx->skip_plain = md_skip_plain_avx2;
+    else if(__builtin_cpu_supports("ssse3"))
+        ctx->skip_plain = md_skip_plain_ssse3;
+#elif defined MD_SIMD_NEON
+    ctx->skip_plain = md_skip_plain_neon;
+#endif
 }
 
 static int
@@ -3025,6 +3344,12 @@ md_collect_marks(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines, int table_m
     #define IS_MARK_CHAR(off)   (ctx->mark_char_map[(unsigned char) CH(off)])
 #endif
 
+            /* Skip plain text a vector at a time, then finish the tail. */
+            if(ctx->skip_plain != NULL)
+                off = ctx->skip_plain(ctx->text, off, line->end,
+                            ctx->mark_nibbles_lo, ctx->mark_nibbles_hi,
+                            (ctx->parser.flags & MD_FLAG_COLLAPSEWHITESPACE));
+
             /* Optimization: Use some loop unrolling. */
             while(off + 3 < line->end  &&  !IS_MARK_CHAR(off+0)  &&  !IS_MARK_CHAR(off+1)
                                        &&  !IS_MARK_CHAR(off+2)  &&  !IS_MARK_CHAR(off+3))
@@ -3576,7 +3901,7 @@ md_resolve_links(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_lines)
                             if(ctx->marks[mark->next].beg >= inline_link_end) {
                                 /* Cancel the link status. */
                                 if(attr.title_needs_free)
-                                    free(attr.title);
+                                    md_arena_free(ctx->arena, attr.title);
                                 is_link = FALSE;
                                 break;
                             }
@@ -4571,7 +4896,7 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
     /* We have to remember the cell boundaries in local buffer because
      * ctx->marks[] shall be reused during cell contents processing. */
     n = ctx->n_table_cell_boundaries + 2;
-    pipe_offs = (OFF*) malloc(n * sizeof(OFF));
+    pipe_offs = (OFF*) md_arena_alloc(ctx->arena, n * sizeof(OFF));
     if(pipe_offs == NULL) {
         MD_LOG("malloc() failed.");
         ret = -1;
@@ -4599,7 +4924,7 @@ md_process_table_row(MD_CTX* ctx, MD_BLOCKTYPE cell_type, OFF beg, OFF end,
     MD_LEAVE_BLOCK(MD_BLOCK_TR, NULL);
 
 abort:
-    free(pipe_offs);
+    md_arena_free(ctx->arena, pipe_offs);
 
     ctx->table_cell_boundaries_head = -1;
     ctx->table_cell_boundaries_tail = -1;
@@ -4618,7 +4943,7 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
      * with the underlines. */
     MD_ASSERT(n_lines >= 2);
 
-    align = malloc(col_count * sizeof(MD_ALIGN));
+    align = md_arena_alloc(ctx->arena, col_count * sizeof(MD_ALIGN));
     if(align == NULL) {
         MD_LOG("malloc() failed.");
         ret = -1;
@@ -4642,7 +4967,7 @@ md_process_table_block_contents(MD_CTX* ctx, int col_count, const MD_LINE* lines
     }
 
 abort:
-    free(align);
+    md_arena_free(ctx->arena, align);
     return ret;
 }
 
@@ -4699,7 +5024,7 @@ md_process_normal_block_contents(MD_CTX* ctx, const MD_LINE* lines, MD_SIZE n_li
 abort:
     /* Free any temporary memory blocks stored within some dummy marks. */
     for(i = ctx->ptr_stack.top; i >= 0; i = ctx->marks[i].next)
-        free(md_mark_get_ptr(ctx, i));
+        md_arena_free(ctx->arena, md_mark_get_ptr(ctx, i));
     ctx->ptr_stack.top = -1;
 
     return ret;
@@ -5796,12 +6121,146 @@ md_is_container_mark(MD_CTX* ctx, unsigned indent, OFF beg, OFF* p_end, MD_CONTA
     return FALSE;
 }
 
+/********************
+ ***  Line Table  ***
+ ********************/
+
+/* md_lane_mask(p, ch) sets lane bits for the bytes in p[0..MD_LANES) equal
+ * to ch; a lane spans MD_LANE_BITS bits (all set when it matches). */
+#if defined MD_SIMD_X86  &&  defined __AVX2__
+    #define MD_LANES        32
+    #define MD_LANE_BITS    1
+    #define MD_LANE_ONES    1ULL
+
+    static inline uint64_t
+    md_lane_mask(const CHAR* p, CHAR ch)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*) p);
+        return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch)));
+    }
+#elif defined MD_SIMD_X86  &&  defined __SSE2__
+    #define MD_LANES        16
+    #define MD_LANE_BITS    1
+    #define MD_LANE_ONES    1ULL
+
+    static inline uint64_t
+    md_lane_mask(const CHAR* p, CHAR ch)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*) p);
+        return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(ch)));
+    }
+#elif defined MD_SIMD_NEON
+    #define MD_LANES        16
+    #define MD_LANE_BITS    4
+    #define MD_LANE_ONES    0xfULL
+
+    static inline uint64_t
+    md_lane_mask(const CHAR* p, CHAR ch)
+    {
+        uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t*) p), vdupq_n_u8((uint8_t) ch));
+        return vget_lane_u64(vreinterpret_u64_u8(
+                    vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+    }
+#endif
+
+static int
+md_push_line_end(MD_CTX* ctx, OFF off)
+{
+    if(ctx->n_line_ends >= ctx->alloc_line_ends) {
+        OFF* new_line_ends;
+
+        ctx->alloc_line_ends = (ctx->alloc_line_ends > 0
+                ? ctx->alloc_line_ends + ctx->alloc_line_ends / 2
+                : 256);
+        new_line_ends = realloc(ctx->line_ends, ctx->alloc_line_ends * sizeof(OFF));
+        if(new_line_ends == NULL) {
+            MD_LOG("realloc() failed.");
+            return -1;
+        }
+
+        ctx->line_ends = new_line_ends;
+    }
+
+    ctx->line_ends[ctx->n_line_ends++] = off;
+    return 0;
+}
+
+/* Records the offset of every line break character of the document, so
+ * md_analyze_line() finds the end of each line with a table lookup. */
+static int
+md_build_line_table(MD_CTX* ctx)
+{
+    OFF off = 0;
+    int ret = 0;
+
+    ctx->n_line_ends = 0;
+    ctx->line_end_next = 0;
+
+#ifdef MD_LANES
+    while(off + MD_LANES <= ctx->size) {
+        uint64_t mask = md_lane_mask(STR(off), _T('\n')) | md_lane_mask(STR(off), _T('\r'));
+
+        while(mask != 0) {
+            int bit = __builtin_ctzll(mask);
+            MD_CHECK(md_push_line_end(ctx, off + (OFF) (bit / MD_LANE_BITS)));
+            mask &= ~(MD_LANE_ONES << bit);
+        }
+        off += MD_LANES;
+    }
+#endif
+
+    for(; off < ctx->size; off++) {
+        if(ISNEWLINE(off))
+            MD_CHECK(md_push_line_end(ctx, off));
+    }
+
+abort:
+    return ret;
+}
+
+/* Returns offset of the first line break at or after 'off', or the document
+ * size if there is none. */
+static inline OFF
+md_line_table_next(MD_CTX* ctx, OFF off)
+{
+    int i = ctx->line_end_next;
+
+    while(i > 0  &&  ctx->line_ends[i-1] >= off)
+        i--;
+    while(i < ctx->n_line_ends  &&  ctx->line_ends[i] < off)
+        i++;
+
+    ctx->line_end_next = i;
+    return (i < ctx->n_line_ends ? ctx->line_ends[i] : ctx->size);
+}
+
 static unsigned
 md_line_indentation(MD_CTX* ctx, unsigned total_indent, OFF beg, OFF* p_end)
 {
     OFF off = beg;
     unsigned indent = total_indent;
 
+#ifdef MD_LANES
+    /* Skip long runs of spaces (e.g. deeply indented code) a vector at a
+     * time; tabs and the rest are handled below. */
+    if(off + 1 < ctx->size  &&  CH(off) == _T(' ')  &&  CH(off+1) == _T(' ')) {
+        while(off + MD_LANES <= ctx->size) {
+            uint64_t mask = ~md_lane_mask(STR(off), _T(' '));
+
+            if(MD_LANES * MD_LANE_BITS < 64)
+                mask &= (1ULL << (MD_LANES * MD_LANE_BITS)) - 1;
+            if(mask != 0) {
+                unsigned n = (unsigned) __builtin_ctzll(mask) / MD_LANE_BITS;
+                off += n;
+                indent += n;
+                break;
+            }
+            off += MD_LANES;
+            indent += MD_LANES;
+        }
+    }
+#endif
+
     while(off < ctx->size  &&  ISBLANK(off)) {
         if(CH(off) == _T('\t'))
             indent = (indent + 4) & ~3;
@@ -6214,35 +6673,8 @@ md_analyze_line(MD_CTX* ctx, OFF beg, OFF* p_end,
         break;
     }
 
-    /* Scan for end of the line.
-     *
-     * Note this is quite a bottleneck of the parsing as we here iterate almost
-     * over compete document.
-     */
-#if defined __linux__ && !defined MD4C_USE_UTF16
-    /* Recent glibc versions have superbly optimized strcspn(), even using
-     * vectorization if available. */
-    if(ctx->doc_ends_with_newline  &&  off < ctx->size) {
-        while(TRUE) {
-            off += (OFF) strcspn(STR(off), "\r\n");
-
-            /* strcspn() can stop on zero terminator; but that can appear
-             * anywhere in the Markfown input... */
-            if(CH(off) == _T('\0'))
-                off++;
-            else
-                break;
-        }
-    } else
-#endif
-    {
-        /* Optimization: Use some loop unrolling. */
-        while(off + 3 < ctx->size  &&  !ISNEWLINE(off+0)  &&  !ISNEWLINE(off+1)
-                                   &&  !ISNEWLINE(off+2)  &&  !ISNEWLINE(off+3))
-            off += 4;
-        while(off < ctx->size  &&  !ISNEWLINE(off))
-            off++;
-    }
+    /* Find end of the line. */
+    off = md_line_table_next(ctx, off);
 
     /* Set end of the line. */
     line->end = off;
@@ -6392,6 +6824,8 @@ md_process_doc(MD_CTX *ctx)
     OFF off = 0;
     int ret = 0;
 
+    MD_CHECK(md_build_line_table(ctx));
+
     MD_ENTER_BLOCK(MD_BLOCK_DOC, NULL);
 
     while(off < ctx->size) {
@@ -6444,13 +6878,62 @@ abort:
  ***  Public API  ***
  ********************/
 
+/* Working memory carried from one document to the next: the growing
+ * arrays are kept at their largest size and the arena is reset. */
+struct MD_PARSE_CONTEXT_tag {
+    CHAR* buffer;
+    unsigned alloc_buffer;
+    MD_REF_DEF* ref_defs;
+    int alloc_ref_defs;
+    MD_MARK* marks;
+    int alloc_marks;
+    void* block_bytes;
+    int alloc_block_bytes;
+    MD_CONTAINER* containers;
+    int alloc_containers;
+    OFF* line_ends;
+    int alloc_line_ends;
+    MD_ARENA arena;
+};
+
+MD_PARSE_CONTEXT*
+md_parse_context_new(void)
+{
+    return (MD_PARSE_CONTEXT*) calloc(1, sizeof(MD_PARSE_CONTEXT));
+}
+
+static void
+md_parse_context_fini(MD_PARSE_CONTEXT* pc)
+{
+    free(pc->buffer);
+    free(pc->ref_defs);
+    free(pc->marks);
+    free(pc->block_bytes);
+    free(pc->containers);
+    free(pc->line_ends);
+    md_arena_fini(&pc->arena);
+}
+
+void
+md_parse_context_free(MD_PARSE_CONTEXT* pc)
+{
+    if(pc != NULL) {
+        md_parse_context_fini(pc);
+        free(pc);
+    }
+}
+
 int
-md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata)
+md_parse_ex(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata,
+            MD_PARSE_CONTEXT* pc)
 {
     MD_CTX ctx;
     int i;
     int ret;
 
+    if(pc == NULL)
+        return md_parse(text, size, parser, userdata);
+
     if(parser->abi_version != 0) {
         if(parser->debug_log != NULL)
             parser->debug_log("Unsupported abi_version.", userdata);
@@ -6468,6 +6951,21 @@ md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userd
     ctx.doc_ends_with_newline = (size > 0  &&  ISNEWLINE_(text[size-1]));
     ctx.max_ref_def_output = MIN(MIN(16 * (uint64_t)size, (uint64_t)(1024 * 1024)), (uint64_t)SZ_MAX);
 
+    /* Adopt the buffers of the previous document. */
+    ctx.arena = &pc->arena;
+    ctx.buffer = pc->buffer;
+    ctx.alloc_buffer = pc->alloc_buffer;
+    ctx.ref_defs = pc->ref_defs;
+    ctx.alloc_ref_defs = pc->alloc_ref_defs;
+    ctx.marks = pc->marks;
+    ctx.alloc_marks = pc->alloc_marks;
+    ctx.block_bytes = pc->block_bytes;
+    ctx.alloc_block_bytes = pc->alloc_block_bytes;
+    ctx.containers = pc->containers;
+    ctx.alloc_containers = pc->alloc_containers;
+    ctx.line_ends = pc->line_ends;
+    ctx.alloc_line_ends = pc->alloc_line_ends;
+
     /* Reset all mark stacks and lists. */
     for(i = 0; i < (int) SIZEOF_ARRAY(ctx.opener_stacks); i++)
         ctx.opener_stacks[i].top = -1;
@@ -6483,10 +6981,31 @@ md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userd
     /* Clean-up. */
     md_free_ref_defs(&ctx);
     md_free_ref_def_hashtable(&ctx);
-    free(ctx.buffer);
-    free(ctx.marks);
-    free(ctx.block_bytes);
-    free(ctx.containers);
+    md_arena_reset(&pc->arena);
+    pc->buffer = ctx.buffer;
+    pc->alloc_buffer = ctx.alloc_buffer;
+    pc->ref_defs = ctx.ref_defs;
+    pc->alloc_ref_defs = ctx.alloc_ref_defs;
+    pc->marks = ctx.marks;
+    pc->alloc_marks = ctx.alloc_marks;
+    pc->block_bytes = ctx.block_bytes;
+    pc->alloc_block_bytes = ctx.alloc_block_bytes;
+    pc->containers = ctx.containers;
+    pc->alloc_containers = ctx.alloc_containers;
+    pc->line_ends = ctx.line_ends;
+    pc->alloc_line_ends = ctx.alloc_line_ends;
+
+    return ret;
+}
+
+int
+md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata)
+{
+    MD_PARSE_CONTEXT pc;
+    int ret;
 
+    memset(&pc, 0, sizeof(pc));
+    ret = md_parse_ex(text, size, parser, userdata, &pc);
+    md_parse_context_fini(&pc);
     return ret;
 }
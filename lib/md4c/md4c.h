@@ -400,6 +400,28 @@ typedef MD_PARSER MD_RENDERER;
 int md_parse(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata);
 
 
+/* Reusable parser working memory.
+ *
+ * md_parse() allocates its working buffers for every document and frees
+ * them afterwards. A context created with md_parse_context_new() keeps them
+ * between md_parse_ex() calls instead, grown to the largest document seen so
+ * far, so parsing a stream of similar documents settles into making no
+ * allocations at all.
+ *
+ * A context may be used by one md_parse_ex() call at a time; give each
+ * thread its own.
+ */
+typedef struct MD_PARSE_CONTEXT_tag MD_PARSE_CONTEXT;
+
+MD_PARSE_CONTEXT* md_parse_context_new(void);
+void md_parse_context_free(MD_PARSE_CONTEXT* pc);
+
+/* Same as md_parse(), using the working memory of 'pc' (if not NULL).
+ */
+int md_parse_ex(const MD_CHAR* text, MD_SIZE size, const MD_PARSER* parser, void* userdata,
+                MD_PARSE_CONTEXT* pc);
+
+
 #ifdef __cplusplus
     }  /* extern "C" { */
 #endif
@@ -0,0 +1,103 @@
+// src/chunked.c
+#include "../include/chunked.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// Sends every byte of `iov`, advancing it in place.
+static int send_iov(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = (size_t)count;
+    ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    size_t sent = (size_t)n;
+    while (count > 0 && sent >= iov->iov_len) {
+      sent -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + sent;
+      iov->iov_len -= sent;
+    }
+  }
+  return 0;
+}
+
+// Sends `data` as one chunk: size line, data, CRLF. Without chunked
+// encoding, just the data.
+static void send_chunk(struct chunked_writer *w, const char *data,
+                       size_t len) {
+  if (w->failed || len == 0)
+    return;
+  if (!w->chunked) {
+    struct iovec iov = {(void *)data, len};
+    if (send_iov(w->fd, &iov, 1) != 0)
+      w->failed = 1;
+    return;
+  }
+  char size_line[24];
+  int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+  struct iovec iov[3] = {{size_line, (size_t)n},
+                         {(void *)data, len},
+                         {"\r\n", 2}};
+  if (send_iov(w->fd, iov, 3) != 0)
+    w->failed = 1;
+}
+
+static void flush(struct chunked_writer *w) {
+  send_chunk(w, w->buf, w->len);
+  w->len = 0;
+}
+
+int chunked_begin(struct chunked_writer *w, int fd, const char *content_type,
+                  const char *version) {
+  w->fd = fd;
+  w->failed = 0;
+  w->len = 0;
+  w->chunked = !version || (strcmp(version, "HTTP/1.0") != 0 &&
+                            strcmp(version, "HTTP/0.9") != 0);
+
+  char headers[256];
+  int n = snprintf(headers, sizeof(headers),
+                   "HTTP/1.1 200 OK\r\n"
+                   "Content-Type: %s\r\n"
+                   "%s"
+                   "Cache-Control: no-cache\r\n"
+                   "Connection: close\r\n"
+                   "\r\n",
+                   content_type,
+                   w->chunked ? "Transfer-Encoding: chunked\r\n" : "");
+  struct iovec iov = {headers, (size_t)n};
+  if (send_iov(fd, &iov, 1) != 0)
+    w->failed = 1;
+  return w->failed ? -1 : 0;
+}
+
+void chunked_write(struct chunked_writer *w, const char *data, size_t len) {
+  if (w->len + len > sizeof(w->buf)) {
+    flush(w);
+    if (len >= sizeof(w->buf)) {
+      send_chunk(w, data, len);
+      return;
+    }
+  }
+  memcpy(w->buf + w->len, data, len);
+  w->len += len;
+}
+
+int chunked_end(struct chunked_writer *w) {
+  flush(w);
+  struct iovec iov = {"0\r\n\r\n", 5};
+  if (!w->failed && w->chunked && send_iov(w->fd, &iov, 1) != 0)
+    w->failed = 1;
+  return w->failed ? -1 : 0;
+}
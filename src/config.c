@@ -1,31 +1,43 @@
 #include "../include/config.h"
+#include "../include/vfs.h"
 #include "../lib/cJSON.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 struct server_config load_config(const char *filename) {
-  struct server_config config = {.port = 8080, .posts_per_page = 10};
+  struct server_config config = {.port = 8080,
+                                 .posts_per_page = 10,
+                                 .page_cache_mb = 64,
+                                 .snapshot_interval = 300,
+                                 .stream_threshold = 1024 * 1024};
   strcpy(config.host, "127.0.0.1");
   strcpy(config.static_dir, "./static");
   strcpy(config.blog_dir, "./content");
   strcpy(config.templates_dir, "./templates");
 
+  // A config.json on disk always wins over the embedded copy
   FILE *fp = fopen(filename, "r");
-  if (!fp) {
-    printf("Warning: Could not open config file, using defaults\n");
-    return config;
-  }
+  char *json_str = NULL;
+  if (fp) {
+    // Read the file
+    fseek(fp, 0, SEEK_END);
+    long file_size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
 
-  // Read the file
-  fseek(fp, 0, SEEK_END);
-  long file_size = ftell(fp);
-  fseek(fp, 0, SEEK_SET);
-
-  char *json_str = malloc(file_size + 1);
-  fread(json_str, 1, file_size, fp);
-  json_str[file_size] = '\0';
-  fclose(fp);
+    json_str = malloc(file_size + 1);
+    fread(json_str, 1, file_size, fp);
+    json_str[file_size] = '\0';
+    fclose(fp);
+  } else {
+    struct vfs_file file;
+    if (vfs_open(filename, &file) != 0) {
+      printf("Warning: Could not open config file, using defaults\n");
+      return config;
+    }
+    json_str = strdup(file.data);
+    vfs_close(&file);
+  }
 
   cJSON *json = cJSON_Parse(json_str);
   if (!json) {
@@ -59,6 +71,49 @@ struct server_config load_config(const char *filename) {
     if (templates_dir && templates_dir->valuestring)
       strncpy(config.templates_dir, templates_dir->valuestring,
               sizeof(config.templates_dir) - 1);
+
+    cJSON *embed_override = cJSON_GetObjectItem(server, "embed_override");
+    if (embed_override && cJSON_IsBool(embed_override))
+      config.embed_override = cJSON_IsTrue(embed_override);
+
+    cJSON *zerocopy = cJSON_GetObjectItem(server, "zerocopy_threshold");
+    if (zerocopy && cJSON_IsNumber(zerocopy) && zerocopy->valuedouble > 0)
+      config.zerocopy_threshold = (size_t)zerocopy->valuedouble;
+
+    cJSON *page_cache = cJSON_GetObjectItem(server, "page_cache_mb");
+    if (page_cache && cJSON_IsNumber(page_cache) && page_cache->valueint >= 0)
+      config.page_cache_mb = (size_t)page_cache->valueint;
+
+    cJSON *prerender = cJSON_GetObjectItem(server, "prerender_posts");
+    if (prerender && cJSON_IsBool(prerender))
+      config.prerender_posts = cJSON_IsTrue(prerender);
+
+    cJSON *pages = cJSON_GetObjectItem(server, "prerender_pages");
+    if (pages && cJSON_IsNumber(pages) && pages->valueint >= 0)
+      config.prerender_pages = pages->valueint;
+
+    cJSON *warm_log = cJSON_GetObjectItem(server, "warm_log");
+    if (warm_log && warm_log->valuestring)
+      strncpy(config.warm_log, warm_log->valuestring,
+              sizeof(config.warm_log) - 1);
+
+    cJSON *snapshot = cJSON_GetObjectItem(server, "snapshot_path");
+    if (snapshot && snapshot->valuestring)
+      strncpy(config.snapshot_path, snapshot->valuestring,
+              sizeof(config.snapshot_path) - 1);
+
+    cJSON *interval = cJSON_GetObjectItem(server, "snapshot_interval");
+    if (interval && cJSON_IsNumber(interval) && interval->valueint >= 0)
+      config.snapshot_interval = interval->valueint;
+
+    cJSON *pack = cJSON_GetObjectItem(server, "post_pack");
+    if (pack && pack->valuestring)
+      strncpy(config.post_pack, pack->valuestring,
+              sizeof(config.post_pack) - 1);
+
+    cJSON *stream = cJSON_GetObjectItem(server, "stream_threshold");
+    if (stream && cJSON_IsNumber(stream) && stream->valuedouble >= 0)
+      config.stream_threshold = (size_t)stream->valuedouble;
   }
 
   // Parse blog settings
@@ -1,10 +1,18 @@
 // src/error_pages.c
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 #include <unistd.h>
 #include "../include/error_pages.h"
+#include "../include/logger.h"
+#include "../include/mime.h"
+#include "../include/template.h"
+#include "../include/vfs.h"
 
-const char* ERROR_TEMPLATE =
+// Built-in fallback used when templates/error.html is missing
+static const char* ERROR_TEMPLATE =
     "<!DOCTYPE html>\n"
     "<html lang=\"en\">\n"
     "<head>\n"
@@ -30,25 +38,212 @@ const char* ERROR_TEMPLATE =
     "</body>\n"
     "</html>";
 
-void send_error_page(int client_fd, int status_code, const char* message) {
+struct canned_spec {
+    int status;
+    const char* message;
+    int plain; // text/plain body instead of the styled error page
+};
+
+// Every fixed response the server sends. Styled entries are also matched by
+// send_error_page() so existing call sites hit the table.
+static const struct canned_spec CANNED_SPECS[CANNED_COUNT] = {
+    [CANNED_HEALTH_OK] = {200, "OK", 1},
+    [CANNED_NOT_READY] = {503, "Warming up", 1},
+    [CANNED_NOT_FOUND_PLAIN] = {404, "404 Not Found", 1},
+    [CANNED_SERVER_ERROR_PLAIN] = {500, "500 Internal Server Error", 1},
+    [CANNED_FILE_NOT_FOUND] = {404, "File not found", 0},
+    [CANNED_PAGE_NOT_FOUND] = {404, "Page not found", 0},
+    [CANNED_MALFORMED_REQUEST] = {400, "Malformed request", 0},
+    [CANNED_INVALID_PATH] = {400, "Invalid path", 0},
+    [CANNED_HEADERS_TOO_LARGE] = {413, "Request headers too large", 0},
+    [CANNED_INTERNAL_ERROR] = {500, "Internal Server Error", 0},
+    [CANNED_INDEX_FAILED] = {500, "Failed to load blog index", 0},
+    [CANNED_POSTS_FAILED] = {500, "Failed to render posts", 0},
+    [CANNED_PAGINATION_FAILED] = {500, "Failed to render pagination", 0},
+    [CANNED_PAGE_FAILED] = {500, "Failed to render page", 0},
+    [CANNED_ABOUT_FAILED] = {500, "Failed to render about page", 0},
+};
+
+struct canned_table {
+    size_t map_size;
+    const char* data[CANNED_COUNT];
+    size_t len[CANNED_COUNT];
+};
+
+static struct canned_table* g_canned = NULL;
+static char g_templates_dir[256];
+static char g_error_tpl_path[512];
+static time_t g_error_tpl_mtime = 0;
+static time_t g_last_check = 0;
+
+static const char* status_text_for(int status_code) {
+    return status_code == 200 ? "OK" :
+           status_code == 404 ? "Not Found" :
+           status_code == 400 ? "Bad Request" :
+           status_code == 413 ? "Payload Too Large" :
+           status_code == 500 ? "Internal Server Error" :
+           status_code == 503 ? "Service Unavailable" : "Error";
+}
+
+static size_t format_response(char* out, size_t size, int status_code,
+                              const char* content_type, const char* body,
+                              size_t body_len) {
+    int n = snprintf(out, size,
+                     "HTTP/1.1 %d %s\r\n"
+                     "Content-Type: %s\r\n"
+                     "Content-Length: %zu\r\n"
+                     "Connection: close\r\n"
+                     "\r\n",
+                     status_code, status_text_for(status_code), content_type,
+                     body_len);
+    if (n < 0 || (size_t)n + body_len >= size) {
+        return 0;
+    }
+    memcpy(out + n, body, body_len);
+    out[n + body_len] = '\0';
+    return (size_t)n + body_len;
+}
+
+size_t format_error_page(char* out, size_t size, int status_code,
+                         const char* message) {
+    char status[16];
+    snprintf(status, sizeof(status), "%d", status_code);
+    struct template_kv kvs[2] = {
+        {"STATUS", status, 0},
+        {"MESSAGE", message, 0},
+    };
+
+    char* rendered = NULL;
+    if (g_error_tpl_path[0] &&
+        render_template_file(g_error_tpl_path, kvs, 2, &rendered) == 0 &&
+        rendered) {
+        size_t len = format_response(out, size, status_code, mime_html(),
+                                     rendered, strlen(rendered));
+        free_rendered_template(rendered);
+        return len;
+    }
+
     char body[4096];
-    snprintf(body, sizeof(body), ERROR_TEMPLATE, 
-             status_code, status_code, message);
-
-    char headers[512];
-    const char* status_text = 
-        status_code == 404 ? "Not Found" :
-        status_code == 400 ? "Bad Request" :
-        status_code == 500 ? "Internal Server Error" : "Error";
-
-    snprintf(headers, sizeof(headers),
-            "HTTP/1.1 %d %s\r\n"
-            "Content-Type: text/html\r\n"
-            "Content-Length: %lu\r\n"
-            "Connection: close\r\n"
-            "\r\n",
-            status_code, status_text, strlen(body));
-
-    write(client_fd, headers, strlen(headers));
-    write(client_fd, body, strlen(body));
+    int body_len = snprintf(body, sizeof(body), ERROR_TEMPLATE,
+                            status_code, status_code, message);
+    if (body_len < 0) {
+        return 0;
+    }
+    if ((size_t)body_len >= sizeof(body)) {
+        body_len = sizeof(body) - 1;
+    }
+    return format_response(out, size, status_code, mime_html(), body,
+                           (size_t)body_len);
+}
+
+static void free_canned_table(struct canned_table* table) {
+    if (table) {
+        munmap(table, table->map_size);
+    }
+}
+
+// Serializes every canned response into one mapping that is made read-only
+// once filled in.
+static struct canned_table* build_canned_table(void) {
+    static char scratch[CANNED_COUNT][8192];
+    size_t lens[CANNED_COUNT];
+    size_t total = sizeof(struct canned_table);
+
+    for (int i = 0; i < CANNED_COUNT; i++) {
+        const struct canned_spec* spec = &CANNED_SPECS[i];
+        lens[i] = spec->plain
+            ? format_response(scratch[i], sizeof(scratch[i]), spec->status,
+                              "text/plain", spec->message,
+                              strlen(spec->message))
+            : format_error_page(scratch[i], sizeof(scratch[i]), spec->status,
+                                spec->message);
+        if (lens[i] == 0) {
+            return NULL;
+        }
+        total += lens[i];
+    }
+
+    void* map = mmap(NULL, total, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    struct canned_table* table = map;
+    table->map_size = total;
+    char* w = (char*)map + sizeof(struct canned_table);
+    for (int i = 0; i < CANNED_COUNT; i++) {
+        memcpy(w, scratch[i], lens[i]);
+        table->data[i] = w;
+        table->len[i] = lens[i];
+        w += lens[i];
+    }
+
+    mprotect(map, total, PROT_READ);
+    return table;
+}
+
+int canned_init(const char* templates_dir) {
+    if (templates_dir != g_templates_dir) {
+        snprintf(g_templates_dir, sizeof(g_templates_dir), "%s", templates_dir);
+    }
+    snprintf(g_error_tpl_path, sizeof(g_error_tpl_path), "%s/error.html",
+             templates_dir);
+    g_error_tpl_mtime = 0;
+    vfs_stat(g_error_tpl_path, NULL, &g_error_tpl_mtime);
+    g_last_check = time(NULL);
+
+    struct canned_table* table = build_canned_table();
+    if (!table) {
+        logger_log(LOG_ERROR, "Failed to build canned responses");
+        return -1;
+    }
+
+    struct canned_table* old = g_canned;
+    g_canned = table;
+    free_canned_table(old);
+    return 0;
+}
+
+void canned_refresh(void) {
+    time_t now = time(NULL);
+    if (!g_canned || now == g_last_check) {
+        return;
+    }
+    g_last_check = now;
+
+    time_t mtime = 0;
+    vfs_stat(g_error_tpl_path, NULL, &mtime);
+    if (mtime != g_error_tpl_mtime) {
+        logger_log(LOG_INFO, "Error template changed, rebuilding canned responses");
+        canned_init(g_templates_dir);
+    }
+}
+
+void send_canned(int client_fd, enum canned_response id) {
+    if (!g_canned) {
+        const struct canned_spec* spec = &CANNED_SPECS[id];
+        send_error_page(client_fd, spec->status, spec->message);
+        return;
+    }
+    write(client_fd, g_canned->data[id], g_canned->len[id]);
+}
+
+void send_error_page(int client_fd, int status_code, const char* message) {
+    if (g_canned) {
+        for (int i = 0; i < CANNED_COUNT; i++) {
+            if (!CANNED_SPECS[i].plain && CANNED_SPECS[i].status == status_code &&
+                strcmp(CANNED_SPECS[i].message, message) == 0) {
+                write(client_fd, g_canned->data[i], g_canned->len[i]);
+                return;
+            }
+        }
+    }
+
+    char response[8192];
+    size_t len = format_error_page(response, sizeof(response), status_code,
+                                   message);
+    if (len > 0) {
+        write(client_fd, response, len);
+    }
 }
@@ -0,0 +1,541 @@
+// src/export.c
+#include "../include/export.h"
+#include "../include/error_pages.h"
+#include "../include/gzip.h"
+#include "../include/logger.h"
+#include "../include/mime.h"
+#include "../include/page_cache.h"
+#include "../include/post.h"
+#include "../include/post_index.h"
+#include "../include/server.h"
+#include "../include/vfs.h"
+#include "../include/workers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MANIFEST_NAME ".export-manifest"
+#define GZIP_MIN_SIZE 256 // smaller files are not worth a .gz
+
+struct manifest_entry {
+  char *path; // relative to the export directory
+  uint64_t fingerprint;
+};
+
+struct manifest {
+  struct manifest_entry *entries;
+  size_t count, cap;
+};
+
+// One output file. Rendered pages carry their body; static assets are
+// read from `source` by the worker that writes them.
+struct export_file {
+  char path[512];
+  uint64_t fingerprint;
+  const char *data;
+  size_t len;
+  char source[512];
+  int ok;
+};
+
+struct export_ctx {
+  struct server_config *config;
+  const char *out_dir;
+  struct manifest old;  // from the previous export, sorted by path
+  struct manifest next; // files present after this export
+  size_t written, unchanged, failed;
+};
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+#define FNV_OFFSET 1469598103934665603ULL
+
+static uint64_t hash_str(uint64_t h, const char *s) {
+  return fnv1a(h, s, strlen(s) + 1);
+}
+
+// Folds the identity of `path` (or its absence) into `h`.
+static uint64_t hash_source(uint64_t h, const char *path) {
+  struct vfs_identity id;
+  memset(&id, 0, sizeof(id));
+  vfs_identity(path, &id);
+  h = hash_str(h, path);
+  h = fnv1a(h, &id.ino, sizeof(id.ino));
+  h = fnv1a(h, &id.mtime, sizeof(id.mtime));
+  return fnv1a(h, &id.size, sizeof(id.size));
+}
+
+static int manifest_add(struct manifest *m, const char *path,
+                        uint64_t fingerprint) {
+  if (m->count == m->cap) {
+    size_t cap = m->cap ? m->cap * 2 : 256;
+    struct manifest_entry *entries = realloc(m->entries, cap * sizeof(*entries));
+    if (!entries)
+      return -1;
+    m->entries = entries;
+    m->cap = cap;
+  }
+  char *copy = strdup(path);
+  if (!copy)
+    return -1;
+  m->entries[m->count].path = copy;
+  m->entries[m->count].fingerprint = fingerprint;
+  m->count++;
+  return 0;
+}
+
+static void manifest_free(struct manifest *m) {
+  for (size_t i = 0; i < m->count; i++)
+    free(m->entries[i].path);
+  free(m->entries);
+  memset(m, 0, sizeof(*m));
+}
+
+static int compare_entries(const void *a, const void *b) {
+  return strcmp(((const struct manifest_entry *)a)->path,
+                ((const struct manifest_entry *)b)->path);
+}
+
+static const struct manifest_entry *manifest_find(const struct manifest *m,
+                                                  const char *path) {
+  struct manifest_entry key = {(char *)path, 0};
+  return m->count ? bsearch(&key, m->entries, m->count, sizeof(key),
+                            compare_entries)
+                  : NULL;
+}
+
+static void manifest_load(struct export_ctx *ctx) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", ctx->out_dir, MANIFEST_NAME);
+  FILE *f = fopen(path, "r");
+  if (!f)
+    return;
+
+  unsigned long long fingerprint;
+  char rel[512];
+  while (fscanf(f, "%16llx %511[^\n]\n", &fingerprint, rel) == 2)
+    manifest_add(&ctx->old, rel, (uint64_t)fingerprint);
+  fclose(f);
+  qsort(ctx->old.entries, ctx->old.count, sizeof(struct manifest_entry),
+        compare_entries);
+}
+
+static int mkdirs(const char *path) {
+  char buf[1024];
+  snprintf(buf, sizeof(buf), "%s", path);
+  for (char *p = buf + 1; *p; p++) {
+    if (*p != '/')
+      continue;
+    *p = '\0';
+    if (mkdir(buf, 0755) != 0 && errno != EEXIST)
+      return -1;
+    *p = '/';
+  }
+  return 0;
+}
+
+// Writes through a temporary file so a server never sees a partial file.
+static int write_atomic(const char *path, const void *data, size_t len) {
+  char tmp[1100];
+  snprintf(tmp, sizeof(tmp), "%s.tmp%ld", path, (long)getpid());
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    return -1;
+
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = write(fd, (const char *)data + done, len - done);
+    if (n <= 0)
+      break;
+    done += (size_t)n;
+  }
+  if (close(fd) != 0 || done != len || rename(tmp, path) != 0) {
+    unlink(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+// Writes `file` and, for compressible types, a smaller .gz variant.
+static int write_output(const char *out_dir, const char *rel, const char *data,
+                        size_t len) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s/%s", out_dir, rel);
+  if (mkdirs(path) != 0 || write_atomic(path, data, len) != 0)
+    return -1;
+
+  char gz_path[1100];
+  snprintf(gz_path, sizeof(gz_path), "%s.gz", path);
+  if (!mime_lookup(rel)->compressible || len < GZIP_MIN_SIZE) {
+    unlink(gz_path);
+    return 0;
+  }
+
+  unsigned char *gz = malloc(gzip_bound(len));
+  size_t gz_len = gz ? gzip_compress((const unsigned char *)data, len, gz) : 0;
+  int rc = 0;
+  if (gz_len > 0 && gz_len < len)
+    rc = write_atomic(gz_path, gz, gz_len);
+  else
+    unlink(gz_path);
+  free(gz);
+  return rc;
+}
+
+struct write_job {
+  struct export_ctx *ctx;
+  struct export_file *files;
+};
+
+static void write_one(size_t item, int worker, void *arg) {
+  (void)worker;
+  struct write_job *job = arg;
+  struct export_ctx *ctx = job->ctx;
+  struct export_file *file = &job->files[item];
+
+  if (file->data) {
+    file->ok = write_output(ctx->out_dir, file->path, file->data,
+                            file->len) == 0;
+    return;
+  }
+
+  struct vfs_file src;
+  if (vfs_open(file->source, &src) != 0)
+    return;
+  file->ok = write_output(ctx->out_dir, file->path, src.data, src.len) == 0;
+  vfs_close(&src);
+}
+
+// Writes a batch in parallel and records the results.
+static void write_batch(struct export_ctx *ctx, struct export_file *files,
+                        size_t count) {
+  struct write_job job = {ctx, files};
+  workers_run(count, write_one, &job);
+  for (size_t i = 0; i < count; i++) {
+    if (files[i].ok) {
+      manifest_add(&ctx->next, files[i].path, files[i].fingerprint);
+      ctx->written++;
+    } else {
+      logger_log(LOG_ERROR, "Export failed: %s/%s", ctx->out_dir,
+                 files[i].path);
+      ctx->failed++;
+    }
+  }
+}
+
+// Returns 1 (and keeps the file) if `rel` was exported from the same inputs
+// and is still on disk.
+static int unchanged(struct export_ctx *ctx, const char *rel,
+                     uint64_t fingerprint) {
+  const struct manifest_entry *e = manifest_find(&ctx->old, rel);
+  if (!e || e->fingerprint != fingerprint)
+    return 0;
+
+  char path[1024];
+  struct stat st;
+  snprintf(path, sizeof(path), "%s/%s", ctx->out_dir, rel);
+  if (stat(path, &st) != 0)
+    return 0;
+
+  manifest_add(&ctx->next, rel, fingerprint);
+  ctx->unchanged++;
+  return 1;
+}
+
+static uint64_t post_fingerprint(struct export_ctx *ctx,
+                                 const struct blog_post *post) {
+  char path[512];
+  post_source_path(ctx->config, post->filename, path, sizeof(path));
+  uint64_t h = hash_source(FNV_OFFSET, path);
+  snprintf(path, sizeof(path), "%s/post.html", ctx->config->templates_dir);
+  return hash_source(h, path);
+}
+
+static int skip_post(const struct blog_post *post, void *arg) {
+  struct export_ctx *ctx = arg;
+  char rel[512];
+  snprintf(rel, sizeof(rel), "post/%s.html", post->filename);
+  return unchanged(ctx, rel, post_fingerprint(ctx, post));
+}
+
+static void emit_posts(const struct blog_post *posts,
+                       struct page_entry **entries, int count, void *arg) {
+  struct export_ctx *ctx = arg;
+  struct export_file *files = calloc((size_t)count, sizeof(*files));
+  if (!files) {
+    ctx->failed += (size_t)count;
+    return;
+  }
+
+  size_t n = 0;
+  for (int i = 0; i < count; i++) {
+    if (!entries[i]) {
+      logger_log(LOG_ERROR, "Export failed to render post %s",
+                 posts[i].filename);
+      ctx->failed++;
+      continue;
+    }
+    snprintf(files[n].path, sizeof(files[n].path), "post/%s.html",
+             posts[i].filename);
+    files[n].fingerprint = post_fingerprint(ctx, &posts[i]);
+    files[n].data = entries[i]->data + entries[i]->header_len;
+    files[n].len = entries[i]->len - entries[i]->header_len;
+    n++;
+  }
+  write_batch(ctx, files, n);
+  free(files);
+}
+
+// Listing pages depend on the template and on what they list.
+static uint64_t listing_fingerprint(struct export_ctx *ctx,
+                                    const struct blog_index *index, int page,
+                                    int total_pages, int per_page) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/index.html", ctx->config->templates_dir);
+  uint64_t h = hash_source(FNV_OFFSET, path);
+  h = fnv1a(h, &page, sizeof(page));
+  h = fnv1a(h, &total_pages, sizeof(total_pages));
+  for (int i = (page - 1) * per_page;
+       i < page * per_page && i < index->post_count; i++) {
+    const struct blog_post *post = &index->posts[i];
+    h = hash_str(h, post->filename);
+    h = hash_str(h, post->title);
+    h = hash_str(h, post->date);
+    h = hash_str(h, post->preview);
+  }
+  return h;
+}
+
+// Adds a rendered page under `rel` unless it is unchanged.
+static int add_page(struct export_ctx *ctx, struct export_file *files,
+                    size_t *n, const char *rel, uint64_t fingerprint,
+                    struct page_entry *entry) {
+  if (!entry) {
+    logger_log(LOG_ERROR, "Export failed to render %s", rel);
+    ctx->failed++;
+    return -1;
+  }
+  struct export_file *f = &files[(*n)++];
+  snprintf(f->path, sizeof(f->path), "%s", rel);
+  f->fingerprint = fingerprint;
+  f->data = entry->data + entry->header_len;
+  f->len = entry->len - entry->header_len;
+  return 0;
+}
+
+static void export_pages(struct export_ctx *ctx,
+                         const struct blog_index *index) {
+  int per_page =
+      ctx->config->posts_per_page > 0 ? ctx->config->posts_per_page : 10;
+  int total_pages =
+      index->post_count == 0 ? 1 : (index->post_count + per_page - 1) / per_page;
+
+  // Page 1 is also "/" and "/blog"; the about page and 404 come last
+  size_t cap = (size_t)total_pages + 5;
+  struct export_file *files = calloc(cap, sizeof(*files));
+  struct page_entry **entries = calloc(cap, sizeof(*entries));
+  if (!files || !entries) {
+    free(files);
+    free(entries);
+    ctx->failed++;
+    return;
+  }
+
+  size_t n = 0, held = 0;
+  for (int page = 1; page <= total_pages; page++) {
+    uint64_t fp =
+        listing_fingerprint(ctx, index, page, total_pages, per_page);
+    char rel[64];
+    snprintf(rel, sizeof(rel), "blog/page/%d.html", page);
+    const char *aliases[3] = {rel, "index.html", "blog.html"};
+    int outputs = page == 1 ? 3 : 1;
+
+    struct page_entry *entry = NULL;
+    for (int a = 0; a < outputs; a++) {
+      if (unchanged(ctx, aliases[a], fp))
+        continue;
+      if (!entry) {
+        enum canned_response error = CANNED_PAGE_FAILED;
+        entry = render_blog_page(ctx->config, page, &error);
+        if (entry)
+          entries[held++] = entry;
+      }
+      add_page(ctx, files, &n, aliases[a], fp, entry);
+    }
+  }
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/about.html", ctx->config->templates_dir);
+  uint64_t fp = hash_source(FNV_OFFSET, path);
+  if (!unchanged(ctx, "about.html", fp)) {
+    enum canned_response error = CANNED_ABOUT_FAILED;
+    struct page_entry *entry = render_about_page(ctx->config, &error);
+    if (entry)
+      entries[held++] = entry;
+    add_page(ctx, files, &n, "about.html", fp, entry);
+  }
+
+  // The styled "File not found" page, without its HTTP headers
+  char response[16384];
+  size_t len = format_error_page(response, sizeof(response), 404,
+                                 "File not found");
+  const char *body = len ? strstr(response, "\r\n\r\n") : NULL;
+  if (body) {
+    body += 4;
+    size_t body_len = len - (size_t)(body - response);
+    fp = fnv1a(FNV_OFFSET, body, body_len);
+    if (!unchanged(ctx, "404.html", fp)) {
+      struct export_file *f = &files[n++];
+      snprintf(f->path, sizeof(f->path), "404.html");
+      f->fingerprint = fp;
+      f->data = body;
+      f->len = body_len;
+    }
+  }
+
+  write_batch(ctx, files, n);
+  for (size_t i = 0; i < held; i++)
+    page_cache_release(entries[i]);
+  free(files);
+  free(entries);
+}
+
+struct asset_scan {
+  struct export_ctx *ctx;
+  size_t pages; // ctx->next[0..pages) is sorted and holds the rendered routes
+  struct export_file *files;
+  size_t count, cap;
+};
+
+static int collect_asset(const struct vfs_entry *entry, void *arg) {
+  struct asset_scan *scan = arg;
+  struct export_ctx *ctx = scan->ctx;
+  if (entry->is_dir)
+    return 0;
+
+  // Rendered routes win, as "/" does over static/index.html when serving
+  struct manifest pages = {ctx->next.entries, scan->pages, scan->pages};
+  if (manifest_find(&pages, entry->path))
+    return 0;
+
+  char source[512];
+  snprintf(source, sizeof(source), "%s/%s", ctx->config->static_dir,
+           entry->path);
+  uint64_t fp = hash_source(FNV_OFFSET, source);
+  if (unchanged(ctx, entry->path, fp))
+    return 0;
+
+  if (scan->count == scan->cap) {
+    size_t cap = scan->cap ? scan->cap * 2 : 64;
+    struct export_file *files = realloc(scan->files, cap * sizeof(*files));
+    if (!files)
+      return 1;
+    scan->files = files;
+    scan->cap = cap;
+  }
+  struct export_file *f = &scan->files[scan->count++];
+  memset(f, 0, sizeof(*f));
+  snprintf(f->path, sizeof(f->path), "%s", entry->path);
+  snprintf(f->source, sizeof(f->source), "%s", source);
+  f->fingerprint = fp;
+  return 0;
+}
+
+static void export_assets(struct export_ctx *ctx) {
+  qsort(ctx->next.entries, ctx->next.count, sizeof(struct manifest_entry),
+        compare_entries);
+  struct asset_scan scan = {ctx, ctx->next.count, NULL, 0, 0};
+  if (vfs_walk(ctx->config->static_dir, collect_asset, &scan) != 0)
+    ctx->failed++;
+  write_batch(ctx, scan.files, scan.count);
+  free(scan.files);
+}
+
+// Deletes files the previous export wrote that no route produces anymore.
+static void remove_stale(struct export_ctx *ctx) {
+  qsort(ctx->next.entries, ctx->next.count, sizeof(struct manifest_entry),
+        compare_entries);
+  for (size_t i = 0; i < ctx->old.count; i++) {
+    const char *rel = ctx->old.entries[i].path;
+    if (manifest_find(&ctx->next, rel))
+      continue;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", ctx->out_dir, rel);
+    unlink(path);
+    strcat(path, ".gz");
+    unlink(path);
+    logger_log(LOG_INFO, "Export removed %s", rel);
+  }
+}
+
+static int manifest_save(struct export_ctx *ctx) {
+  size_t size = 1;
+  for (size_t i = 0; i < ctx->next.count; i++)
+    size += strlen(ctx->next.entries[i].path) + 18;
+  char *buf = malloc(size);
+  if (!buf)
+    return -1;
+
+  size_t len = 0;
+  for (size_t i = 0; i < ctx->next.count; i++) {
+    len += (size_t)snprintf(buf + len, size - len, "%016llx %s\n",
+                            (unsigned long long)ctx->next.entries[i].fingerprint,
+                            ctx->next.entries[i].path);
+  }
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", ctx->out_dir, MANIFEST_NAME);
+  int rc = write_atomic(path, buf, len);
+  free(buf);
+  return rc;
+}
+
+int export_site(struct server_config *config, const char *out_dir) {
+  if (mkdir(out_dir, 0755) != 0 && errno != EEXIST) {
+    logger_log(LOG_ERROR, "Cannot create %s: %s", out_dir, strerror(errno));
+    return -1;
+  }
+
+  struct export_ctx ctx;
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.config = config;
+  ctx.out_dir = out_dir;
+  manifest_load(&ctx);
+
+  struct blog_index *index = post_index_acquire();
+  if (!index) {
+    manifest_free(&ctx.old);
+    return -1;
+  }
+
+  post_render_all(config, index, skip_post, emit_posts, &ctx);
+  export_pages(&ctx, index);
+  post_index_release(index);
+  export_assets(&ctx);
+
+  // Keep the old manifest after failures so the next run retries them
+  if (ctx.failed == 0) {
+    remove_stale(&ctx);
+    if (manifest_save(&ctx) != 0) {
+      logger_log(LOG_ERROR, "Cannot write %s/%s", out_dir, MANIFEST_NAME);
+      ctx.failed++;
+    }
+  }
+
+  logger_log(LOG_INFO, "Exported %zu files to %s (%zu unchanged, %zu failed)",
+             ctx.written, out_dir, ctx.unchanged, ctx.failed);
+  manifest_free(&ctx.old);
+  manifest_free(&ctx.next);
+  return ctx.failed ? -1 : 0;
+}
@@ -0,0 +1,186 @@
+// src/gzip.c
+#include "../include/gzip.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WINDOW_SIZE 32768
+#define MIN_MATCH 3
+#define MAX_MATCH 258
+#define HASH_BITS 15
+#define MAX_CHAIN 64 // candidates tried per position
+
+struct bit_writer {
+  unsigned char *out;
+  size_t pos;
+  uint32_t bits;
+  int count;
+};
+
+static void put_bits(struct bit_writer *w, uint32_t value, int n) {
+  w->bits |= value << w->count;
+  w->count += n;
+  while (w->count >= 8) {
+    w->out[w->pos++] = (unsigned char)w->bits;
+    w->bits >>= 8;
+    w->count -= 8;
+  }
+}
+
+// Huffman codes are sent most significant bit first
+static void put_code(struct bit_writer *w, uint32_t code, int n) {
+  uint32_t rev = 0;
+  for (int i = 0; i < n; i++)
+    rev |= ((code >> i) & 1) << (n - 1 - i);
+  put_bits(w, rev, n);
+}
+
+// Fixed literal/length code (RFC 1951, 3.2.6)
+static void put_symbol(struct bit_writer *w, int sym) {
+  if (sym < 144)
+    put_code(w, 0x30 + sym, 8);
+  else if (sym < 256)
+    put_code(w, 0x190 + sym - 144, 9);
+  else if (sym < 280)
+    put_code(w, sym - 256, 7);
+  else
+    put_code(w, 0xc0 + sym - 280, 8);
+}
+
+static const uint16_t length_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                         1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,
+    97,  129, 193, 257, 385, 513,  769,  1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0,  0,  1,  1,  2,  2,  3,  3,
+                                       4, 4, 5,  5,  6,  6,  7,  7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static void put_match(struct bit_writer *w, size_t len, size_t dist) {
+  int l = 28;
+  while (length_base[l] > len)
+    l--;
+  put_symbol(w, 257 + l);
+  put_bits(w, (uint32_t)(len - length_base[l]), length_extra[l]);
+
+  int d = 29;
+  while (dist_base[d] > dist)
+    d--;
+  put_code(w, (uint32_t)d, 5);
+  put_bits(w, (uint32_t)(dist - dist_base[d]), dist_extra[d]);
+}
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void init_crc_table(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    crc_table[i] = c;
+  }
+}
+
+static uint32_t crc32(const unsigned char *p, size_t len) {
+  pthread_once(&crc_once, init_crc_table);
+  uint32_t crc = 0xffffffffu;
+  for (size_t i = 0; i < len; i++)
+    crc = crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return crc ^ 0xffffffffu;
+}
+
+static void put_le32(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char)v;
+  p[1] = (unsigned char)(v >> 8);
+  p[2] = (unsigned char)(v >> 16);
+  p[3] = (unsigned char)(v >> 24);
+}
+
+static uint32_t hash3(const unsigned char *p) {
+  uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16;
+  return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Literals cost at most 9 bits, so 9/8 of the input plus framing bounds a
+// single fixed-code block.
+size_t gzip_bound(size_t len) { return len + len / 8 + 64; }
+
+size_t gzip_compress(const unsigned char *src, size_t len, unsigned char *dst) {
+  // head[] holds the latest position + 1 for each hash, prev[] the chain
+  int32_t *head = calloc((size_t)1 << HASH_BITS, sizeof(int32_t));
+  int32_t *prev = malloc(WINDOW_SIZE * sizeof(int32_t));
+  if (!head || !prev) {
+    free(head);
+    free(prev);
+    return 0;
+  }
+
+  static const unsigned char header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+  memcpy(dst, header, sizeof(header));
+
+  struct bit_writer w = {dst, sizeof(header), 0, 0};
+  put_bits(&w, 1, 1); // BFINAL
+  put_bits(&w, 1, 2); // BTYPE = fixed Huffman
+
+  size_t i = 0;
+  while (i < len) {
+    size_t best_len = 0, best_dist = 0;
+    if (i + MIN_MATCH <= len) {
+      uint32_t h = hash3(src + i);
+      size_t max = len - i < MAX_MATCH ? len - i : MAX_MATCH;
+      int32_t cand = head[h] - 1;
+      for (int chain = 0; cand >= 0 && i - (size_t)cand <= WINDOW_SIZE &&
+                          chain < MAX_CHAIN;
+           chain++) {
+        const unsigned char *a = src + cand, *b = src + i;
+        if (a[best_len] == b[best_len]) {
+          size_t n = 0;
+          while (n < max && a[n] == b[n])
+            n++;
+          if (n > best_len) {
+            best_len = n;
+            best_dist = i - (size_t)cand;
+            if (n == max)
+              break;
+          }
+        }
+        int32_t next = prev[cand % WINDOW_SIZE] - 1;
+        if (next >= cand)
+          break;
+        cand = next;
+      }
+    }
+
+    size_t advance = best_len >= MIN_MATCH ? best_len : 1;
+    if (best_len >= MIN_MATCH)
+      put_match(&w, best_len, best_dist);
+    else
+      put_symbol(&w, src[i]);
+
+    // Index every covered position so later matches can reach them
+    for (size_t end = i + advance; i < end; i++) {
+      if (i + MIN_MATCH <= len) {
+        uint32_t h = hash3(src + i);
+        prev[i % WINDOW_SIZE] = head[h];
+        head[h] = (int32_t)i + 1;
+      }
+    }
+  }
+
+  put_symbol(&w, 256); // end of block
+  if (w.count > 0)
+    put_bits(&w, 0, 8 - w.count);
+
+  free(head);
+  free(prev);
+  put_le32(dst + w.pos, crc32(src, len));
+  put_le32(dst + w.pos + 4, (uint32_t)len);
+  return w.pos + 8;
+}
@@ -1,15 +1,46 @@
 #include "../include/http.h"
+#include "../include/error_pages.h"
 #include "../include/logger.h"
+#include "../include/mime.h"
 #include <stdbool.h> // Add this for bool type
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <ctype.h>
 
+bool http_get_header(const char *request, const char *name, char *out,
+                     size_t out_size) {
+  size_t name_len = strlen(name);
+  const char *line = strstr(request, "\r\n");
+  while (line && line[2] != '\r' && line[2] != '\0') {
+    line += 2;
+    if (strncasecmp(line, name, name_len) == 0 && line[name_len] == ':') {
+      const char *value = line + name_len + 1;
+      while (*value == ' ' || *value == '\t') {
+        value++;
+      }
+      size_t len = strcspn(value, "\r\n");
+      if (len >= out_size) {
+        len = out_size - 1;
+      }
+      memcpy(out, value, len);
+      out[len] = '\0';
+      return true;
+    }
+    line = strstr(line, "\r\n");
+  }
+  return false;
+}
+
 bool parse_http_request(char *request_line, struct http_request *req) {
   // Initialize request structure
   memset(req, 0, sizeof(struct http_request));
 
+  // Headers are read before strtok_r cuts up the request line
+  http_get_header(request_line, "If-None-Match", req->if_none_match,
+                  sizeof(req->if_none_match));
+
   logger_log(LOG_DEBUG, "Parsing request line: %s", request_line);
 
   // Skip any leading whitespace
@@ -46,52 +77,13 @@ bool parse_http_request(char *request_line, struct http_request *req) {
 }
 
 const char *get_content_type(const char *path) {
-  const char *ext = strrchr(path, '.');
-  if (ext) {
-    if (strcmp(ext, ".html") == 0) {
-      return "text/html";
-    } else if (strcmp(ext, ".css") == 0) {
-      return "text/css";
-    } else if (strcmp(ext, ".js") == 0) {
-      return "application/javascript";
-    } else if (strcmp(ext, ".json") == 0) {
-      return "application/json";
-    } else if (strcmp(ext, ".png") == 0) {
-      return "image/png";
-    } else if (strcmp(ext, ".ico") == 0) {
-      return "image/x-icon";
-    }
-  }
-  return "text/plain";
-} // In src/http.c
-void send_404(int client_fd) {
-  const char *body = "404 Not Found";
-  char headers[512];
-  snprintf(headers, sizeof(headers),
-           "HTTP/1.1 404 Not Found\r\n"
-           "Content-Type: text/plain\r\n"
-           "Content-Length: %lu\r\n"
-           "Connection: close\r\n"
-           "\r\n"
-           "%s",
-           strlen(body), body);
-
-  write(client_fd, headers, strlen(headers));
+  return mime_lookup(path)->content_type;
 }
 
-void send_500(int client_fd) {
-  const char *body = "500 Internal Server Error";
-  char headers[512];
-  snprintf(headers, sizeof(headers),
-           "HTTP/1.1 500 Internal Server Error\r\n"
-           "Content-Type: text/plain\r\n"
-           "Content-Length: %lu\r\n"
-           "Connection: close\r\n"
-           "\r\n"
-           "%s",
-           strlen(body), body);
+void send_404(int client_fd) { send_canned(client_fd, CANNED_NOT_FOUND_PLAIN); }
 
-  write(client_fd, headers, strlen(headers));
+void send_500(int client_fd) {
+  send_canned(client_fd, CANNED_SERVER_ERROR_PLAIN);
 }
 
 void send_response(int client_fd, int status_code, const char *status_text,
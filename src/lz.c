@@ -0,0 +1,149 @@
+// src/lz.c
+#include "../include/lz.h"
+#include <stdint.h>
+#include <string.h>
+
+// Each sequence is a token byte (literal length in the high nibble, match
+// length - LZ_MIN_MATCH in the low nibble), optional length extension bytes,
+// the literals, and a 2-byte little-endian match offset. The final sequence
+// carries literals only.
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 13
+
+static uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t hash4(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char *write_length(unsigned char *op, size_t len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (unsigned char)len;
+  return op;
+}
+
+size_t lz_bound(size_t len) { return len + len / 255 + 16; }
+
+static unsigned char *emit_sequence(unsigned char *op,
+                                    const unsigned char *lit, size_t lit_len,
+                                    size_t match_len, size_t offset) {
+  unsigned char *token = op++;
+  size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+  *token = (unsigned char)(((lit_len >= 15) ? 15 : lit_len) << 4);
+  if (lit_len >= 15) {
+    op = write_length(op, lit_len - 15);
+  }
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+
+  if (match_len) {
+    *op++ = (unsigned char)(offset & 0xff);
+    *op++ = (unsigned char)(offset >> 8);
+    *token |= (unsigned char)((ml >= 15) ? 15 : ml);
+    if (ml >= 15) {
+      op = write_length(op, ml - 15);
+    }
+  }
+  return op;
+}
+
+size_t lz_compress(const unsigned char *src, size_t len, unsigned char *dst) {
+  uint32_t table[1 << LZ_HASH_BITS];
+  memset(table, 0xff, sizeof(table));
+
+  unsigned char *op = dst;
+  size_t anchor = 0;
+  size_t i = 0;
+
+  while (len >= LZ_MIN_MATCH && i + LZ_MIN_MATCH <= len) {
+    uint32_t seq = read32(src + i);
+    uint32_t h = hash4(seq);
+    uint32_t cand = table[h];
+    table[h] = (uint32_t)i;
+
+    if (cand != UINT32_MAX && i - cand <= LZ_MAX_OFFSET &&
+        read32(src + cand) == seq) {
+      size_t match_len = LZ_MIN_MATCH;
+      while (i + match_len < len && src[cand + match_len] == src[i + match_len]) {
+        match_len++;
+      }
+      op = emit_sequence(op, src + anchor, i - anchor, match_len, i - cand);
+      i += match_len;
+      anchor = i;
+    } else {
+      i++;
+    }
+  }
+
+  return (size_t)(emit_sequence(op, src + anchor, len - anchor, 0, 0) - dst);
+}
+
+static int read_length(const unsigned char **ip, const unsigned char *end,
+                       size_t *len) {
+  unsigned char b;
+  do {
+    if (*ip >= end) {
+      return -1;
+    }
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return 0;
+}
+
+int lz_decompress(const unsigned char *src, size_t src_len,
+                  unsigned char *dst, size_t dst_len) {
+  const unsigned char *ip = src;
+  const unsigned char *end = src + src_len;
+  size_t out = 0;
+
+  while (ip < end) {
+    unsigned char token = *ip++;
+
+    size_t lit_len = token >> 4;
+    if (lit_len == 15 && read_length(&ip, end, &lit_len) != 0) {
+      return -1;
+    }
+    if (lit_len > (size_t)(end - ip) || lit_len > dst_len - out) {
+      return -1;
+    }
+    memcpy(dst + out, ip, lit_len);
+    ip += lit_len;
+    out += lit_len;
+
+    if (ip == end) {
+      break; // final literal-only sequence
+    }
+
+    if (end - ip < 2) {
+      return -1;
+    }
+    size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+    ip += 2;
+    size_t match_len = token & 0x0f;
+    if (match_len == 15 && read_length(&ip, end, &match_len) != 0) {
+      return -1;
+    }
+    match_len += LZ_MIN_MATCH;
+    if (offset == 0 || offset > out || match_len > dst_len - out) {
+      return -1;
+    }
+
+    // Overlapping copies are valid (offset < match_len repeats a run).
+    for (size_t k = 0; k < match_len; k++) {
+      dst[out + k] = dst[out - offset + k];
+    }
+    out += match_len;
+  }
+
+  return out == dst_len ? 0 : -1;
+}
@@ -1,38 +1,426 @@
 #include "../include/markdown.h"
+#include "../lib/md4c/entity.h"
+#include "../lib/md4c/md4c-ast.h"
 #include "../lib/md4c/md4c-html.h"
 #include "../lib/md4c/md4c.h"
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Growable output buffer for md4c-html
+struct html_buffer {
+  char *data;
+  size_t len;
+  size_t cap;
+  int failed;
+};
+
 // callback for md4c-html to write output
 static void write_output(const MD_CHAR *text, MD_SIZE size, void *userdata) {
-  char **output = (char **)userdata;
-  size_t len = *output ? strlen(*output) : 0;
-  *output = realloc(*output, len + size + 1);
-  memcpy(*output + len, text, size);
-  (*output)[len + size] = '\0';
+  struct html_buffer *out = (struct html_buffer *)userdata;
+  if (out->failed)
+    return;
+  if (out->len + size + 1 > out->cap) {
+    size_t cap = out->cap * 2;
+    while (cap < out->len + size + 1)
+      cap *= 2;
+    char *data = realloc(out->data, cap);
+    if (!data) {
+      out->failed = 1;
+      return;
+    }
+    out->data = data;
+    out->cap = cap;
+  }
+  memcpy(out->data + out->len, text, size);
+  out->len += size;
+}
+
+// Parser and renderer options shared by every conversion
+static const unsigned parser_flags =
+    MD_FLAG_COLLAPSEWHITESPACE | MD_FLAG_TABLES | MD_FLAG_STRIKETHROUGH |
+    MD_FLAG_PERMISSIVEEMAILAUTOLINKS;
+static const unsigned renderer_flags =
+    MD_HTML_FLAG_SKIP_UTF8_BOM | MD_HTML_FLAG_HEADING_IDS;
+
+// Parser working memory, one per thread and reused for every post the
+// thread converts; freed when the thread exits
+static pthread_key_t g_context_key;
+static pthread_once_t g_context_once = PTHREAD_ONCE_INIT;
+
+static void free_context(void *pc) { md_parse_context_free(pc); }
+static void make_context_key(void) {
+  pthread_key_create(&g_context_key, free_context);
+}
+
+// Returns NULL if no context could be made; md4c then allocates per call.
+static MD_PARSE_CONTEXT *thread_context(void) {
+  pthread_once(&g_context_once, make_context_key);
+  MD_PARSE_CONTEXT *pc = pthread_getspecific(g_context_key);
+  if (!pc && (pc = md_parse_context_new()) != NULL)
+    pthread_setspecific(g_context_key, pc);
+  return pc;
+}
+
+// A context grows to the largest document it parsed. After an oversized
+// one (a streamed post, say) it is dropped, so the thread does not hold
+// memory sized to that document for good; the next call makes a new one.
+#define CONTEXT_KEEP_MAX (256 * 1024) // bytes of markdown
+
+static void done_context(size_t len) {
+  if (len <= CONTEXT_KEEP_MAX)
+    return;
+  MD_PARSE_CONTEXT *pc = pthread_getspecific(g_context_key);
+  if (pc) {
+    pthread_setspecific(g_context_key, NULL);
+    md_parse_context_free(pc);
+  }
 }
 
 char *markdown_to_html(const char *markdown_content) {
-  char *html_output = NULL;
+  size_t input_len = strlen(markdown_content);
 
-  // Configure HTML renderer options
-  unsigned parser_flags = MD_FLAG_COLLAPSEWHITESPACE | MD_FLAG_TABLES |
-                          MD_FLAG_STRIKETHROUGH |
-                          MD_FLAG_PERMISSIVEEMAILAUTOLINKS;
-  unsigned renderer_flags = MD_HTML_FLAG_SKIP_UTF8_BOM;
+  // HTML runs a little longer than its markdown; start there so most posts
+  // need no reallocation
+  struct html_buffer out = {NULL, 0, input_len + input_len / 4 + 256, 0};
+  out.data = malloc(out.cap);
+  if (!out.data)
+    return NULL;
 
   // Convert markdown to HTML
-  int result = md_html(markdown_content, strlen(markdown_content), write_output,
-                       &html_output, parser_flags, renderer_flags);
+  int result = md_html_ex(markdown_content, (MD_SIZE)input_len, write_output,
+                          &out, parser_flags, renderer_flags, thread_context());
+  done_context(input_len);
+
+  if (result != 0 || out.failed) {
+    free(out.data);
+    return NULL;
+  }
+
+  out.data[out.len] = '\0';
+  return out.data;
+}
+
+struct stream_sink {
+  void (*emit)(const char *text, size_t size, void *arg);
+  void *arg;
+};
+
+static void stream_output(const MD_CHAR *text, MD_SIZE size, void *userdata) {
+  struct stream_sink *sink = userdata;
+  sink->emit(text, size, sink->arg);
+}
+
+int markdown_stream(const char *markdown, size_t len,
+                    void (*emit)(const char *text, size_t size, void *arg),
+                    void *arg) {
+  struct stream_sink sink = {emit, arg};
+  int result = md_html_ex(markdown, (MD_SIZE)len, stream_output, &sink,
+                          parser_flags, renderer_flags, thread_context());
+  done_context(len);
+  return result;
+}
+
+#define WORDS_PER_MINUTE 200
+#define EXCERPT_CHARS 200 // cut at the last space before this
+
+static void append(struct html_buffer *out, const char *text, size_t size) {
+  write_output(text, (MD_SIZE)size, out);
+}
+
+static void append_codepoint(struct html_buffer *out, unsigned cp) {
+  char utf8[4];
+  size_t n;
+  if (cp == 0 || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+    cp = 0xfffd;
+  }
+  if (cp < 0x80) {
+    utf8[0] = (char)cp;
+    n = 1;
+  } else if (cp < 0x800) {
+    utf8[0] = (char)(0xc0 | (cp >> 6));
+    utf8[1] = (char)(0x80 | (cp & 0x3f));
+    n = 2;
+  } else if (cp < 0x10000) {
+    utf8[0] = (char)(0xe0 | (cp >> 12));
+    utf8[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    utf8[2] = (char)(0x80 | (cp & 0x3f));
+    n = 3;
+  } else {
+    utf8[0] = (char)(0xf0 | (cp >> 18));
+    utf8[1] = (char)(0x80 | ((cp >> 12) & 0x3f));
+    utf8[2] = (char)(0x80 | ((cp >> 6) & 0x3f));
+    utf8[3] = (char)(0x80 | (cp & 0x3f));
+    n = 4;
+  }
+  append(out, utf8, n);
+}
+
+// "&amp;", "&#38;" or "&#x26;" as the character; unknown names stay as is
+static void append_entity(struct html_buffer *out, const char *text,
+                          size_t size) {
+  unsigned cp[2] = {0, 0};
+  if (size > 3 && text[1] == '#') {
+    int hex = text[2] == 'x' || text[2] == 'X';
+    cp[0] = (unsigned)strtoul(text + 2 + hex, NULL, hex ? 16 : 10);
+  } else if (!entity_lookup(text, size, cp)) {
+    append(out, text, size);
+    return;
+  }
+  append_codepoint(out, cp[0]);
+  if (cp[1]) {
+    append_codepoint(out, cp[1]);
+  }
+}
+
+// Appends prose, dropping spaces at the start of a line.
+static void append_prose(struct html_buffer *text, const char *s, size_t len) {
+  if (text->len == 0 || text->data[text->len - 1] == '\n') {
+    while (len > 0 && *s == ' ') {
+      s++;
+      len--;
+    }
+  }
+  append(text, s, len);
+}
 
-  if (result != 0) {
-    free(html_output);
+// Ends the current line (sep '\n') or table cell (sep ' ') of plain text.
+static void end_text(struct html_buffer *text, char sep) {
+  if (text->failed || text->len == 0 || text->data[text->len - 1] == '\n') {
+    return;
+  }
+  if (text->data[text->len - 1] == ' ') {
+    text->data[text->len - 1] = sep;
+  } else {
+    append(text, &sep, 1);
+  }
+}
+
+static void add_heading(struct markdown_doc *doc, int level, const char *text,
+                        size_t len) {
+  while (len > 0 && text[len - 1] == ' ') {
+    len--;
+  }
+  if (doc->heading_count % 8 == 0) {
+    struct markdown_heading *outline =
+        realloc(doc->outline, (size_t)(doc->heading_count + 8) *
+                                  sizeof(*outline));
+    if (!outline) {
+      return;
+    }
+    doc->outline = outline;
+  }
+  char *copy = strndup(text, len);
+  if (copy) {
+    doc->outline[doc->heading_count++] = (struct markdown_heading){level, copy};
+  }
+}
+
+// Walks the AST once for the plain text, collecting the opening paragraphs
+// and the headings on the way. Code, raw HTML and images are left out.
+static void derive_text(const MD_AST *ast, unsigned what,
+                        struct markdown_doc *doc, struct html_buffer *text,
+                        struct html_buffer *excerpt) {
+  unsigned count;
+  const MD_AST_NODE *nodes = md_ast_nodes(ast, &count);
+  size_t block_start = 0; // of the current paragraph or heading
+
+  for (unsigned i = 0; i < count; i++) {
+    const MD_AST_NODE *node = &nodes[i];
+    switch (node->event) {
+    case MD_AST_ENTER_BLOCK:
+      if (node->type == MD_BLOCK_CODE || node->type == MD_BLOCK_HTML) {
+        i = node->end;
+      } else if (node->type == MD_BLOCK_P || node->type == MD_BLOCK_H) {
+        end_text(text, '\n');
+        block_start = text->len;
+      }
+      break;
+    case MD_AST_LEAVE_BLOCK:
+      if (node->type == MD_BLOCK_H && node->data && !text->failed &&
+          (what & MARKDOWN_OUTLINE)) {
+        const MD_BLOCK_H_DETAIL *det = node->data;
+        add_heading(doc, (int)det->level, text->data + block_start,
+                    text->len - block_start);
+      } else if (node->type == MD_BLOCK_P && !text->failed &&
+                 (what & MARKDOWN_EXCERPT) && excerpt->len < EXCERPT_CHARS &&
+                 text->len > block_start) {
+        if (excerpt->len > 0) {
+          append(excerpt, " ", 1);
+        }
+        append(excerpt, text->data + block_start, text->len - block_start);
+      }
+      end_text(text, node->type == MD_BLOCK_TH || node->type == MD_BLOCK_TD
+                         ? ' '
+                         : '\n');
+      break;
+    case MD_AST_ENTER_SPAN:
+      if (node->type == MD_SPAN_IMG) {
+        i = node->end;
+      }
+      break;
+    case MD_AST_LEAVE_SPAN:
+      break;
+    case MD_AST_TEXT:
+      switch (node->type) {
+      case MD_TEXT_HTML:
+        break;
+      case MD_TEXT_ENTITY:
+        append_entity(text, node->data, node->size);
+        break;
+      case MD_TEXT_NULLCHAR:
+        append_codepoint(text, 0xfffd);
+        break;
+      case MD_TEXT_BR:
+      case MD_TEXT_SOFTBR:
+        append_prose(text, " ", 1);
+        break;
+      default:
+        append_prose(text, node->data, node->size);
+        break;
+      }
+      break;
+    }
+  }
+}
+
+static int count_words(const char *text, size_t len) {
+  int words = 0, in_word = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = text[i];
+    int space = c == ' ' || c == '\n' || c == '\t' || c == '\r';
+    words += !space && !in_word;
+    in_word = !space;
+  }
+  return words;
+}
+
+// Shortens the excerpt to EXCERPT_CHARS at a word boundary, with an
+// ellipsis.
+static void cut_excerpt(struct html_buffer *excerpt) {
+  if (excerpt->len <= EXCERPT_CHARS) {
+    return;
+  }
+  size_t cut = EXCERPT_CHARS;
+  while (cut > 0 && excerpt->data[cut] != ' ') {
+    cut--;
+  }
+  if (cut == 0) {
+    // One long word: cut between characters
+    cut = EXCERPT_CHARS;
+    while (cut > 0 && ((unsigned char)excerpt->data[cut] & 0xc0) == 0x80) {
+      cut--;
+    }
+  }
+  while (cut > 0 && strchr(" ,;:", excerpt->data[cut - 1])) {
+    cut--;
+  }
+  excerpt->len = cut;
+  append(excerpt, "\xe2\x80\xa6", 3);
+}
+
+// Empty buffer with room for `cap` bytes.
+static int buffer_init(struct html_buffer *out, size_t cap) {
+  out->len = 0;
+  out->cap = cap;
+  out->failed = 0;
+  out->data = malloc(cap);
+  return out->data ? 0 : -1;
+}
+
+// NUL-terminated contents, or NULL (freeing them) if the buffer failed.
+static char *buffer_finish(struct html_buffer *out) {
+  if (out->failed || !out->data) {
+    free(out->data);
     return NULL;
   }
+  out->data[out->len] = '\0';
+  return out->data;
+}
+
+int markdown_analyze(const char *markdown, size_t len, unsigned what,
+                     struct markdown_doc *doc) {
+  memset(doc, 0, sizeof(*doc));
+  if ((renderer_flags & MD_HTML_FLAG_SKIP_UTF8_BOM) && len >= 3 &&
+      memcmp(markdown, "\xef\xbb\xbf", 3) == 0) {
+    markdown += 3;
+    len -= 3;
+  }
+
+  MD_AST *ast =
+      md_ast_parse(markdown, (MD_SIZE)len, parser_flags, thread_context());
+  done_context(len);
+  if (!ast) {
+    return -1;
+  }
+
+  int ok = 1;
+  if (what & MARKDOWN_HTML) {
+    // The table of contents is collected in the same rendering pass
+    struct html_buffer html, toc = {NULL, 0, 0, 0};
+    ok = buffer_init(&html, len + len / 4 + 256) == 0 &&
+         (!(what & MARKDOWN_TOC) || buffer_init(&toc, 256) == 0);
+    if (ok) {
+      if (md_html_ast_toc(ast, write_output, &html,
+                          (what & MARKDOWN_TOC) ? write_output : NULL, &toc,
+                          renderer_flags) != 0) {
+        html.failed = 1;
+      }
+      doc->html = buffer_finish(&html);
+      doc->html_len = html.len;
+      doc->toc = (what & MARKDOWN_TOC) ? buffer_finish(&toc) : NULL;
+      ok = doc->html != NULL && (doc->toc != NULL || !(what & MARKDOWN_TOC));
+    } else {
+      free(html.data);
+      free(toc.data);
+    }
+  }
+
+  struct html_buffer text, excerpt;
+  if (ok && buffer_init(&text, len / 2 + 64) == 0) {
+    if (buffer_init(&excerpt, EXCERPT_CHARS * 2) == 0) {
+      derive_text(ast, what, doc, &text, &excerpt);
+      cut_excerpt(&excerpt);
+      if (what & MARKDOWN_EXCERPT) {
+        ok = (doc->excerpt = buffer_finish(&excerpt)) != NULL;
+      } else {
+        free(excerpt.data);
+      }
+    } else {
+      ok = 0;
+    }
+    doc->words = text.failed ? 0 : count_words(text.data, text.len);
+    doc->reading_minutes =
+        (doc->words + WORDS_PER_MINUTE - 1) / WORDS_PER_MINUTE;
+    if (ok && (what & MARKDOWN_TEXT)) {
+      ok = (doc->text = buffer_finish(&text)) != NULL;
+      doc->text_len = ok ? text.len : 0;
+    } else {
+      free(text.data);
+    }
+  } else {
+    ok = 0;
+  }
 
-  return html_output;
+  md_ast_free(ast);
+  if (!ok) {
+    markdown_doc_free(doc);
+    return -1;
+  }
+  return 0;
+}
+
+void markdown_doc_free(struct markdown_doc *doc) {
+  free(doc->html);
+  free(doc->toc);
+  free(doc->text);
+  free(doc->excerpt);
+  for (int i = 0; i < doc->heading_count; i++) {
+    free(doc->outline[i].text);
+  }
+  free(doc->outline);
+  memset(doc, 0, sizeof(*doc));
 }
 
 char *load_markdown_file(const char *filepath) {
@@ -0,0 +1,40 @@
+// src/mime.c
+#include "../include/mime.h"
+#include "mime_hash.h" // generated by tools/mkmime.c
+#include <string.h>
+#include <strings.h>
+
+// Charset column of mime_types.def: header value and charset per kind
+#define MIME_CT_UTF8(type) type "; charset=utf-8"
+#define MIME_CT_BINARY(type) type
+#define MIME_CS_UTF8 "utf-8"
+#define MIME_CS_BINARY NULL
+
+static const struct mime_type mime_registry[] = {
+#define MIME_TYPE(ext, type, charset, compressible, max_age)                   \
+  {ext, type, MIME_CS_##charset, MIME_CT_##charset(type), compressible,        \
+   max_age},
+#include "../include/mime_types.def"
+#undef MIME_TYPE
+};
+
+static const struct mime_type mime_default = {
+    "", "text/plain", NULL, "text/plain", 1, 0};
+
+const struct mime_type *mime_lookup(const char *path) {
+  const char *slash = strrchr(path, '/');
+  const char *ext = strrchr(slash ? slash : path, '.');
+  if (!ext || ext[1] == '\0') {
+    return &mime_default;
+  }
+  ext++;
+
+  uint32_t slot = mime_hash(ext, MIME_HASH_SEED) & ((1u << MIME_HASH_BITS) - 1);
+  unsigned index = mime_slots[slot];
+  if (index == 0 || strcasecmp(mime_registry[index - 1].extension, ext) != 0) {
+    return &mime_default;
+  }
+  return &mime_registry[index - 1];
+}
+
+const char *mime_html(void) { return mime_lookup("page.html")->content_type; }
@@ -0,0 +1,262 @@
+// src/negcache.c
+#include "../include/negcache.h"
+#include "../include/error_pages.h"
+#include "../include/logger.h"
+#include "../include/pack.h"
+#include "../include/vfs.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define BLOOM_HASHES 4
+#define BLOOM_BITS_PER_KEY 16
+#define BLOOM_MIN_BITS 4096
+
+struct watched_dir {
+  char path[512];
+  time_t mtime;
+};
+
+static uint64_t *g_bloom = NULL;
+static uint64_t g_bloom_mask = 0; // bit count - 1 (power of two)
+static size_t g_bloom_keys = 0;
+
+// On-disk directories whose mtime changes when files are added or removed
+static struct watched_dir *g_dirs = NULL;
+static size_t g_dir_count = 0, g_dir_cap = 0;
+static time_t g_last_check = 0;
+
+// Recent misses; the least recently hit slot is replaced
+struct miss_entry {
+  char path[256];
+  uint64_t last_used;
+};
+static struct miss_entry g_lru[NEGCACHE_LRU_SIZE];
+static uint64_t g_lru_clock = 0;
+
+static uint64_t hash_path(const char *s, size_t len) {
+  uint64_t h = 1469598103934665603ULL; // FNV-1a
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void bloom_bits(uint64_t h, uint64_t bits[BLOOM_HASHES]) {
+  uint64_t h1 = h & 0xffffffffu;
+  uint64_t h2 = (h >> 32) | 1;
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    bits[i] = (h1 + (uint64_t)i * h2) & g_bloom_mask;
+  }
+}
+
+static void bloom_add(uint64_t *bloom, const char *key, size_t len) {
+  uint64_t bits[BLOOM_HASHES];
+  bloom_bits(hash_path(key, len), bits);
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    bloom[bits[i] >> 6] |= 1ULL << (bits[i] & 63);
+  }
+}
+
+// Collapses duplicate slashes like sanitize_path, into a caller buffer.
+static size_t normalize_path(const char *path, char *out, size_t size) {
+  size_t o = 0;
+  for (const char *p = path; *p; p++) {
+    if (*p == '/' && o > 0 && out[o - 1] == '/')
+      continue;
+    if (o + 1 >= size)
+      return 0;
+    out[o++] = *p;
+  }
+  out[o] = '\0';
+  return o;
+}
+
+static void watch_dir(const char *path) {
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return;
+  if (g_dir_count == g_dir_cap) {
+    size_t cap = g_dir_cap ? g_dir_cap * 2 : 16;
+    struct watched_dir *dirs = realloc(g_dirs, cap * sizeof(*dirs));
+    if (!dirs)
+      return;
+    g_dirs = dirs;
+    g_dir_cap = cap;
+  }
+  snprintf(g_dirs[g_dir_count].path, sizeof(g_dirs[0].path), "%s", path);
+  g_dirs[g_dir_count].mtime = st.st_mtime;
+  g_dir_count++;
+}
+
+struct collect_ctx {
+  const char *root;
+  const char *url_prefix; // "/" for static files, "/post/" for posts
+  int strip_md;
+  uint64_t *bloom; // NULL while counting
+  size_t count;
+};
+
+static int collect_path(const struct vfs_entry *entry, void *arg) {
+  struct collect_ctx *ctx = arg;
+  if (entry->is_dir) {
+    if (!ctx->bloom) {
+      char dir[1024];
+      snprintf(dir, sizeof(dir), "%s/%s", ctx->root, entry->path);
+      watch_dir(dir);
+    }
+    return 0;
+  }
+
+  size_t len = strlen(entry->path);
+  if (ctx->strip_md) {
+    if (len <= 3 || strcmp(entry->path + len - 3, ".md") != 0)
+      return 0;
+    len -= 3;
+  }
+
+  ctx->count++;
+  if (ctx->bloom) {
+    char key[1024];
+    int n = snprintf(key, sizeof(key), "%s%.*s", ctx->url_prefix, (int)len,
+                     entry->path);
+    if (n > 0 && (size_t)n < sizeof(key))
+      bloom_add(ctx->bloom, key, (size_t)n);
+  }
+  return 0;
+}
+
+int negcache_rebuild(struct server_config *config) {
+  struct collect_ctx trees[2] = {
+      {config->static_dir, "/", 0, NULL, 0},
+      {config->blog_dir, "/post/", 1, NULL, 0},
+  };
+
+  // Served from a pack, posts are whatever the pack holds
+  struct pack *pack = pack_acquire();
+  int trees_walked = pack ? 1 : 2;
+
+  // First pass counts keys (and records directories) to size the filter
+  g_dir_count = 0;
+  watch_dir(config->static_dir);
+  if (!pack)
+    watch_dir(config->blog_dir);
+  size_t keys = pack ? (size_t)pack_count(pack) : 0;
+  for (int t = 0; t < trees_walked; t++) {
+    vfs_walk(trees[t].root, collect_path, &trees[t]);
+    keys += trees[t].count;
+  }
+
+  uint64_t bits = BLOOM_MIN_BITS;
+  while (bits < (uint64_t)keys * BLOOM_BITS_PER_KEY)
+    bits <<= 1;
+
+  uint64_t *bloom = calloc(bits / 64, sizeof(uint64_t));
+  if (!bloom) {
+    logger_log(LOG_ERROR, "Failed to allocate negative lookup filter");
+    pack_release(pack);
+    negcache_invalidate();
+    return -1;
+  }
+
+  free(g_bloom);
+  g_bloom = NULL;
+  g_bloom_mask = bits - 1;
+  for (int t = 0; t < trees_walked; t++) {
+    trees[t].bloom = bloom;
+    vfs_walk(trees[t].root, collect_path, &trees[t]);
+  }
+  for (int i = 0; pack && i < pack_count(pack); i++) {
+    struct pack_entry entry;
+    char key[1024];
+    int n = pack_get(pack, i, &entry) == 0
+                ? snprintf(key, sizeof(key), "/post/%s", entry.slug)
+                : -1;
+    if (n > 0 && (size_t)n < sizeof(key))
+      bloom_add(bloom, key, (size_t)n);
+  }
+  pack_release(pack);
+  g_bloom = bloom;
+  g_bloom_keys = keys;
+
+  memset(g_lru, 0, sizeof(g_lru));
+  g_last_check = time(NULL);
+
+  logger_log(LOG_DEBUG, "Negative lookup filter: %zu paths, %llu bits",
+             g_bloom_keys, (unsigned long long)bits);
+  return 0;
+}
+
+void negcache_refresh(struct server_config *config) {
+  time_t now = time(NULL);
+  if (g_bloom && now == g_last_check)
+    return;
+  g_last_check = now;
+
+  int stale = g_bloom == NULL;
+  for (size_t i = 0; !stale && i < g_dir_count; i++) {
+    struct stat st;
+    if (stat(g_dirs[i].path, &st) != 0 || st.st_mtime != g_dirs[i].mtime)
+      stale = 1;
+  }
+
+  if (stale) {
+    negcache_rebuild(config);
+  }
+}
+
+void negcache_invalidate(void) {
+  free(g_bloom);
+  g_bloom = NULL;
+  g_bloom_keys = 0;
+  memset(g_lru, 0, sizeof(g_lru));
+}
+
+bool negcache_is_miss(const char *path) {
+  if (!g_bloom)
+    return false;
+
+  char key[256];
+  size_t len = normalize_path(path, key, sizeof(key));
+  if (len == 0)
+    return false;
+
+  uint64_t bits[BLOOM_HASHES];
+  bloom_bits(hash_path(key, len), bits);
+  for (int i = 0; i < BLOOM_HASHES; i++) {
+    if (!(g_bloom[bits[i] >> 6] & (1ULL << (bits[i] & 63))))
+      return true;
+  }
+
+  for (size_t i = 0; i < NEGCACHE_LRU_SIZE; i++) {
+    if (g_lru[i].path[0] && strcmp(g_lru[i].path, key) == 0) {
+      g_lru[i].last_used = ++g_lru_clock;
+      return true;
+    }
+  }
+  return false;
+}
+
+void negcache_remember_miss(const char *path) {
+  if (!g_bloom)
+    return;
+  char key[256];
+  if (normalize_path(path, key, sizeof(key)) == 0)
+    return;
+
+  size_t victim = 0;
+  for (size_t i = 1; i < NEGCACHE_LRU_SIZE; i++) {
+    if (g_lru[i].last_used < g_lru[victim].last_used)
+      victim = i;
+  }
+  memcpy(g_lru[victim].path, key, sizeof(key));
+  g_lru[victim].last_used = ++g_lru_clock;
+}
+
+void negcache_send_404(int client_fd) {
+  send_canned(client_fd, CANNED_FILE_NOT_FOUND);
+}
@@ -0,0 +1,467 @@
+// src/pack.c
+#include "../include/pack.h"
+#include "../include/logger.h"
+#include "../include/markdown.h"
+#include "../include/post.h"
+#include "../include/post_index.h"
+#include "../include/workers.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout (native byte order, checked through `endian`):
+//
+//   header | posts | slots | strings | bodies
+//
+// Posts are in index order, so page N of the listing is a slice of the
+// table. Slots are an open-addressing table of post numbers + 1 keyed by
+// the slug hash. Strings hold the listed fields of every post together,
+// away from the bodies, so building the index touches only the front of
+// the file. Every string and body is NUL-terminated. The checksum covers
+// posts, slots and strings.
+#define PACK_MAGIC "BLOGPACK"
+#define PACK_VERSION 1
+#define PACK_ENDIAN 0x01020304u
+#define PACK_WINDOW 256 // posts read and converted per parallel round
+
+#define PACK_HAS_HTML 1u      // header flag: every post carries its HTML
+#define PACK_POST_UNTITLED 1u // post flag: the file has no frontmatter
+
+struct pack_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t file_size;
+  uint64_t checksum;
+  uint32_t post_count, slot_count; // slot_count is a power of two
+  uint32_t flags, reserved;
+  uint64_t posts_off, slots_off, strings_off, bodies_off;
+};
+
+struct pack_ref {
+  uint64_t off, len; // absolute; off == 0 means absent
+};
+
+struct pack_post {
+  uint64_t slug_hash;
+  struct pack_ref slug, title, date, preview;
+  struct pack_ref markdown, html;
+  int64_t date_key;
+  uint64_t ino;
+  int64_t mtime;
+  uint64_t size;
+  uint32_t flags, reserved;
+};
+
+struct pack {
+  int refcount;
+  const unsigned char *map;
+  size_t len;
+  const struct pack_header *hdr;
+  struct vfs_identity id;
+};
+
+static struct pack *g_pack = NULL;
+static char g_path[512];
+
+static uint64_t fnv1a_update(uint64_t h, const void *data, size_t len) {
+  const unsigned char *p = data;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static uint64_t fnv1a(const void *data, size_t len) {
+  return fnv1a_update(1469598103934665603ULL, data, len);
+}
+
+static const struct pack_post *pack_posts(const struct pack *pack) {
+  return (const struct pack_post *)(pack->map + pack->hdr->posts_off);
+}
+
+static const uint32_t *pack_slots(const struct pack *pack) {
+  return (const uint32_t *)(pack->map + pack->hdr->slots_off);
+}
+
+// Returns the string `r` refers to, or NULL if it is absent or corrupt.
+static const char *pack_str(const struct pack *pack, struct pack_ref r) {
+  if (r.off < pack->hdr->strings_off || r.off >= pack->len ||
+      r.len >= pack->len - r.off || pack->map[r.off + r.len] != '\0')
+    return NULL;
+  return (const char *)pack->map + r.off;
+}
+
+static int region_ok(uint64_t off, uint64_t count, size_t size,
+                     uint64_t end) {
+  return off % 8 == 0 && off <= end && count <= (end - off) / size;
+}
+
+static int validate(const unsigned char *map, size_t len) {
+  const struct pack_header *h = (const struct pack_header *)map;
+  if (len < sizeof(*h) || memcmp(h->magic, PACK_MAGIC, 8) != 0 ||
+      h->version != PACK_VERSION || h->endian != PACK_ENDIAN ||
+      h->file_size != len || h->bodies_off > len ||
+      h->strings_off > h->bodies_off)
+    return -1;
+  if (h->slot_count == 0 || (h->slot_count & (h->slot_count - 1)) != 0 ||
+      h->slot_count <= h->post_count)
+    return -1;
+  if (!region_ok(h->posts_off, h->post_count, sizeof(struct pack_post),
+                 h->strings_off) ||
+      !region_ok(h->slots_off, h->slot_count, sizeof(uint32_t),
+                 h->strings_off) ||
+      h->posts_off < sizeof(*h))
+    return -1;
+  if (fnv1a(map + h->posts_off, h->bodies_off - h->posts_off) != h->checksum)
+    return -1;
+  return 0;
+}
+
+static struct pack *pack_map(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return NULL;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  struct pack *pack = NULL;
+  if (validate(map, (size_t)st.st_size) == 0)
+    pack = calloc(1, sizeof(*pack));
+  if (!pack) {
+    munmap(map, (size_t)st.st_size);
+    return NULL;
+  }
+  pack->refcount = 1;
+  pack->map = map;
+  pack->len = (size_t)st.st_size;
+  pack->hdr = map;
+  pack->id.ino = (unsigned long long)st.st_ino;
+  pack->id.mtime = st.st_mtime;
+  pack->id.size = (size_t)st.st_size;
+  return pack;
+}
+
+int pack_init(const char *path) {
+  struct pack *pack = pack_map(path);
+  if (!pack) {
+    logger_log(LOG_ERROR, "Cannot load post pack %s", path);
+    return -1;
+  }
+  snprintf(g_path, sizeof(g_path), "%s", path);
+  pack_release(g_pack);
+  g_pack = pack;
+  logger_log(LOG_INFO, "Post pack %s: %u posts%s", path,
+             pack->hdr->post_count,
+             pack->hdr->flags & PACK_HAS_HTML ? " with HTML" : "");
+  return 0;
+}
+
+int pack_reload(void) {
+  if (!g_pack)
+    return 0;
+
+  struct vfs_identity id;
+  if (vfs_identity(g_path, &id) != 0 ||
+      (id.ino == g_pack->id.ino && id.mtime == g_pack->id.mtime &&
+       id.size == g_pack->id.size))
+    return 0;
+
+  struct pack *pack = pack_map(g_path);
+  if (!pack) {
+    logger_log(LOG_WARN, "Ignoring unusable post pack %s", g_path);
+    return -1;
+  }
+  // Readers holding the old mapping keep it until they release it
+  pack_release(g_pack);
+  g_pack = pack;
+  logger_log(LOG_INFO, "Post pack reloaded: %u posts", pack->hdr->post_count);
+  return 1;
+}
+
+const char *pack_path(void) { return g_pack ? g_path : ""; }
+
+struct pack *pack_acquire(void) {
+  if (g_pack)
+    __atomic_add_fetch(&g_pack->refcount, 1, __ATOMIC_RELAXED);
+  return g_pack;
+}
+
+void pack_release(struct pack *pack) {
+  if (pack && __atomic_sub_fetch(&pack->refcount, 1, __ATOMIC_ACQ_REL) == 0) {
+    munmap((void *)pack->map, pack->len);
+    free(pack);
+  }
+}
+
+int pack_count(const struct pack *pack) {
+  return (int)pack->hdr->post_count;
+}
+
+// Fills `out` from post `i`; bodies only if asked, since checking them
+// touches their pages.
+static int get_post(const struct pack *pack, uint32_t i, int bodies,
+                    struct pack_entry *out) {
+  if (i >= pack->hdr->post_count)
+    return -1;
+  const struct pack_post *p = &pack_posts(pack)[i];
+  out->slug = pack_str(pack, p->slug);
+  out->title = pack_str(pack, p->title);
+  out->date = pack_str(pack, p->date);
+  out->preview = pack_str(pack, p->preview);
+  if (!out->slug || !out->title || !out->date || !out->preview)
+    return -1;
+  out->markdown = out->html = NULL;
+  if (bodies) {
+    out->markdown = pack_str(pack, p->markdown);
+    out->html = p->html.off ? pack_str(pack, p->html) : NULL;
+    if (!out->markdown || (p->html.off && !out->html))
+      return -1;
+  }
+  out->date_key = p->date_key;
+  out->id.ino = p->ino;
+  out->id.mtime = (time_t)p->mtime;
+  out->id.size = (size_t)p->size;
+  out->untitled = (p->flags & PACK_POST_UNTITLED) != 0;
+  return 0;
+}
+
+int pack_get(const struct pack *pack, int i, struct pack_entry *out) {
+  return i < 0 ? -1 : get_post(pack, (uint32_t)i, 0, out);
+}
+
+int pack_find(const struct pack *pack, const char *slug,
+              struct pack_entry *out) {
+  uint64_t h = fnv1a(slug, strlen(slug));
+  uint32_t mask = pack->hdr->slot_count - 1;
+  const uint32_t *slots = pack_slots(pack);
+  const struct pack_post *posts = pack_posts(pack);
+  for (uint32_t i = (uint32_t)h & mask, probes = 0; probes <= mask;
+       i = (i + 1) & mask, probes++) {
+    uint32_t n = slots[i];
+    if (n == 0 || n > pack->hdr->post_count)
+      return -1;
+    const struct pack_post *p = &posts[n - 1];
+    if (p->slug_hash != h)
+      continue;
+    const char *s = pack_str(pack, p->slug);
+    if (s && strcmp(s, slug) == 0)
+      return get_post(pack, n - 1, 1, out);
+  }
+  return -1;
+}
+
+// Growable byte buffer for the strings region
+struct buf {
+  char *data;
+  size_t len, cap;
+};
+
+static struct pack_ref add_str(struct buf *b, uint64_t base, const char *s,
+                               int *err) {
+  size_t len = strlen(s);
+  if (b->len + len + 1 > b->cap) {
+    size_t cap = b->cap ? b->cap : 64 * 1024;
+    while (cap < b->len + len + 1)
+      cap *= 2;
+    char *data = realloc(b->data, cap);
+    if (!data) {
+      *err = 1;
+      return (struct pack_ref){0, 0};
+    }
+    b->data = data;
+    b->cap = cap;
+  }
+  struct pack_ref r = {base + b->len, len};
+  memcpy(b->data + b->len, s, len + 1);
+  b->len += len + 1;
+  return r;
+}
+
+// One post being packed
+struct pack_item {
+  struct vfs_file file;
+  int opened;
+  const char *markdown;
+  int untitled;
+  char *html;
+};
+
+struct pack_job {
+  struct server_config *config;
+  const struct blog_post *posts;
+  struct pack_item *items;
+  int with_html;
+};
+
+static void pack_one(size_t item, int worker, void *arg) {
+  (void)worker;
+  struct pack_job *job = arg;
+  struct pack_item *it = &job->items[item];
+  char filepath[512];
+  snprintf(filepath, sizeof(filepath), "%s/%s.md", job->config->blog_dir,
+           job->posts[item].filename);
+  it->opened = vfs_open(filepath, &it->file) == 0;
+  if (!it->opened)
+    return;
+
+  struct post_metadata metadata;
+  int has_metadata;
+  it->markdown = post_split(it->file.data, &metadata, &has_metadata);
+  it->untitled = !has_metadata;
+  if (job->with_html)
+    it->html = markdown_to_html(it->markdown);
+}
+
+// Appends a NUL-terminated body at the end of `out`.
+static struct pack_ref write_body(FILE *out, uint64_t *pos, const char *s,
+                                  int *err) {
+  size_t len = strlen(s);
+  struct pack_ref r = {*pos, len};
+  if (fwrite(s, 1, len + 1, out) != len + 1)
+    *err = 1;
+  *pos += len + 1;
+  return r;
+}
+
+int pack_write(struct server_config *config, const char *path, int with_html) {
+  struct blog_index *index = post_index_acquire();
+  if (!index)
+    return -1;
+
+  uint32_t count = (uint32_t)index->post_count;
+  struct pack_header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, PACK_MAGIC, 8);
+  hdr.version = PACK_VERSION;
+  hdr.endian = PACK_ENDIAN;
+  hdr.post_count = count;
+  hdr.flags = with_html ? PACK_HAS_HTML : 0;
+  hdr.slot_count = 16;
+  while (hdr.slot_count < 2 * count)
+    hdr.slot_count *= 2;
+  hdr.posts_off = sizeof(hdr);
+  hdr.slots_off = hdr.posts_off + (uint64_t)count * sizeof(struct pack_post);
+  hdr.strings_off = (hdr.slots_off + hdr.slot_count * sizeof(uint32_t) + 7) &
+                    ~(uint64_t)7;
+
+  struct pack_post *posts = calloc(count ? count : 1, sizeof(*posts));
+  uint32_t *slots = calloc(hdr.slot_count, sizeof(*slots));
+  struct pack_item *items = calloc(PACK_WINDOW, sizeof(*items));
+  struct buf strings = {NULL, 0, 0};
+  int err = !posts || !slots || !items;
+
+  // Listed fields come from the index, so they match what indexing the
+  // markdown files would produce
+  for (uint32_t i = 0; !err && i < count; i++) {
+    const struct blog_post *post = &index->posts[i];
+    struct pack_post *p = &posts[i];
+    p->slug_hash = fnv1a(post->filename, strlen(post->filename));
+    p->slug = add_str(&strings, hdr.strings_off, post->filename, &err);
+    p->title = add_str(&strings, hdr.strings_off, post->title, &err);
+    p->date = add_str(&strings, hdr.strings_off, post->date, &err);
+    p->preview = add_str(&strings, hdr.strings_off, post->preview, &err);
+    p->date_key = post->date_key;
+    p->ino = post->id.ino;
+    p->mtime = (int64_t)post->id.mtime;
+    p->size = post->id.size;
+
+    uint32_t slot = (uint32_t)p->slug_hash & (hdr.slot_count - 1);
+    while (slots[slot])
+      slot = (slot + 1) & (hdr.slot_count - 1);
+    slots[slot] = i + 1;
+  }
+  hdr.bodies_off = (hdr.strings_off + strings.len + 7) & ~(uint64_t)7;
+
+  char tmp[600];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *out = err ? NULL : fopen(tmp, "wb");
+  err |= !out || fseeko(out, (off_t)hdr.bodies_off, SEEK_SET) != 0;
+
+  // Bodies are read and converted in parallel, then appended in order
+  uint64_t pos = hdr.bodies_off;
+  size_t missing = 0;
+  for (uint32_t next = 0; !err && next < count;) {
+    uint32_t n = count - next < PACK_WINDOW ? count - next : PACK_WINDOW;
+    struct pack_job job = {config, &index->posts[next], items, with_html};
+    workers_run(n, pack_one, &job);
+
+    for (uint32_t i = 0; i < n; i++) {
+      struct pack_item *it = &items[i];
+      struct pack_post *p = &posts[next + i];
+      if (!it->opened) {
+        // Deleted since indexing; keep the record with an empty body
+        missing++;
+        p->markdown = write_body(out, &pos, "", &err);
+      } else {
+        p->flags = it->untitled ? PACK_POST_UNTITLED : 0;
+        p->markdown = write_body(out, &pos, it->markdown, &err);
+        if (it->html)
+          p->html = write_body(out, &pos, it->html, &err);
+        else if (with_html)
+          err = 1;
+        vfs_close(&it->file);
+      }
+      free(it->html);
+      memset(it, 0, sizeof(*it));
+    }
+    next += n;
+  }
+  hdr.file_size = pos;
+
+  if (!err) {
+    static const char zeros[8];
+    uint64_t slots_end = hdr.slots_off + hdr.slot_count * sizeof(uint32_t);
+    size_t pad1 = (size_t)(hdr.strings_off - slots_end);
+    size_t pad2 = (size_t)(hdr.bodies_off - hdr.strings_off - strings.len);
+    uint64_t h = 1469598103934665603ULL;
+    h = fnv1a_update(h, posts, count * sizeof(*posts));
+    h = fnv1a_update(h, slots, hdr.slot_count * sizeof(*slots));
+    h = fnv1a_update(h, zeros, pad1);
+    h = fnv1a_update(h, strings.data, strings.len);
+    h = fnv1a_update(h, zeros, pad2);
+    hdr.checksum = h;
+
+    err = fseeko(out, 0, SEEK_SET) != 0 ||
+          fwrite(&hdr, sizeof(hdr), 1, out) != 1 ||
+          fwrite(posts, sizeof(*posts), count, out) != count ||
+          fwrite(slots, sizeof(*slots), hdr.slot_count, out) !=
+              hdr.slot_count ||
+          fwrite(zeros, 1, pad1, out) != pad1 ||
+          fwrite(strings.data, 1, strings.len, out) != strings.len ||
+          fwrite(zeros, 1, pad2, out) != pad2;
+  }
+  if (out) {
+    err |= fflush(out) != 0 || fsync(fileno(out)) != 0;
+    err |= fclose(out) != 0;
+    if (!err && rename(tmp, path) != 0)
+      err = 1;
+    if (err)
+      unlink(tmp);
+  }
+
+  if (!err)
+    logger_log(LOG_INFO, "Packed %u posts%s into %s (%llu bytes)",
+               count - (uint32_t)missing, with_html ? " with HTML" : "",
+               path, (unsigned long long)hdr.file_size);
+  else
+    logger_log(LOG_ERROR, "Failed to write post pack %s", path);
+
+  free(posts);
+  free(slots);
+  free(items);
+  free(strings.data);
+  post_index_release(index);
+  return err ? -1 : 0;
+}
@@ -0,0 +1,326 @@
+// src/page_cache.c
+#include "../include/page_cache.h"
+#include "../include/logger.h"
+#include "../include/zerocopy.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PAGE_CACHE_BUCKETS 1024
+
+static struct page_entry *g_buckets[PAGE_CACHE_BUCKETS];
+static struct page_entry *g_lru_head = NULL; // most recently used
+static struct page_entry *g_lru_tail = NULL;
+static size_t g_bytes = 0;
+static size_t g_max_bytes = 0;
+static page_loader_fn g_loader = NULL;
+
+static uint64_t fnv1a(const char *s, size_t len) {
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+void page_cache_init(size_t max_bytes) {
+  g_max_bytes = max_bytes;
+  logger_log(LOG_INFO, "Page cache: %zu MB", max_bytes / (1024 * 1024));
+}
+
+static void lru_unlink(struct page_entry *e) {
+  if (e->lru_prev)
+    e->lru_prev->lru_next = e->lru_next;
+  else
+    g_lru_head = e->lru_next;
+  if (e->lru_next)
+    e->lru_next->lru_prev = e->lru_prev;
+  else
+    g_lru_tail = e->lru_prev;
+  e->lru_prev = e->lru_next = NULL;
+}
+
+static void lru_push_front(struct page_entry *e) {
+  e->lru_prev = NULL;
+  e->lru_next = g_lru_head;
+  if (g_lru_head)
+    g_lru_head->lru_prev = e;
+  g_lru_head = e;
+  if (!g_lru_tail)
+    g_lru_tail = e;
+}
+
+// Unlinks an entry from the table; it is freed once the last reader is done.
+static void evict(struct page_entry *e) {
+  struct page_entry **pp = &g_buckets[e->hash % PAGE_CACHE_BUCKETS];
+  while (*pp && *pp != e)
+    pp = &(*pp)->hash_next;
+  if (*pp)
+    *pp = e->hash_next;
+  lru_unlink(e);
+  g_bytes -= e->len;
+  e->cached = 0;
+  page_cache_release(e);
+}
+
+void page_cache_release(struct page_entry *entry) {
+  if (entry && --entry->refcount == 0)
+    free(entry);
+}
+
+static void release_cb(void *arg) { page_cache_release(arg); }
+
+static int sources_fresh(struct page_entry *e) {
+  time_t now = time(NULL);
+  if (e->checked == now)
+    return 1;
+  e->checked = now;
+
+  for (int i = 0; i < e->source_count; i++) {
+    struct vfs_identity id;
+    if (vfs_identity(e->sources[i].path, &id) != 0 ||
+        id.ino != e->sources[i].id.ino || id.mtime != e->sources[i].id.mtime ||
+        id.size != e->sources[i].id.size)
+      return 0;
+  }
+  return 1;
+}
+
+struct page_entry *page_cache_get(const char *key) {
+  if (g_max_bytes == 0)
+    return NULL;
+
+  uint64_t hash = fnv1a(key, strlen(key));
+  for (struct page_entry *e = g_buckets[hash % PAGE_CACHE_BUCKETS]; e;
+       e = e->hash_next) {
+    if (e->hash != hash || strcmp(e->key, key) != 0)
+      continue;
+    if (!sources_fresh(e)) {
+      evict(e);
+      return NULL;
+    }
+    lru_unlink(e);
+    lru_push_front(e);
+    e->refcount++;
+    return e;
+  }
+  return g_loader ? g_loader(key) : NULL;
+}
+
+void page_cache_set_loader(page_loader_fn loader) { g_loader = loader; }
+
+void page_cache_foreach(void (*fn)(struct page_entry *entry, void *arg),
+                        void *arg) {
+  for (struct page_entry *e = g_lru_head; e; e = e->lru_next)
+    fn(e, arg);
+}
+
+static uint64_t tag_hash(const char *kind, const char *name) {
+  uint64_t h = fnv1a(kind, strlen(kind));
+  h ^= ':';
+  h *= 1099511628211ULL;
+  for (const char *p = name; *p; p++) {
+    h ^= (unsigned char)*p;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+int page_entry_has_tag(const struct page_entry *entry, const char *kind,
+                       const char *name) {
+  uint64_t tag = tag_hash(kind, name);
+  for (size_t i = 0; i < entry->tag_count; i++) {
+    if (entry->tags[i] == tag)
+      return 1;
+  }
+  return 0;
+}
+
+void page_deps_init(struct page_deps *deps) { memset(deps, 0, sizeof(*deps)); }
+
+void page_deps_free(struct page_deps *deps) {
+  free(deps->tags);
+  memset(deps, 0, sizeof(*deps));
+}
+
+void page_deps_source(struct page_deps *deps, const char *path) {
+  if (deps->source_count == PAGE_CACHE_MAX_SOURCES) {
+    deps->failed = 1;
+    return;
+  }
+  struct page_source *source = &deps->sources[deps->source_count];
+  snprintf(source->path, sizeof(source->path), "%s", path);
+  if (vfs_identity(path, &source->id) != 0) {
+    deps->failed = 1;
+    return;
+  }
+  deps->source_count++;
+}
+
+void page_deps_tag(struct page_deps *deps, const char *kind,
+                   const char *name) {
+  if (deps->tag_count == deps->tag_cap) {
+    size_t cap = deps->tag_cap ? deps->tag_cap * 2 : 16;
+    uint64_t *tags = realloc(deps->tags, cap * sizeof(*tags));
+    if (!tags) {
+      deps->failed = 1;
+      return;
+    }
+    deps->tags = tags;
+    deps->tag_cap = cap;
+  }
+  deps->tags[deps->tag_count++] = tag_hash(kind, name);
+}
+
+void page_cache_invalidate(const char *kind, const char *name) {
+  struct page_tag tag = {kind, name};
+  page_cache_invalidate_tags(&tag, 1);
+}
+
+void page_cache_invalidate_tags(const struct page_tag *tags, size_t count) {
+  if (count == 0 || !g_lru_head)
+    return;
+
+  // Open-addressing set of the tag hashes; 0 marks an empty slot, so a tag
+  // hashing to 0 is tracked on the side
+  size_t slot_count = 16;
+  while (slot_count < count * 2)
+    slot_count *= 2;
+  uint64_t *slots = calloc(slot_count, sizeof(*slots));
+  if (!slots) {
+    // Fall back to evicting everything the tags could have named
+    while (g_lru_head)
+      evict(g_lru_head);
+    return;
+  }
+  int has_zero = 0;
+  for (size_t i = 0; i < count; i++) {
+    uint64_t tag = tag_hash(tags[i].kind, tags[i].name);
+    if (tag == 0) {
+      has_zero = 1;
+      continue;
+    }
+    size_t k = tag & (slot_count - 1);
+    while (slots[k] && slots[k] != tag)
+      k = (k + 1) & (slot_count - 1);
+    slots[k] = tag;
+  }
+
+  size_t evicted = 0;
+  for (struct page_entry *e = g_lru_head; e;) {
+    struct page_entry *next = e->lru_next;
+    for (size_t i = 0; i < e->tag_count; i++) {
+      uint64_t tag = e->tags[i];
+      size_t k = tag & (slot_count - 1);
+      while (slots[k] && slots[k] != tag)
+        k = (k + 1) & (slot_count - 1);
+      if (slots[k] == tag && (tag != 0 || has_zero)) {
+        evict(e);
+        evicted++;
+        break;
+      }
+    }
+    e = next;
+  }
+  free(slots);
+
+  if (evicted > 0 && count == 1)
+    logger_log(LOG_DEBUG, "Invalidated %s:%s (%zu pages)", tags[0].kind,
+               tags[0].name, evicted);
+  else if (evicted > 0)
+    logger_log(LOG_DEBUG, "Invalidated %zu tags (%zu pages)", count, evicted);
+}
+
+struct page_entry *page_cache_put(const char *key, const char *content_type,
+                                  const char *body, size_t body_len,
+                                  const struct page_deps *deps) {
+  if (strlen(key) >= sizeof(((struct page_entry *)0)->key))
+    return NULL;
+
+  char etag[24];
+  snprintf(etag, sizeof(etag), "\"%016llx\"",
+           (unsigned long long)fnv1a(body, body_len));
+
+  char headers[512];
+  int header_len = snprintf(headers, sizeof(headers),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Type: %s\r\n"
+                            "Content-Length: %zu\r\n"
+                            "ETag: %s\r\n"
+                            "Cache-Control: no-cache\r\n"
+                            "Connection: close\r\n"
+                            "\r\n",
+                            content_type, body_len, etag);
+  if (header_len < 0 || (size_t)header_len >= sizeof(headers))
+    return NULL;
+
+  // Entry, tag list and response share one allocation
+  size_t len = (size_t)header_len + body_len;
+  size_t tags_size = deps->tag_count * sizeof(uint64_t);
+  struct page_entry *e = malloc(sizeof(*e) + tags_size + len);
+  if (!e)
+    return NULL;
+  memset(e, 0, sizeof(*e));
+  snprintf(e->key, sizeof(e->key), "%s", key);
+  e->hash = fnv1a(key, strlen(key));
+  memcpy(e->etag, etag, sizeof(etag));
+  memcpy(e->sources, deps->sources,
+         sizeof(deps->sources[0]) * (size_t)deps->source_count);
+  e->source_count = deps->source_count;
+  uint64_t *tags = (uint64_t *)(e + 1);
+  if (tags_size)
+    memcpy(tags, deps->tags, tags_size);
+  e->tags = tags;
+  e->tag_count = deps->tag_count;
+  e->data = (char *)tags + tags_size;
+  e->checked = time(NULL);
+  e->header_len = (size_t)header_len;
+  e->len = len;
+  memcpy(e->data, headers, (size_t)header_len);
+  memcpy(e->data + header_len, body, body_len);
+  e->refcount = 1; // caller
+
+  if (g_max_bytes == 0 || deps->failed || len > g_max_bytes / 4)
+    return e; // not cacheable; still usable by the caller
+
+  // Replace any previous version, then make room
+  for (struct page_entry *old = g_buckets[e->hash % PAGE_CACHE_BUCKETS]; old;
+       old = old->hash_next) {
+    if (old->hash == e->hash && strcmp(old->key, key) == 0) {
+      evict(old);
+      break;
+    }
+  }
+  while (g_lru_tail && g_bytes + len > g_max_bytes)
+    evict(g_lru_tail);
+
+  e->refcount++; // cache
+  e->cached = 1;
+  e->hash_next = g_buckets[e->hash % PAGE_CACHE_BUCKETS];
+  g_buckets[e->hash % PAGE_CACHE_BUCKETS] = e;
+  lru_push_front(e);
+  g_bytes += len;
+  return e;
+}
+
+void page_cache_send(int client_fd, struct page_entry *entry,
+                     const char *if_none_match) {
+  if (if_none_match && *if_none_match &&
+      strstr(if_none_match, entry->etag) != NULL) {
+    char headers[256];
+    int n = snprintf(headers, sizeof(headers),
+                     "HTTP/1.1 304 Not Modified\r\n"
+                     "ETag: %s\r\n"
+                     "Connection: close\r\n"
+                     "\r\n",
+                     entry->etag);
+    write(client_fd, headers, (size_t)n);
+    page_cache_release(entry);
+    return;
+  }
+
+  // The reference is dropped once the kernel no longer needs the bytes
+  zerocopy_send(client_fd, entry->data, entry->len, release_cb, entry);
+}
@@ -1,10 +1,17 @@
 // src/post.c
 #include "../include/post.h"
+#include "../include/post_index.h"
+#include "../include/chunked.h"
 #include "../include/http.h"
 #include "../include/error_pages.h"
 #include "../include/markdown.h"
+#include "../include/mime.h"
+#include "../include/pack.h"
+#include "../include/page_cache.h"
 #include "../include/template.h"
-#include <dirent.h>
+#include "../include/logger.h"
+#include "../include/vfs.h"
+#include "../include/workers.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -51,36 +58,44 @@ static char *build_pagination_html(int page, int total_pages) {
   return markup;
 }
 
-static void render_blog_page(int client_fd, struct server_config *config,
-                             int page) {
+struct page_entry *render_blog_page(struct server_config *config, int page,
+                                    enum canned_response *error) {
   int posts_per_page =
       (config->posts_per_page > 0) ? config->posts_per_page : 10;
 
-  struct blog_index *index = build_post_index(config->blog_dir);
+  if (page < 1) {
+    page = 1;
+  }
+
+  // "/" and "/blog?page=1" share an entry
+  char cache_key[32];
+  snprintf(cache_key, sizeof(cache_key), "blog:%d", page);
+  struct page_entry *cached = page_cache_get(cache_key);
+  if (cached) {
+    return cached;
+  }
+
+  struct blog_index *index = post_index_acquire();
   if (!index) {
-    send_error_page(client_fd, 500, "Failed to load blog index");
-    return;
+    *error = CANNED_INDEX_FAILED;
+    return NULL;
   }
 
   int total_posts = index->post_count;
 
   if (total_posts == 0 && page > 1) {
-    free_post_index(index);
-    send_error_page(client_fd, 404, "Page not found");
-    return;
-  }
-
-  if (page < 1) {
-    page = 1;
+    post_index_release(index);
+    *error = CANNED_PAGE_NOT_FOUND;
+    return NULL;
   }
 
   int total_pages =
       (total_posts == 0) ? 1 : (total_posts + posts_per_page - 1) / posts_per_page;
 
   if (total_posts > 0 && page > total_pages) {
-    free_post_index(index);
-    send_error_page(client_fd, 404, "Page not found");
-    return;
+    post_index_release(index);
+    *error = CANNED_PAGE_NOT_FOUND;
+    return NULL;
   }
 
   int start_index = (page - 1) * posts_per_page;
@@ -97,9 +112,9 @@ static void render_blog_page(int client_fd, struct server_config *config,
 
   char *posts_html = malloc(posts_html_capacity);
   if (!posts_html) {
-    free_post_index(index);
-    send_error_page(client_fd, 500, "Failed to render posts");
-    return;
+    post_index_release(index);
+    *error = CANNED_POSTS_FAILED;
+    return NULL;
   }
 
   posts_html[0] = '\0';
@@ -125,8 +140,8 @@ static void render_blog_page(int client_fd, struct server_config *config,
       const struct blog_post *post = &index->posts[i];
       int needed = snprintf(
           posts_html + offset, posts_html_capacity - offset,
-          POST_CARD_TEMPLATE, post->metadata.date, post->filename,
-          post->metadata.title, post->metadata.preview);
+          POST_CARD_TEMPLATE, post->date, post->filename,
+          post->title, post->preview);
 
       if (needed < 0) {
         continue;
@@ -137,22 +152,22 @@ static void render_blog_page(int client_fd, struct server_config *config,
         char *resized = realloc(posts_html, new_capacity);
         if (!resized) {
           free(posts_html);
-          free_post_index(index);
-          send_error_page(client_fd, 500, "Failed to render posts");
-          return;
+          post_index_release(index);
+          *error = CANNED_POSTS_FAILED;
+          return NULL;
         }
         posts_html = resized;
         posts_html_capacity = new_capacity;
         needed = snprintf(posts_html + offset, posts_html_capacity - offset,
-                          POST_CARD_TEMPLATE, post->metadata.date,
-                          post->filename, post->metadata.title,
-                          post->metadata.preview);
+                          POST_CARD_TEMPLATE, post->date,
+                          post->filename, post->title,
+                          post->preview);
 
         if (needed < 0 || (size_t)needed >= posts_html_capacity - offset) {
           free(posts_html);
-          free_post_index(index);
-          send_error_page(client_fd, 500, "Failed to render posts");
-          return;
+          post_index_release(index);
+          *error = CANNED_POSTS_FAILED;
+          return NULL;
         }
       }
 
@@ -163,9 +178,9 @@ static void render_blog_page(int client_fd, struct server_config *config,
   char *pagination_html = build_pagination_html(page, total_pages);
   if (!pagination_html) {
     free(posts_html);
-    free_post_index(index);
-    send_error_page(client_fd, 500, "Failed to render pagination");
-    return;
+    post_index_release(index);
+    *error = CANNED_PAGINATION_FAILED;
+    return NULL;
   }
 
   struct template_kv kvs[2];
@@ -176,261 +191,590 @@ static void render_blog_page(int client_fd, struct server_config *config,
   kvs[1].value = pagination_html;
   kvs[1].is_raw = 1;
 
-  char *full_html = NULL;
   char index_tpl_path[512];
   snprintf(index_tpl_path, sizeof(index_tpl_path), "%s/index.html",
            config->templates_dir);
+
+  // The page changes when posts are added, removed or reordered, or when
+  // the metadata of a listed post changes
+  struct page_deps deps;
+  page_deps_init(&deps);
+  page_deps_source(&deps, index_tpl_path);
+  page_deps_tag(&deps, "index", "");
+  for (int i = start_index; i < end_index; i++) {
+    page_deps_tag(&deps, "meta", index->posts[i].filename);
+  }
+
+  char *full_html = NULL;
   if (render_template_file(index_tpl_path, kvs, 2, &full_html) != 0 ||
       !full_html) {
     free(posts_html);
     free(pagination_html);
-    free_post_index(index);
-    send_error_page(client_fd, 500, "Failed to render page");
-    return;
+    page_deps_free(&deps);
+    post_index_release(index);
+    *error = CANNED_PAGE_FAILED;
+    return NULL;
   }
 
-  char headers[512];
-  snprintf(headers, sizeof(headers),
-           "HTTP/1.1 200 OK\r\n"
-           "Content-Type: text/html\r\n"
-           "Content-Length: %lu\r\n"
-           "Connection: close\r\n"
-           "\r\n",
-           strlen(full_html));
-
-  write(client_fd, headers, strlen(headers));
-  write(client_fd, full_html, strlen(full_html));
+  struct page_entry *entry = page_cache_put(cache_key, mime_html(), full_html,
+                                            strlen(full_html), &deps);
+  page_deps_free(&deps);
+  if (!entry) {
+    *error = CANNED_PAGE_FAILED;
+  }
 
   free(posts_html);
   free(pagination_html);
   free(full_html);
-  free_post_index(index);
+  post_index_release(index);
+  return entry;
 }
 
-void handle_index_page(int client_fd, struct server_config *config) {
-  render_blog_page(client_fd, config, 1);
+// Sends a rendered page, or the canned response for why it failed.
+static void send_page(int client_fd, struct page_entry *entry,
+                      enum canned_response error, const char *if_none_match) {
+  if (entry) {
+    page_cache_send(client_fd, entry, if_none_match);
+  } else {
+    send_canned(client_fd, error);
+  }
 }
 
-void handle_blog_page(int client_fd, struct server_config *config, int page) {
-  render_blog_page(client_fd, config, page);
+void handle_index_page(int client_fd, struct server_config *config,
+                       const char *if_none_match) {
+  handle_blog_page(client_fd, config, 1, if_none_match);
+}
+void handle_blog_page(int client_fd, struct server_config *config, int page,
+                      const char *if_none_match) {
+  enum canned_response error = CANNED_PAGE_FAILED;
+  struct page_entry *entry = render_blog_page(config, page, &error);
+  send_page(client_fd, entry, error, if_none_match);
 }
 
-int parse_post_metadata(const char *content, struct post_metadata *metadata) {
-  // Initialize metadata with empty strings
-  memset(metadata, 0, sizeof(struct post_metadata));
+static const char *find_delim(const char *p, const char *end) {
+  size_t dlen = strlen(FRONTMATTER_DELIM);
+  for (; (size_t)(end - p) >= dlen; p++) {
+    p = memchr(p, FRONTMATTER_DELIM[0], (size_t)(end - p) - dlen + 1);
+    if (!p) {
+      return NULL;
+    }
+    if (memcmp(p, FRONTMATTER_DELIM, dlen) == 0) {
+      return p;
+    }
+  }
+  return NULL;
+}
+
+long parse_frontmatter(const char *buf, size_t len,
+                       struct post_frontmatter *fm) {
+  memset(fm, 0, sizeof(*fm));
+  size_t dlen = strlen(FRONTMATTER_DELIM);
 
   // Check if content starts with frontmatter delimiter
-  if (strncmp(content, FRONTMATTER_DELIM, strlen(FRONTMATTER_DELIM)) != 0) {
+  if (len < dlen || memcmp(buf, FRONTMATTER_DELIM, dlen) != 0) {
     return 0;
   }
 
   // Find end of frontmatter
-  const char *end =
-      strstr(content + strlen(FRONTMATTER_DELIM), FRONTMATTER_DELIM);
+  const char *end = find_delim(buf + dlen, buf + len);
   if (!end) {
-    return 0;
+    return -1;
   }
 
-  // Copy frontmatter section for parsing
-  size_t fm_length = end - (content + strlen(FRONTMATTER_DELIM));
-  char *frontmatter = malloc(fm_length + 1);
-  strncpy(frontmatter, content + strlen(FRONTMATTER_DELIM), fm_length);
-  frontmatter[fm_length] = '\0';
-
-  // Parse each line
-  char *line = strtok(frontmatter, "\n");
-  while (line) {
-    char *value = strchr(line, ':');
-    if (value) {
-      *value = '\0'; // Split at colon
-      value++;       // Move past colon
+  // Parse each line as "key: value"
+  for (const char *line = buf + dlen; line < end;) {
+    const char *eol = memchr(line, '\n', (size_t)(end - line));
+    if (!eol) {
+      eol = end;
+    }
 
-      // Skip initial whitespace
-      while (*value == ' ')
+    const char *colon = memchr(line, ':', (size_t)(eol - line));
+    if (colon) {
+      const char *value = colon + 1;
+      while (value < eol && *value == ' ') {
         value++;
-
-      // Remove trailing whitespace
-      char *end = value + strlen(value) - 1;
-      while (end > value && (*end == ' ' || *end == '\n' || *end == '\r')) {
-        *end = '\0';
-        end--;
+      }
+      const char *value_end = eol;
+      while (value_end > value + 1 &&
+             (value_end[-1] == ' ' || value_end[-1] == '\r')) {
+        value_end--;
       }
 
-      if (strcmp(line, "title") == 0) {
-        strncpy(metadata->title, value, sizeof(metadata->title) - 1);
-      } else if (strcmp(line, "date") == 0) {
-        strncpy(metadata->date, value, sizeof(metadata->date) - 1);
-      } else if (strcmp(line, "preview") == 0) {
-        strncpy(metadata->preview, value, sizeof(metadata->preview) - 1);
+      struct post_field field = {value, (size_t)(value_end - value)};
+      size_t key_len = (size_t)(colon - line);
+      if (key_len == 5 && memcmp(line, "title", 5) == 0) {
+        fm->title = field;
+      } else if (key_len == 4 && memcmp(line, "date", 4) == 0) {
+        fm->date = field;
+      } else if (key_len == 7 && memcmp(line, "preview", 7) == 0) {
+        fm->preview = field;
       }
     }
-    line = strtok(NULL, "\n");
+    line = eol + 1;
   }
 
-  free(frontmatter);
-  return 1;
+  return (long)(end + dlen - buf);
 }
 
-void handle_markdown_post(int client_fd, const char *path,
-                          struct server_config *config) {
-  char filepath[512];
-  snprintf(filepath, sizeof(filepath), "%s/%s.md", config->blog_dir, path);
-
-  FILE *file = fopen(filepath, "r");
-  if (!file) {
-    send_404(client_fd);
-    return;
+static void copy_field(char *out, size_t size, struct post_field field) {
+  size_t len = field.len < size - 1 ? field.len : size - 1;
+  if (len > 0) {
+    memcpy(out, field.data, len);
   }
+  out[len] = '\0';
+}
 
-  // Read entire file content
-  fseek(file, 0, SEEK_END);
-  long file_size = ftell(file);
-  fseek(file, 0, SEEK_SET);
+int parse_post_metadata(const char *content, struct post_metadata *metadata) {
+  // Initialize metadata with empty strings
+  memset(metadata, 0, sizeof(struct post_metadata));
 
-  char *content = malloc(file_size + 1);
-  fread(content, 1, file_size, file);
-  content[file_size] = '\0';
-  fclose(file);
+  struct post_frontmatter fm;
+  if (parse_frontmatter(content, strlen(content), &fm) <= 0) {
+    return 0;
+  }
 
-  // Parse metadata
-  struct post_metadata metadata;
-  if (!parse_post_metadata(content, &metadata)) {
+  copy_field(metadata->title, sizeof(metadata->title), fm.title);
+  copy_field(metadata->date, sizeof(metadata->date), fm.date);
+  copy_field(metadata->preview, sizeof(metadata->preview), fm.preview);
+  return 1;
+}
+
+// post_split() over content[0..len), which need not be NUL-terminated.
+static const char *split_post(const char *content, size_t len,
+                              struct post_metadata *metadata,
+                              int *has_metadata) {
+  memset(metadata, 0, sizeof(*metadata));
+  struct post_frontmatter fm;
+  *has_metadata = parse_frontmatter(content, len, &fm) > 0;
+  if (*has_metadata) {
+    copy_field(metadata->title, sizeof(metadata->title), fm.title);
+    copy_field(metadata->date, sizeof(metadata->date), fm.date);
+    copy_field(metadata->preview, sizeof(metadata->preview), fm.preview);
+  } else {
     // Set default values if no metadata
-    strncpy(metadata.title, "Untitled Post", sizeof(metadata.title));
-    strncpy(metadata.date, "Unknown Date", sizeof(metadata.date));
-    strncpy(metadata.preview, "", sizeof(metadata.preview));
+    strncpy(metadata->title, "Untitled Post", sizeof(metadata->title));
+    strncpy(metadata->date, "Unknown Date", sizeof(metadata->date));
+    strncpy(metadata->preview, "", sizeof(metadata->preview));
   }
 
   // Find start of actual content (after frontmatter)
-  const char *content_start = strstr(content, FRONTMATTER_DELIM);
+  const char *end = content + len;
+  const char *content_start = find_delim(content, end);
   if (content_start) {
     content_start =
-        strstr(content_start + strlen(FRONTMATTER_DELIM), FRONTMATTER_DELIM);
+        find_delim(content_start + strlen(FRONTMATTER_DELIM), end);
     if (content_start) {
       content_start += strlen(FRONTMATTER_DELIM);
     }
   }
+  return content_start ? content_start : content;
+}
 
-  // Convert markdown to HTML
-  char *html_content =
-      markdown_to_html(content_start ? content_start : content);
-  if (!html_content) {
-    free(content);
-    send_500(client_fd);
-    return;
+const char *post_split(const char *content, struct post_metadata *metadata,
+                       int *has_metadata) {
+  return split_post(content, strlen(content), metadata, has_metadata);
+}
+
+void post_source_path(const struct server_config *config, const char *slug,
+                      char *out, size_t size) {
+  if (pack_path()[0]) {
+    snprintf(out, size, "%s", pack_path());
+  } else {
+    snprintf(out, size, "%s/%s.md", config->blog_dir, slug);
+  }
+}
+
+// Post body converted from markdown, before templating
+struct post_body {
+  struct post_metadata metadata;
+  const char *html;
+  char *owned;          // html, when it is not borrowed from a pack
+  char reading_time[32]; // "" for bodies rendered ahead (packed HTML)
+  char *toc;             // NULL for those, and for posts without headings
+};
+
+static void free_body(struct post_body *body) {
+  free(body->owned);
+  free(body->toc);
+  body->html = body->owned = body->toc = NULL;
+}
+
+// Converts `markdown` into the body, with the reading time and table of
+// contents from the same parse. Returns 0 on success.
+static int convert_markdown(const char *markdown, size_t len,
+                            struct post_body *body) {
+  struct markdown_doc doc;
+  if (markdown_analyze(markdown, len, MARKDOWN_HTML | MARKDOWN_TOC, &doc) !=
+      0) {
+    return -1;
+  }
+  body->html = body->owned = doc.html;
+  doc.html = NULL;
+  if (doc.toc[0]) {
+    size_t toc_size = strlen(doc.toc) + 64;
+    if ((body->toc = malloc(toc_size)) != NULL) {
+      snprintf(body->toc, toc_size, "<nav class=\"toc\">\n%s</nav>\n",
+               doc.toc);
+    }
   }
+  snprintf(body->reading_time, sizeof(body->reading_time), "%d min read",
+           doc.reading_minutes > 0 ? doc.reading_minutes : 1);
+  markdown_doc_free(&doc);
+  return 0;
+}
 
-  // Render with file-based template
-  struct template_kv pkvs[4];
+char *post_excerpt(const char *content, size_t len) {
+  struct post_metadata metadata;
+  int has_metadata;
+  const char *markdown = split_post(content, len, &metadata, &has_metadata);
+  struct markdown_doc doc;
+  if (markdown_analyze(markdown, (size_t)(content + len - markdown),
+                       MARKDOWN_EXCERPT, &doc) != 0) {
+    return NULL;
+  }
+  char *excerpt = doc.excerpt[0] ? html_escape(doc.excerpt) : NULL;
+  markdown_doc_free(&doc);
+  return excerpt;
+}
+
+// Page metadata of a packed post.
+static void packed_metadata(const struct pack_entry *entry,
+                            struct post_metadata *metadata) {
+  if (entry->untitled) {
+    strncpy(metadata->title, "Untitled Post", sizeof(metadata->title));
+    strncpy(metadata->date, "Unknown Date", sizeof(metadata->date));
+    strncpy(metadata->preview, "", sizeof(metadata->preview));
+  } else {
+    copy_field(metadata->title, sizeof(metadata->title),
+               (struct post_field){entry->title, strlen(entry->title)});
+    copy_field(metadata->date, sizeof(metadata->date),
+               (struct post_field){entry->date, strlen(entry->date)});
+    copy_field(metadata->preview, sizeof(metadata->preview),
+               (struct post_field){entry->preview, strlen(entry->preview)});
+  }
+}
+
+// Takes a packed post's metadata and, if present, its pre-rendered body.
+static int convert_packed(const struct pack *pack, const char *slug,
+                          struct post_body *body) {
+  struct pack_entry entry;
+  if (pack_find(pack, slug, &entry) != 0) {
+    return -1;
+  }
+
+  packed_metadata(&entry, &body->metadata);
+  if (entry.html) {
+    body->html = entry.html;
+    return 0;
+  }
+  return convert_markdown(entry.markdown, strlen(entry.markdown), body) == 0
+             ? 0
+             : -2;
+}
+
+// Reads and converts one post, from `pack` if one is given. Touches only
+// the vfs, the pack and md4c, so it is safe on worker threads. Returns -1
+// if the post is missing, -2 if conversion failed.
+static int convert_post(const char *filepath, const struct pack *pack,
+                        const char *slug, struct post_body *body) {
+  body->html = body->owned = body->toc = NULL;
+  body->reading_time[0] = '\0';
+  if (pack) {
+    return convert_packed(pack, slug, body);
+  }
+
+  struct vfs_file file;
+  if (vfs_open(filepath, &file) != 0) {
+    return -1;
+  }
+
+  int has_metadata;
+  const char *markdown = post_split(file.data, &body->metadata, &has_metadata);
+
+  // Convert markdown to HTML
+  int rc = convert_markdown(markdown, (size_t)(file.data + file.len - markdown),
+                            body);
+  vfs_close(&file);
+  return rc == 0 ? 0 : -2;
+}
+
+#define POST_VARS 6
+
+// Template variables of a post page.
+static void post_vars(struct template_kv pkvs[POST_VARS],
+                      const struct post_metadata *metadata,
+                      const char *html, const char *reading_time,
+                      const char *toc) {
   pkvs[0].key = "TITLE";
-  pkvs[0].value = metadata.title;
+  pkvs[0].value = metadata->title;
   pkvs[0].is_raw = 0;
   pkvs[1].key = "DATE";
-  pkvs[1].value = metadata.date;
+  pkvs[1].value = metadata->date;
   pkvs[1].is_raw = 0;
   pkvs[2].key = "POST_TITLE";
-  pkvs[2].value = metadata.title;
+  pkvs[2].value = metadata->title;
   pkvs[2].is_raw = 0;
   pkvs[3].key = "CONTENT";
-  pkvs[3].value = html_content;
+  pkvs[3].value = html;
   pkvs[3].is_raw = 1;
+  pkvs[4].key = "READING_TIME";
+  pkvs[4].value = reading_time;
+  pkvs[4].is_raw = 0;
+  pkvs[5].key = "TOC";
+  pkvs[5].value = toc ? toc : "";
+  pkvs[5].is_raw = 1;
+}
+
+// Renders `body` with the file-based post template.
+static char *wrap_post(const char *post_tpl_path,
+                       const struct post_body *body) {
+  struct template_kv pkvs[POST_VARS];
+  post_vars(pkvs, &body->metadata, body->html, body->reading_time, body->toc);
 
   char *full_html = NULL;
+  if (render_template_file(post_tpl_path, pkvs, POST_VARS, &full_html) != 0) {
+    free(full_html);
+    return NULL;
+  }
+  return full_html;
+}
+
+// Records what a post page is rendered from; call before reading it.
+static void post_deps(struct page_deps *deps, const char *filepath,
+                      const char *post_tpl_path, const char *slug) {
+  page_deps_init(deps);
+  page_deps_source(deps, filepath);
+  page_deps_source(deps, post_tpl_path);
+  page_deps_tag(deps, "post", slug);
+}
+
+struct page_entry *render_post_page(struct server_config *config,
+                                    const char *slug,
+                                    enum canned_response *error) {
+  char cache_key[320];
+  snprintf(cache_key, sizeof(cache_key), "post:%s", slug);
+  struct page_entry *cached = page_cache_get(cache_key);
+  if (cached) {
+    return cached;
+  }
+
+  char filepath[512];
+  post_source_path(config, slug, filepath, sizeof(filepath));
   char post_tpl_path[512];
   snprintf(post_tpl_path, sizeof(post_tpl_path), "%s/post.html",
            config->templates_dir);
-  if (render_template_file(post_tpl_path, pkvs, 4, &full_html) != 0 ||
-      !full_html) {
-    free(content);
-    free(html_content);
-    send_500(client_fd);
-    return;
-  }
-
-  // Send response
-  char headers[512];
-  snprintf(headers, sizeof(headers),
-           "HTTP/1.1 200 OK\r\n"
-           "Content-Type: text/html\r\n"
-           "Content-Length: %lu\r\n"
-           "Connection: close\r\n"
-           "\r\n",
-           strlen(full_html));
-
-  write(client_fd, headers, strlen(headers));
-  write(client_fd, full_html, strlen(full_html));
-
-  // Clean up
-  free(content);
-  free(html_content);
+
+  // Identities are taken before reading so a concurrent edit invalidates
+  struct page_deps deps;
+  post_deps(&deps, filepath, post_tpl_path, slug);
+
+  struct pack *pack = pack_acquire();
+  struct post_body body;
+  int rc = convert_post(filepath, pack, slug, &body);
+  char *full_html = rc == 0 ? wrap_post(post_tpl_path, &body) : NULL;
+  struct page_entry *entry = NULL;
+  if (full_html) {
+    entry = page_cache_put(cache_key, mime_html(), full_html,
+                           strlen(full_html), &deps);
+  }
+  if (!entry) {
+    *error = rc == -1 ? CANNED_NOT_FOUND_PLAIN : CANNED_SERVER_ERROR_PLAIN;
+  }
+
+  page_deps_free(&deps);
+  free_body(&body);
   free(full_html);
+  pack_release(pack);
+  return entry;
 }
 
-struct blog_index *build_post_index(const char *content_dir) {
-  DIR *dir;
-  struct dirent *entry;
-  struct blog_index *index = malloc(sizeof(struct blog_index));
-  index->post_count = 0;
+static void stream_html(const char *text, size_t size, void *arg) {
+  chunked_write(arg, text, size);
+}
 
-  dir = opendir(content_dir);
-  if (!dir) {
-    printf("Failed to open content directory: %s\n", content_dir);
-    return index;
+// Sends a post whose body is at least stream_threshold bytes without
+// holding it in memory: the markdown is mapped and converted straight into
+// chunked writes, between the template text before and after {{{CONTENT}}}.
+// Streamed pages are not cached, carry no ETag and have no reading time or
+// table of contents. Returns 0, sending nothing, if the post is smaller,
+// already cached or missing.
+static int stream_post_page(int client_fd, struct server_config *config,
+                            const char *slug, const char *version) {
+  char cache_key[320];
+  snprintf(cache_key, sizeof(cache_key), "post:%s", slug);
+  struct page_entry *cached = page_cache_get(cache_key);
+  if (cached) {
+    page_cache_release(cached);
+    return 0;
   }
 
-  while ((entry = readdir(dir)) != NULL && index->post_count < MAX_POSTS) {
-    // Skip . and .. directories
-    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-      continue;
+  char filepath[512];
+  post_source_path(config, slug, filepath, sizeof(filepath));
+  size_t threshold = config->stream_threshold;
+
+  struct post_metadata metadata;
+  const char *markdown = NULL;
+  const char *html = NULL;
+  size_t len = 0;
+  struct vfs_file file;
+  memset(&file, 0, sizeof(file));
+  struct pack *pack = pack_acquire();
+  if (pack) {
+    struct pack_entry entry;
+    if (pack_find(pack, slug, &entry) != 0) {
+      pack_release(pack);
+      return 0;
+    }
+    // Only the first `threshold` bytes are looked at for small posts
+    html = entry.html;
+    const char *text = html ? html : entry.markdown;
+    if (strnlen(text, threshold) < threshold) {
+      pack_release(pack);
+      return 0;
     }
+    packed_metadata(&entry, &metadata);
+    markdown = entry.markdown;
+    len = strlen(text);
+  } else {
+    size_t size;
+    if (vfs_stat(filepath, &size, NULL) != 0 || size < threshold ||
+        vfs_map(filepath, &file) != 0) {
+      return 0;
+    }
+    int has_metadata;
+    markdown = split_post(file.data, file.len, &metadata, &has_metadata);
+    len = (size_t)(file.data + file.len - markdown);
+  }
 
-    // Check if file ends with .md
-    size_t name_len = strlen(entry->d_name);
-    if (name_len > 3 && strcmp(entry->d_name + name_len - 3, ".md") == 0) {
-      char filepath[512];
-      snprintf(filepath, sizeof(filepath), "%s/%s", content_dir, entry->d_name);
-
-      // Read file content
-      FILE *file = fopen(filepath, "r");
-      if (file) {
-        fseek(file, 0, SEEK_END);
-        long file_size = ftell(file);
-        fseek(file, 0, SEEK_SET);
-
-        char *content = malloc(file_size + 1);
-        fread(content, 1, file_size, file);
-        content[file_size] = '\0';
-        fclose(file);
-
-        // Store filename without .md extension
-        strncpy(index->posts[index->post_count].filename, entry->d_name,
-                name_len - 3);
-        index->posts[index->post_count].filename[name_len - 3] = '\0';
-
-        // Parse metadata
-        parse_post_metadata(content, &index->posts[index->post_count].metadata);
-        free(content);
-
-        index->post_count++;
+  char post_tpl_path[512];
+  snprintf(post_tpl_path, sizeof(post_tpl_path), "%s/post.html",
+           config->templates_dir);
+  struct template_kv pkvs[POST_VARS];
+  post_vars(pkvs, &metadata, "", "", "");
+  char *page = NULL;
+  size_t slot_at;
+  if (render_template_split(post_tpl_path, pkvs, POST_VARS, "CONTENT", &page,
+                            &slot_at) != 0) {
+    send_canned(client_fd, CANNED_SERVER_ERROR_PLAIN);
+  } else {
+    logger_log(LOG_DEBUG, "Streaming post %s (%zu bytes)", slug, len);
+    struct chunked_writer out;
+    if (chunked_begin(&out, client_fd, mime_html(), version) == 0) {
+      chunked_write(&out, page, slot_at);
+      int rc = 0;
+      if (html) {
+        chunked_write(&out, html, len);
+      } else {
+        rc = markdown_stream(markdown, len, stream_html, &out);
+      }
+      chunked_write(&out, page + slot_at, strlen(page + slot_at));
+      // Without the final chunk the client sees the response as cut short
+      if (rc == 0) {
+        chunked_end(&out);
+      } else {
+        logger_log(LOG_ERROR, "Failed to convert post %s", slug);
       }
     }
   }
 
-  closedir(dir);
+  free_rendered_template(page);
+  vfs_close(&file);
+  pack_release(pack);
+  return 1;
+}
+
+int handle_markdown_post(int client_fd, const char *path,
+                         const char *version, const char *if_none_match,
+                         struct server_config *config) {
+  if (config->stream_threshold > 0 &&
+      stream_post_page(client_fd, config, path, version)) {
+    return 0;
+  }
+  enum canned_response error = CANNED_SERVER_ERROR_PLAIN;
+  struct page_entry *entry = render_post_page(config, path, &error);
+  send_page(client_fd, entry, error, if_none_match);
+  return !entry && error == CANNED_NOT_FOUND_PLAIN ? -1 : 0;
+}
+
+#define RENDER_WINDOW 256 // posts converted per parallel round
 
-  // Sort posts by date (newest first)
-  for (int i = 0; i < index->post_count - 1; i++) {
-    for (int j = i + 1; j < index->post_count; j++) {
-      if (strcmp(index->posts[i].metadata.date, index->posts[j].metadata.date) <
-          0) {
-        struct blog_post temp = index->posts[i];
-        index->posts[i] = index->posts[j];
-        index->posts[j] = temp;
+struct render_job {
+  struct server_config *config;
+  const struct pack *pack;
+  const struct blog_post *posts;
+  struct post_body *bodies;
+};
+
+static void convert_one(size_t item, int worker, void *arg) {
+  (void)worker;
+  struct render_job *job = arg;
+  char filepath[512];
+  snprintf(filepath, sizeof(filepath), "%s/%s.md", job->config->blog_dir,
+           job->posts[item].filename);
+  convert_post(filepath, job->pack, job->posts[item].filename,
+               &job->bodies[item]);
+}
+
+int post_render_all(struct server_config *config, const struct blog_index *index,
+                    int (*skip)(const struct blog_post *post, void *arg),
+                    post_batch_fn emit, void *arg) {
+  char post_tpl_path[512];
+  snprintf(post_tpl_path, sizeof(post_tpl_path), "%s/post.html",
+           config->templates_dir);
+
+  struct blog_post *posts = malloc(RENDER_WINDOW * sizeof(*posts));
+  struct post_body *bodies = calloc(RENDER_WINDOW, sizeof(*bodies));
+  struct page_deps *deps = calloc(RENDER_WINDOW, sizeof(*deps));
+  struct page_entry **entries = calloc(RENDER_WINDOW, sizeof(*entries));
+  int rendered = 0;
+  int next = 0;
+  while (posts && bodies && deps && entries && next < index->post_count) {
+    int count = 0;
+    for (; next < index->post_count && count < RENDER_WINDOW; next++) {
+      if (!skip || !skip(&index->posts[next], arg)) {
+        posts[count++] = index->posts[next];
+      }
+    }
+
+    // Markdown conversion runs in parallel; templating and the cache are
+    // single-threaded
+    for (int i = 0; i < count; i++) {
+      char filepath[512];
+      post_source_path(config, posts[i].filename, filepath, sizeof(filepath));
+      post_deps(&deps[i], filepath, post_tpl_path, posts[i].filename);
+    }
+    struct render_job job = {config, index->pack, posts, bodies};
+    workers_run((size_t)count, convert_one, &job);
+
+    for (int i = 0; i < count; i++) {
+      char *full_html = bodies[i].html ? wrap_post(post_tpl_path, &bodies[i])
+                                       : NULL;
+      entries[i] = NULL;
+      if (full_html) {
+        char cache_key[320];
+        snprintf(cache_key, sizeof(cache_key), "post:%s", posts[i].filename);
+        entries[i] = page_cache_put(cache_key, mime_html(), full_html,
+                                    strlen(full_html), &deps[i]);
+        rendered += entries[i] != NULL;
+      }
+      free(full_html);
+      free_body(&bodies[i]);
+      page_deps_free(&deps[i]);
+    }
+
+    if (emit && count > 0) {
+      emit(posts, entries, count, arg);
+    }
+    for (int i = 0; i < count; i++) {
+      if (entries[i]) {
+        page_cache_release(entries[i]);
       }
     }
   }
 
-  return index;
+  free(posts);
+  free(bodies);
+  free(deps);
+  free(entries);
+  return rendered;
 }
-
-void free_post_index(struct blog_index *index) { free(index); }
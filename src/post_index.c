@@ -0,0 +1,1096 @@
+// src/post_index.c
+#include "../include/post_index.h"
+#include "../include/logger.h"
+#include "../include/pack.h"
+#include "../include/page_cache.h"
+#include "../include/rcu.h"
+#include "../include/vfs.h"
+#include "../include/workers.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+
+#define WATCH_MASK                                                             \
+  (IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM |        \
+   IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+#endif
+
+static struct blog_index *g_index = NULL;
+static char g_content_dir[256];
+static int g_watch_fd = -1;
+static post_hint_fn g_hint = NULL;
+static char g_pack_name[256]; // watched pack file, "" when reading blog_dir
+
+#ifdef __linux__
+// Watched directory, relative to g_content_dir ("" for the root)
+struct watched_dir {
+  int wd;
+  char dir[256];
+};
+
+static struct watched_dir *g_watches = NULL;
+static size_t g_watch_count = 0, g_watch_cap = 0;
+
+// Full rebuild running on its own thread; requests keep being served from
+// the published index until the thread reports back through the pipe
+struct rebuild {
+  pthread_t thread;
+  int running;
+  int again;         // more changes arrived while it ran
+  struct pack *pack; // handed to the thread
+  struct blog_index *result;
+  int fds[2]; // completion pipe
+};
+static struct rebuild g_rebuild = {.fds = {-1, -1}};
+#endif
+
+// Append-only string storage shared by successive index versions. Strings
+// are interned, so repeated values (dates, empty previews) are stored once.
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t used, cap;
+  char data[];
+};
+
+struct string_arena {
+  int refcount;
+  struct arena_chunk *chunks; // newest first
+  size_t bytes;               // string bytes stored
+  const char **slots;         // intern table, open addressing
+  size_t slot_count, slot_used;
+};
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+#define FRONTMATTER_PREFIX 4096
+#define EXCERPT_PREFIX 8192 // markdown read past the frontmatter for excerpts
+#define EXCERPT_TAIL 4096   // and at the end of the file
+
+static struct string_arena *arena_new(void) {
+  struct string_arena *arena = calloc(1, sizeof(*arena));
+  if (arena) {
+    arena->refcount = 1;
+  }
+  return arena;
+}
+
+static void arena_release(struct string_arena *arena) {
+  if (!arena || --arena->refcount > 0) {
+    return;
+  }
+  for (struct arena_chunk *c = arena->chunks; c;) {
+    struct arena_chunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  free(arena->slots);
+  free(arena);
+}
+
+static uint64_t hash_bytes(const char *s, size_t len) {
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)s[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static int arena_grow_slots(struct string_arena *arena) {
+  size_t count = arena->slot_count ? arena->slot_count * 2 : 1024;
+  const char **slots = calloc(count, sizeof(*slots));
+  if (!slots) {
+    return -1;
+  }
+  for (size_t i = 0; i < arena->slot_count; i++) {
+    const char *str = arena->slots[i];
+    if (!str) {
+      continue;
+    }
+    size_t k = hash_bytes(str, strlen(str)) & (count - 1);
+    while (slots[k]) {
+      k = (k + 1) & (count - 1);
+    }
+    slots[k] = str;
+  }
+  free(arena->slots);
+  arena->slots = slots;
+  arena->slot_count = count;
+  return 0;
+}
+
+// Returns a stable copy of s[0..len), reusing an identical string if any.
+static const char *arena_intern(struct string_arena *arena, const char *s,
+                                size_t len) {
+  if (len == 0) {
+    s = ""; // missing frontmatter fields arrive as empty slices
+  }
+  if (arena->slot_used * 2 >= arena->slot_count &&
+      arena_grow_slots(arena) != 0) {
+    return NULL;
+  }
+
+  size_t mask = arena->slot_count - 1;
+  size_t k = hash_bytes(s, len) & mask;
+  for (; arena->slots[k]; k = (k + 1) & mask) {
+    if (strncmp(arena->slots[k], s, len) == 0 && arena->slots[k][len] == '\0') {
+      return arena->slots[k];
+    }
+  }
+
+  struct arena_chunk *chunk = arena->chunks;
+  if (!chunk || chunk->cap - chunk->used < len + 1) {
+    size_t cap = len + 1 > ARENA_CHUNK_SIZE ? len + 1 : ARENA_CHUNK_SIZE;
+    chunk = malloc(sizeof(*chunk) + cap);
+    if (!chunk) {
+      return NULL;
+    }
+    chunk->used = 0;
+    chunk->cap = cap;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+  }
+
+  char *copy = chunk->data + chunk->used;
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  chunk->used += len + 1;
+  arena->bytes += len + 1;
+  arena->slots[k] = copy;
+  arena->slot_used++;
+  return copy;
+}
+
+// Moves the strings of `src` into `dst` and frees `src`. Pointers into
+// `src` stay valid, but equal strings from both are not merged: only one
+// copy is in the intern table, and arena_intern() on `dst` returns it.
+static void arena_absorb(struct string_arena *dst, struct string_arena *src) {
+  if (src->chunks) {
+    struct arena_chunk *tail = src->chunks;
+    while (tail->next) {
+      tail = tail->next;
+    }
+    tail->next = dst->chunks;
+    dst->chunks = src->chunks;
+    src->chunks = NULL;
+  }
+  dst->bytes += src->bytes;
+
+  for (size_t i = 0; i < src->slot_count; i++) {
+    const char *str = src->slots[i];
+    if (!str || (dst->slot_used * 2 >= dst->slot_count &&
+                 arena_grow_slots(dst) != 0)) {
+      continue;
+    }
+    size_t len = strlen(str);
+    size_t mask = dst->slot_count - 1;
+    size_t k = hash_bytes(str, len) & mask;
+    while (dst->slots[k] && strcmp(dst->slots[k], str) != 0) {
+      k = (k + 1) & mask;
+    }
+    if (!dst->slots[k]) {
+      dst->slots[k] = str;
+      dst->slot_used++;
+    }
+  }
+  arena_release(src);
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date.
+static int64_t days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+// Parses "YYYY-MM-DD" with an optional " HH:MM[:SS]" or "THH:MM[:SS]".
+static int64_t parse_date_key(const char *date) {
+  int y, mo, d, h = 0, mi = 0, sec = 0;
+  if (sscanf(date, "%4d-%2d-%2d", &y, &mo, &d) != 3 || mo < 1 || mo > 12 ||
+      d < 1 || d > 31) {
+    return INT64_MIN;
+  }
+  if (strlen(date) > 10 && (date[10] == ' ' || date[10] == 'T')) {
+    sscanf(date + 11, "%2d:%2d:%2d", &h, &mi, &sec);
+  }
+  return days_from_civil(y, (unsigned)mo, (unsigned)d) * 86400 + h * 3600 +
+         mi * 60 + sec;
+}
+
+// Newest first; ties fall back to the date text, then the slug.
+static int compare_posts(const void *a, const void *b) {
+  const struct blog_post *pa = a, *pb = b;
+  if (pa->date_key != pb->date_key) {
+    return pa->date_key < pb->date_key ? 1 : -1;
+  }
+  int c = strcmp(pb->date, pa->date);
+  return c ? c : strcmp(pa->filename, pb->filename);
+}
+
+static int reserve_posts(struct blog_index *index, int count) {
+  if (count <= index->post_cap) {
+    return 0;
+  }
+  int cap = index->post_cap ? index->post_cap : 64;
+  while (cap < count) {
+    cap *= 2;
+  }
+  struct blog_post *posts = realloc(index->posts, sizeof(*posts) * (size_t)cap);
+  if (!posts) {
+    return -1;
+  }
+  index->posts = posts;
+  index->post_cap = cap;
+  return 0;
+}
+
+// Non-zero if buf[from..at) ends with a blank line, in LF or CRLF files.
+static int blank_line_at(const char *buf, size_t from, size_t at) {
+  return at - from >= 2 && buf[at - 1] == '\n' &&
+         (buf[at - 2] == '\n' ||
+          (at - from >= 3 && buf[at - 2] == '\r' && buf[at - 3] == '\n'));
+}
+
+// Excerpt of the post at `filepath` (see post_excerpt()), or NULL. A long
+// file is not read whole: EXCERPT_PREFIX bytes past the frontmatter (which
+// ends at `body_off`) are far more than the excerpt takes, and the last
+// EXCERPT_TAIL bytes are added for the link reference definitions usually
+// kept there. Both are cut at a blank line, so no block is parsed half
+// read.
+static char *read_excerpt(const char *filepath, size_t body_off,
+                          size_t size) {
+  size_t head = body_off + EXCERPT_PREFIX;
+  size_t tail = EXCERPT_TAIL;
+  if (size <= head + tail) {
+    head = size;
+    tail = 0;
+  }
+  char *buf = malloc(head + 1 + tail);
+  if (!buf) {
+    return NULL;
+  }
+
+  ssize_t n = vfs_pread(filepath, buf, head, 0);
+  size_t len = n > 0 ? (size_t)n : 0;
+  if (tail > 0 && len == head) {
+    size_t cut = len;
+    while (cut > body_off + 1 && !blank_line_at(buf, body_off, cut)) {
+      cut--;
+    }
+    if (cut > body_off + 1) {
+      len = cut;
+    }
+    char *end = buf + len;
+    n = vfs_pread(filepath, end, tail, size - tail);
+    // Keep from the last newline of the first blank line
+    size_t skip = 2;
+    while (n > 0 && skip <= (size_t)n && !blank_line_at(end, 0, skip)) {
+      skip++;
+    }
+    if (n > 0 && skip <= (size_t)n) {
+      skip--;
+      memmove(end, end + skip, (size_t)n - skip);
+      len += (size_t)n - skip;
+    }
+  }
+
+  char *excerpt = len > 0 ? post_excerpt(buf, len) : NULL;
+  free(buf);
+  return excerpt;
+}
+
+// Reads `name` (a file in content_dir) into `post`. Returns 0 on success.
+static int load_post(struct string_arena *arena, const char *content_dir,
+                     const char *name, struct blog_post *post) {
+  // Check if file ends with .md
+  size_t name_len = strlen(name);
+  if (name_len <= 3 || strcmp(name + name_len - 3, ".md") != 0) {
+    return -1;
+  }
+
+  char filepath[512];
+  snprintf(filepath, sizeof(filepath), "%s/%s", content_dir, name);
+
+  // Identity first, so an edit racing the read is caught next time
+  if (vfs_identity(filepath, &post->id) != 0) {
+    return -1;
+  }
+
+  char slug[256];
+  if (name_len - 3 >= sizeof(slug)) {
+    return -1;
+  }
+  memcpy(slug, name, name_len - 3);
+  slug[name_len - 3] = '\0';
+
+  char prefix[FRONTMATTER_PREFIX];
+  char *buf = prefix;
+  struct post_frontmatter fm;
+  long body_off = 0;
+  int hinted = g_hint && g_hint(slug, &post->id, &fm);
+  if (!hinted) {
+    // Only the frontmatter is needed: read a bounded prefix and extend it
+    // only while the closing delimiter is still missing
+    size_t cap = sizeof(prefix);
+    ssize_t n = vfs_pread(filepath, buf, cap, 0);
+    if (n < 0) {
+      return -1;
+    }
+
+    size_t len = (size_t)n;
+    while ((body_off = parse_frontmatter(buf, len, &fm)) < 0 && len == cap) {
+      char *grown = malloc(cap * 2);
+      if (!grown) {
+        break;
+      }
+      memcpy(grown, buf, len);
+      if (buf != prefix) {
+        free(buf);
+      }
+      buf = grown;
+      cap *= 2;
+      n = vfs_pread(filepath, buf + len, cap - len, len);
+      len += n > 0 ? (size_t)n : 0;
+    }
+  }
+
+  // Posts without a preview are listed with the opening of their text.
+  // Snapshots and packs record it like a preview, so it is derived once: a
+  // hinted post's preview is already its excerpt (or there is none).
+  char *excerpt = fm.preview.len == 0 && !hinted
+                      ? read_excerpt(filepath, body_off > 0 ? (size_t)body_off : 0,
+                                     post->id.size)
+                      : NULL;
+  if (excerpt) {
+    fm.preview = (struct post_field){excerpt, strlen(excerpt)};
+  }
+
+  // Store filename without .md extension; values go straight to the arena
+  post->filename = arena_intern(arena, name, name_len - 3);
+  post->title = arena_intern(arena, fm.title.data, fm.title.len);
+  post->date = arena_intern(arena, fm.date.data, fm.date.len);
+  post->preview = arena_intern(arena, fm.preview.data, fm.preview.len);
+  free(excerpt);
+  if (buf != prefix) {
+    free(buf);
+  }
+  if (!post->filename || !post->title || !post->date || !post->preview) {
+    return -1;
+  }
+  post->date_key = parse_date_key(post->date);
+  return 0;
+}
+
+// Relative paths of every post under the content directory
+struct post_scan {
+  char **names;
+  size_t count, cap;
+};
+
+static int collect_post(const struct vfs_entry *entry, void *arg) {
+  struct post_scan *scan = arg;
+  size_t len = strlen(entry->path);
+  if (entry->is_dir || len <= 3 || strcmp(entry->path + len - 3, ".md") != 0) {
+    return 0;
+  }
+  if (scan->count == scan->cap) {
+    size_t cap = scan->cap ? scan->cap * 2 : 256;
+    char **names = realloc(scan->names, cap * sizeof(*names));
+    if (!names) {
+      return 1;
+    }
+    scan->names = names;
+    scan->cap = cap;
+  }
+  scan->names[scan->count] = strdup(entry->path);
+  if (!scan->names[scan->count]) {
+    return 1;
+  }
+  scan->count++;
+  return 0;
+}
+
+struct index_job {
+  const char *content_dir;
+  char **names;
+  struct blog_post *posts;      // one slot per name
+  unsigned char *loaded;        // posts[i] is valid
+  struct string_arena **arenas; // one per worker
+};
+
+static void index_one(size_t item, int worker, void *arg) {
+  struct index_job *job = arg;
+  job->loaded[item] = load_post(job->arenas[worker], job->content_dir,
+                                job->names[item], &job->posts[item]) == 0;
+}
+
+// Reads the frontmatter of every post in parallel, each worker interning
+// into its own arena, then merges the results into `index`.
+static int index_posts(struct blog_index *index, const char *content_dir,
+                       struct post_scan *scan) {
+  int workers = workers_for(scan->count);
+  struct index_job job = {content_dir, scan->names, NULL, NULL, NULL};
+  job.loaded = calloc(scan->count, 1);
+  job.arenas = calloc((size_t)workers, sizeof(*job.arenas));
+  int ok = job.loaded && job.arenas &&
+           reserve_posts(index, (int)scan->count) == 0;
+  for (int w = 0; ok && w < workers; w++) {
+    ok = (job.arenas[w] = arena_new()) != NULL;
+  }
+
+  if (ok) {
+    job.posts = index->posts;
+    workers_run(scan->count, index_one, &job);
+
+    // Drop unreadable files, keeping the array dense
+    for (size_t i = 0; i < scan->count; i++) {
+      if (job.loaded[i]) {
+        index->posts[index->post_count++] = index->posts[i];
+      }
+    }
+    for (int w = 0; w < workers; w++) {
+      arena_absorb(index->arena, job.arenas[w]);
+      job.arenas[w] = NULL;
+    }
+
+    // Workers interned separately; point every post at the canonical copy
+    // so equal strings share a pointer, as post_equal() expects
+    for (int i = 0; i < index->post_count; i++) {
+      struct blog_post *post = &index->posts[i];
+      const char **fields[3] = {&post->title, &post->date, &post->preview};
+      for (int f = 0; f < 3; f++) {
+        const char *copy = arena_intern(index->arena, *fields[f],
+                                        strlen(*fields[f]));
+        if (copy) {
+          *fields[f] = copy;
+        }
+      }
+    }
+  }
+
+  for (int w = 0; job.arenas && w < workers; w++) {
+    arena_release(job.arenas[w]);
+  }
+  free(job.arenas);
+  free(job.loaded);
+  return ok ? 0 : -1;
+}
+
+// Lists the posts of a pack. Records are already in index order and the
+// strings stay in the mapping, so nothing is read, copied or sorted.
+static int index_pack(struct blog_index *index, struct pack *pack) {
+  index->pack = pack;
+  if (reserve_posts(index, pack_count(pack)) != 0) {
+    return -1;
+  }
+  for (int i = 0; i < pack_count(pack); i++) {
+    struct pack_entry entry;
+    if (pack_get(pack, i, &entry) != 0) {
+      continue;
+    }
+    struct blog_post *post = &index->posts[index->post_count++];
+    post->filename = entry.slug;
+    post->title = entry.title;
+    post->date = entry.date;
+    post->preview = entry.preview;
+    post->date_key = entry.date_key;
+    post->id = entry.id;
+  }
+  return 0;
+}
+
+static uint64_t fingerprint(const struct blog_index *index);
+
+// Builds an index from `pack` (whose reference it takes over) or, without
+// one, from content_dir. Touches no shared state, so it may run on the
+// rebuild thread.
+static struct blog_index *build_index(const char *content_dir,
+                                      struct pack *pack) {
+  struct blog_index *index = calloc(1, sizeof(struct blog_index));
+  if (!index) {
+    pack_release(pack);
+    return NULL;
+  }
+  index->arena = arena_new();
+  if (!index->arena) {
+    pack_release(pack);
+    free(index);
+    return NULL;
+  }
+
+  if (pack) {
+    if (index_pack(index, pack) != 0) {
+      free_post_index(index);
+      return NULL;
+    }
+    index->fingerprint = fingerprint(index);
+    return index;
+  }
+
+  if (!vfs_dir_exists(content_dir)) {
+    printf("Failed to open content directory: %s\n", content_dir);
+    return index;
+  }
+
+  struct post_scan scan = {NULL, 0, 0};
+  int rc = vfs_walk(content_dir, collect_post, &scan);
+  if (rc == 0) {
+    rc = index_posts(index, content_dir, &scan);
+  }
+  for (size_t i = 0; i < scan.count; i++) {
+    free(scan.names[i]);
+  }
+  free(scan.names);
+  if (rc != 0) {
+    free_post_index(index);
+    return NULL;
+  }
+
+  qsort(index->posts, (size_t)index->post_count, sizeof(struct blog_post),
+        compare_posts);
+  index->fingerprint = fingerprint(index);
+  return index;
+}
+
+struct blog_index *build_post_index(const char *content_dir) {
+  return build_index(content_dir, pack_acquire());
+}
+
+void free_post_index(struct blog_index *index) {
+  if (!index) {
+    return;
+  }
+  arena_release(index->arena);
+  pack_release(index->pack);
+  free(index->posts);
+  free(index);
+}
+
+struct blog_index *post_index_acquire(void) {
+  return __atomic_load_n(&g_index, __ATOMIC_ACQUIRE);
+}
+
+void post_index_release(struct blog_index *index) { (void)index; }
+
+static void free_retired(void *index) { free_post_index(index); }
+
+static uint64_t fingerprint(const struct blog_index *index) {
+  uint64_t h = 1469598103934665603ULL;
+  for (int i = 0; i < index->post_count; i++) {
+    const struct blog_post *post = &index->posts[i];
+    const char *fields[4] = {post->filename, post->title, post->date,
+                             post->preview};
+    for (int f = 0; f < 4; f++) {
+      h = (h ^ hash_bytes(fields[f], strlen(fields[f]))) * 1099511628211ULL;
+    }
+  }
+  return h;
+}
+
+void post_index_set_hint(post_hint_fn hint) { g_hint = hint; }
+
+// Makes `index` current. Readers still using the previous version keep
+// it until they pass a quiescent state.
+static void publish(struct blog_index *index) {
+  struct blog_index *old =
+      __atomic_exchange_n(&g_index, index, __ATOMIC_ACQ_REL);
+  rcu_retire(old, free_retired);
+}
+
+#ifdef __linux__
+static int add_watch(const char *dir) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s%s%s", g_content_dir, *dir ? "/" : "", dir);
+  int wd = inotify_add_watch(g_watch_fd, path, WATCH_MASK);
+  if (wd == -1) {
+    return -1;
+  }
+
+  if (g_watch_count == g_watch_cap) {
+    size_t cap = g_watch_cap ? g_watch_cap * 2 : 16;
+    struct watched_dir *watches = realloc(g_watches, cap * sizeof(*watches));
+    if (!watches) {
+      return -1;
+    }
+    g_watches = watches;
+    g_watch_cap = cap;
+  }
+  g_watches[g_watch_count].wd = wd;
+  snprintf(g_watches[g_watch_count].dir, sizeof(g_watches[0].dir), "%s", dir);
+  g_watch_count++;
+  return 0;
+}
+
+static int watch_subdir(const struct vfs_entry *entry, void *arg) {
+  (void)arg;
+  if (entry->is_dir && add_watch(entry->path) != 0) {
+    logger_log(LOG_WARN, "Cannot watch %s/%s: %s", g_content_dir, entry->path,
+               strerror(errno));
+  }
+  return 0;
+}
+
+// (Re)registers the content directory and every subdirectory. Re-adding a
+// watched path keeps its descriptor, so this is safe to repeat.
+static int watch_tree(void) {
+  g_watch_count = 0;
+  if (add_watch("") != 0) {
+    return -1;
+  }
+  vfs_walk(g_content_dir, watch_subdir, NULL);
+  return 0;
+}
+
+// Watches the directory holding the pack, where a new pack is renamed in.
+static int watch_pack(void) {
+  const char *path = pack_path();
+  const char *slash = strrchr(path, '/');
+  char dir[512];
+  if (slash) {
+    snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path);
+  } else {
+    snprintf(dir, sizeof(dir), ".");
+  }
+  snprintf(g_pack_name, sizeof(g_pack_name), "%s", slash ? slash + 1 : path);
+  if (inotify_add_watch(g_watch_fd, dir[0] ? dir : "/",
+                        IN_CLOSE_WRITE | IN_MOVED_TO) == -1) {
+    g_pack_name[0] = '\0';
+    return -1;
+  }
+  return 0;
+}
+
+static const char *watched_dir(int wd) {
+  for (size_t i = 0; i < g_watch_count; i++) {
+    if (g_watches[i].wd == wd) {
+      return g_watches[i].dir;
+    }
+  }
+  return NULL;
+}
+#endif
+
+#ifdef __linux__
+// Compares posts of different index versions, whose strings live in
+// different arenas.
+static int same_meta(const struct blog_post *a, const struct blog_post *b) {
+  return strcmp(a->title, b->title) == 0 && strcmp(a->date, b->date) == 0 &&
+         strcmp(a->preview, b->preview) == 0;
+}
+
+static int same_file(const struct blog_post *a, const struct blog_post *b) {
+  return a->id.ino == b->id.ino && a->id.mtime == b->id.mtime &&
+         a->id.size == b->id.size;
+}
+
+// Evicts the pages that differ between `old` and `index`: those of posts
+// added, removed or edited, listings showing changed metadata, and every
+// listing if the order of posts changed. Returns the number of posts that
+// differ.
+static int invalidate_changes(const struct blog_index *old,
+                              const struct blog_index *index) {
+  int old_count = old ? old->post_count : 0;
+  int changed = 0;
+
+  // Old posts by slug: open addressing over their positions, -1 is empty
+  size_t slot_count = 16;
+  while (slot_count < (size_t)old_count * 2) {
+    slot_count *= 2;
+  }
+  int *slots = malloc(slot_count * sizeof(*slots));
+  unsigned char *kept = calloc((size_t)old_count + 1, 1);
+  struct page_tag *tags =
+      malloc(((size_t)old_count + (size_t)index->post_count + 1) * 2 *
+             sizeof(*tags));
+  if (!slots || !kept || !tags) {
+    free(slots);
+    free(kept);
+    free(tags);
+    for (int i = 0; i < old_count; i++) {
+      page_cache_invalidate("post", old->posts[i].filename);
+    }
+    page_cache_invalidate("index", "");
+    return index->post_count > old_count ? index->post_count : old_count;
+  }
+  size_t mask = slot_count - 1;
+  memset(slots, 0xff, slot_count * sizeof(*slots));
+  for (int i = 0; i < old_count; i++) {
+    const char *slug = old->posts[i].filename;
+    size_t k = hash_bytes(slug, strlen(slug)) & mask;
+    while (slots[k] != -1) {
+      k = (k + 1) & mask;
+    }
+    slots[k] = i;
+  }
+
+  size_t tag_count = 0;
+  for (int i = 0; i < index->post_count; i++) {
+    const struct blog_post *post = &index->posts[i];
+    size_t k = hash_bytes(post->filename, strlen(post->filename)) & mask;
+    while (slots[k] != -1 &&
+           strcmp(old->posts[slots[k]].filename, post->filename) != 0) {
+      k = (k + 1) & mask;
+    }
+    if (slots[k] == -1) {
+      tags[tag_count++] = (struct page_tag){"post", post->filename};
+      changed++;
+      continue;
+    }
+    const struct blog_post *was = &old->posts[slots[k]];
+    kept[slots[k]] = 1;
+    if (!same_meta(was, post)) {
+      tags[tag_count++] = (struct page_tag){"post", post->filename};
+      tags[tag_count++] = (struct page_tag){"meta", post->filename};
+      changed++;
+    } else if (!same_file(was, post)) {
+      tags[tag_count++] = (struct page_tag){"post", post->filename};
+      changed++;
+    }
+  }
+  for (int i = 0; i < old_count; i++) {
+    if (!kept[i]) {
+      tags[tag_count++] = (struct page_tag){"post", old->posts[i].filename};
+      changed++;
+    }
+  }
+
+  // Listings shift when any position holds a different post
+  int reordered = old_count != index->post_count;
+  for (int i = 0; !reordered && i < old_count; i++) {
+    reordered = strcmp(old->posts[i].filename, index->posts[i].filename) != 0;
+  }
+  if (reordered) {
+    tags[tag_count++] = (struct page_tag){"index", ""};
+  }
+
+  page_cache_invalidate_tags(tags, tag_count);
+  free(slots);
+  free(kept);
+  free(tags);
+  return changed;
+}
+
+// Publishes a rebuilt index, evicting only what it changed.
+static int swap_in(struct blog_index *index) {
+  int changed = invalidate_changes(g_index, index);
+  publish(index);
+  logger_log(LOG_INFO, "Post index rebuilt: %d posts, %d changed",
+             index->post_count, changed);
+  return changed;
+}
+
+static void *rebuild_main(void *arg) {
+  struct rebuild *r = arg;
+  r->result = build_index(g_content_dir, r->pack);
+  char done = 1;
+  ssize_t n = write(r->fds[1], &done, 1);
+  (void)n; // the pipe has room: one byte per rebuild
+  return NULL;
+}
+
+// Starts a full rebuild on its own thread, or queues one if a rebuild is
+// already running.
+static int start_rebuild(void) {
+  if (g_rebuild.running) {
+    g_rebuild.again = 1;
+    return 0;
+  }
+  if (g_pack_name[0]) {
+    if (pack_reload() != 1) {
+      return 0;
+    }
+  } else {
+    // Re-arm in case directories were added or replaced
+    watch_tree();
+  }
+
+  logger_log(LOG_INFO, "Rebuilding post index");
+  g_rebuild.pack = pack_acquire();
+  g_rebuild.result = NULL;
+  g_rebuild.again = 0;
+  if (g_rebuild.fds[0] != -1 &&
+      pthread_create(&g_rebuild.thread, NULL, rebuild_main, &g_rebuild) == 0) {
+    g_rebuild.running = 1;
+    return 0;
+  }
+
+  // No thread: rebuild inline
+  struct blog_index *index = build_index(g_content_dir, g_rebuild.pack);
+  return index ? swap_in(index) : 0;
+}
+
+// Publishes the result of a finished background rebuild.
+static int finish_rebuild(void) {
+  char done;
+  if (!g_rebuild.running || read(g_rebuild.fds[0], &done, 1) != 1) {
+    return 0;
+  }
+  pthread_join(g_rebuild.thread, NULL);
+  g_rebuild.running = 0;
+  int changed = g_rebuild.result ? swap_in(g_rebuild.result) : 0;
+  if (g_rebuild.again) {
+    changed += start_rebuild();
+  }
+  return changed;
+}
+#endif
+
+int post_index_init(const char *content_dir) {
+  snprintf(g_content_dir, sizeof(g_content_dir), "%s", content_dir);
+
+  struct blog_index *index = build_post_index(content_dir);
+  if (!index) {
+    return -1;
+  }
+  publish(index);
+  logger_log(LOG_INFO, "Post index: %d posts", index->post_count);
+
+#ifdef __linux__
+  // The embedded image never changes; only watch what is read from disk
+  const char *pack = pack_path();
+  if (g_watch_fd == -1 &&
+      (pack[0] || !vfs_is_embedded() || vfs_disk_override())) {
+    g_watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (g_watch_fd == -1 || (pack[0] ? watch_pack() : watch_tree()) != 0) {
+      logger_log(LOG_WARN, "Cannot watch %s (%s); post index is static",
+                 pack[0] ? pack : content_dir, strerror(errno));
+      if (g_watch_fd != -1) {
+        close(g_watch_fd);
+      }
+      g_watch_fd = -1;
+    }
+  }
+  if (g_watch_fd != -1 && g_rebuild.fds[0] == -1 && pipe(g_rebuild.fds) == 0) {
+    for (int i = 0; i < 2; i++) {
+      fcntl(g_rebuild.fds[i], F_SETFL, O_NONBLOCK);
+      fcntl(g_rebuild.fds[i], F_SETFD, FD_CLOEXEC);
+    }
+  }
+#endif
+  return 0;
+}
+
+int post_index_watch_fd(void) { return g_watch_fd; }
+
+int post_index_rebuild_fd(void) {
+#ifdef __linux__
+  return g_rebuild.fds[0];
+#else
+  return -1;
+#endif
+}
+
+// Edits only append to the shared arena. Once superseded strings outweigh
+// live ones, move this version onto a fresh arena of its own.
+static void compact_index(struct blog_index *index) {
+  size_t live = 0;
+  for (int i = 0; i < index->post_count; i++) {
+    const struct blog_post *post = &index->posts[i];
+    live += strlen(post->filename) + strlen(post->title) + strlen(post->date) +
+            strlen(post->preview) + 4;
+  }
+  if (index->arena->bytes <= 2 * live + ARENA_CHUNK_SIZE) {
+    return;
+  }
+
+  struct string_arena *arena = arena_new();
+  if (!arena) {
+    return;
+  }
+  for (int i = 0; i < index->post_count; i++) {
+    struct blog_post *post = &index->posts[i];
+    const char *fields[4] = {post->filename, post->title, post->date,
+                             post->preview};
+    for (int f = 0; f < 4; f++) {
+      fields[f] = arena_intern(arena, fields[f], strlen(fields[f]));
+      if (!fields[f]) {
+        arena_release(arena);
+        return; // keep the old arena; index is still consistent
+      }
+    }
+  }
+  // Every string is present now, so these lookups cannot fail
+  for (int i = 0; i < index->post_count; i++) {
+    struct blog_post *post = &index->posts[i];
+    post->filename = arena_intern(arena, post->filename, strlen(post->filename));
+    post->title = arena_intern(arena, post->title, strlen(post->title));
+    post->date = arena_intern(arena, post->date, strlen(post->date));
+    post->preview = arena_intern(arena, post->preview, strlen(post->preview));
+  }
+  arena_release(index->arena);
+  index->arena = arena;
+}
+
+// Position where `post` belongs in the sorted index.
+static int insert_position(const struct blog_index *index,
+                           const struct blog_post *post) {
+  int lo = 0, hi = index->post_count;
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (compare_posts(&index->posts[mid], post) < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static int post_equal(const struct blog_post *a, const struct blog_post *b) {
+  // Interned strings compare by pointer
+  return a->title == b->title && a->date == b->date &&
+         a->preview == b->preview;
+}
+
+// Re-reads (or drops) one post in a private copy of the index and evicts
+// the cached pages that rendered or listed it.
+static void apply_change(struct blog_index *index, const char *name) {
+  size_t name_len = strlen(name);
+  if (name_len <= 3 || strcmp(name + name_len - 3, ".md") != 0 ||
+      name_len - 3 >= 256) {
+    return;
+  }
+
+  char slug[256];
+  memcpy(slug, name, name_len - 3);
+  slug[name_len - 3] = '\0';
+
+  struct blog_post old;
+  int had_old = 0;
+  for (int i = 0; i < index->post_count; i++) {
+    if (strcmp(index->posts[i].filename, slug) == 0) {
+      old = index->posts[i];
+      had_old = 1;
+      memmove(&index->posts[i], &index->posts[i + 1],
+              sizeof(struct blog_post) * (size_t)(index->post_count - i - 1));
+      index->post_count--;
+      break;
+    }
+  }
+
+  struct blog_post post;
+  int has_new = reserve_posts(index, index->post_count + 1) == 0 &&
+                load_post(index->arena, g_content_dir, name, &post) == 0;
+  if (has_new) {
+    int at = insert_position(index, &post);
+    memmove(&index->posts[at + 1], &index->posts[at],
+            sizeof(struct blog_post) * (size_t)(index->post_count - at));
+    index->posts[at] = post;
+    index->post_count++;
+  }
+
+  page_cache_invalidate("post", slug);
+  if (had_old != has_new) {
+    page_cache_invalidate("index", ""); // listing pages shift
+  } else if (had_old && !post_equal(&old, &post)) {
+    page_cache_invalidate("meta", slug);
+    if (old.date != post.date) {
+      page_cache_invalidate("index", ""); // order may change
+    }
+  }
+}
+
+int post_index_process_events(void) {
+#ifdef __linux__
+  if (g_watch_fd == -1) {
+    return 0;
+  }
+  int changed = finish_rebuild();
+
+  char names[64][256];
+  int name_count = 0;
+  int rebuild = 0;
+
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t len;
+  while ((len = read(g_watch_fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + len;) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      p += sizeof(struct inotify_event) + ev->len;
+
+      // Serving a pack, only a new pack file matters
+      if (g_pack_name[0]) {
+        if ((ev->mask & IN_Q_OVERFLOW) ||
+            (ev->len > 0 && strcmp(ev->name, g_pack_name) == 0)) {
+          rebuild = 1;
+        }
+        continue;
+      }
+
+      // Directories appearing, vanishing or moving may carry many posts
+      if (ev->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF |
+                      IN_IGNORED | IN_ISDIR)) {
+        rebuild = 1;
+        continue;
+      }
+      const char *dir = watched_dir(ev->wd);
+      if (ev->len == 0 || ev->name[0] == '.' || !dir) {
+        continue;
+      }
+
+      char name[256];
+      int n = snprintf(name, sizeof(name), "%s%s%s", dir, *dir ? "/" : "",
+                       ev->name);
+      if (n < 0 || (size_t)n >= sizeof(name)) {
+        continue;
+      }
+
+      // Editors emit several events per save; handle each file once
+      int seen = 0;
+      for (int i = 0; i < name_count && !seen; i++) {
+        seen = strcmp(names[i], name) == 0;
+      }
+      if (seen) {
+        continue;
+      }
+      if (name_count == 64) {
+        rebuild = 1;
+        continue;
+      }
+      memcpy(names[name_count++], name, (size_t)n + 1);
+    }
+  }
+
+  // A rebuild in flight may or may not have seen these changes; another
+  // one after it will
+  if (rebuild || (g_rebuild.running && name_count > 0)) {
+    start_rebuild();
+    return changed;
+  }
+  if (name_count == 0) {
+    return changed;
+  }
+
+  // New version: copied records, shared append-only arena
+  struct blog_index *next = calloc(1, sizeof(struct blog_index));
+  if (!next || reserve_posts(next, g_index->post_count + name_count) != 0) {
+    free(next);
+    return 0;
+  }
+  memcpy(next->posts, g_index->posts,
+         sizeof(struct blog_post) * (size_t)g_index->post_count);
+  next->post_count = g_index->post_count;
+  next->arena = g_index->arena;
+  next->arena->refcount++;
+
+  for (int i = 0; i < name_count; i++) {
+    apply_change(next, names[i]);
+    logger_log(LOG_INFO, "Post index updated: %s", names[i]);
+  }
+  compact_index(next);
+  next->fingerprint = fingerprint(next);
+  publish(next);
+  return changed + name_count;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,121 @@
+// src/rcu.c
+#include "../include/rcu.h"
+#include "../include/logger.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define RCU_MAX_READERS 64
+
+// Retiring advances the global epoch. Each reader slot holds the epoch the
+// reader last saw at a quiescent state (0 = slot unused); an object retired
+// at epoch E is unreachable once every slot is at least E.
+static uint64_t g_epoch = 1;
+static uint64_t g_seen[RCU_MAX_READERS];
+static __thread int t_slot = -1;
+
+struct retired {
+  void *ptr;
+  void (*free_fn)(void *);
+  uint64_t epoch;
+  struct retired *next;
+};
+
+// Retire and reclaim are rare (one per publication); the lock never
+// touches the read side
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct retired *g_retired = NULL;
+static int g_pending = 0; // entries on g_retired
+
+int rcu_register_thread(void) {
+  if (t_slot != -1)
+    return 0;
+  uint64_t epoch = __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST);
+  for (int i = 0; i < RCU_MAX_READERS; i++) {
+    uint64_t unused = 0;
+    if (__atomic_compare_exchange_n(&g_seen[i], &unused, epoch, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+      t_slot = i;
+      return 0;
+    }
+  }
+  logger_log(LOG_ERROR, "Too many RCU reader threads");
+  return -1;
+}
+
+void rcu_unregister_thread(void) {
+  if (t_slot == -1)
+    return;
+  __atomic_store_n(&g_seen[t_slot], 0, __ATOMIC_SEQ_CST);
+  t_slot = -1;
+  rcu_quiescent();
+}
+
+// Oldest epoch any reader may still be in, UINT64_MAX with no readers.
+static uint64_t oldest_seen(void) {
+  uint64_t oldest = UINT64_MAX;
+  for (int i = 0; i < RCU_MAX_READERS; i++) {
+    uint64_t seen = __atomic_load_n(&g_seen[i], __ATOMIC_SEQ_CST);
+    if (seen != 0 && seen < oldest)
+      oldest = seen;
+  }
+  return oldest;
+}
+
+static void reclaim(void) {
+  struct retired *ready = NULL;
+  pthread_mutex_lock(&g_lock);
+  uint64_t oldest = oldest_seen();
+  for (struct retired **p = &g_retired; *p;) {
+    struct retired *r = *p;
+    if (r->epoch <= oldest) {
+      *p = r->next;
+      r->next = ready;
+      ready = r;
+      __atomic_sub_fetch(&g_pending, 1, __ATOMIC_RELAXED);
+    } else {
+      p = &r->next;
+    }
+  }
+  pthread_mutex_unlock(&g_lock);
+
+  // Free outside the lock; free functions may retire more objects
+  while (ready) {
+    struct retired *next = ready->next;
+    ready->free_fn(ready->ptr);
+    free(ready);
+    ready = next;
+  }
+}
+
+void rcu_quiescent(void) {
+  if (t_slot != -1)
+    __atomic_store_n(&g_seen[t_slot],
+                     __atomic_load_n(&g_epoch, __ATOMIC_SEQ_CST),
+                     __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&g_pending, __ATOMIC_RELAXED) > 0)
+    reclaim();
+}
+
+void rcu_retire(void *ptr, void (*free_fn)(void *)) {
+  if (!ptr)
+    return;
+  struct retired *r = malloc(sizeof(*r));
+  if (!r) {
+    // Freeing now could pull the object from under a reader; leak it
+    logger_log(LOG_WARN, "Out of memory retiring an object; leaking it");
+    return;
+  }
+  r->ptr = ptr;
+  r->free_fn = free_fn;
+  r->epoch = __atomic_add_fetch(&g_epoch, 1, __ATOMIC_SEQ_CST);
+
+  pthread_mutex_lock(&g_lock);
+  r->next = g_retired;
+  g_retired = r;
+  __atomic_add_fetch(&g_pending, 1, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&g_lock);
+
+  // Frees right away when there are no readers
+  reclaim();
+}
@@ -1,17 +1,30 @@
 #include "../include/server.h"
 #include "../include/config.h"
 #include "../include/error_pages.h"
+#include "../include/export.h"
 #include "../include/http.h"
 #include "../include/logger.h"
+#include "../include/mime.h"
+#include "../include/negcache.h"
+#include "../include/pack.h"
+#include "../include/page_cache.h"
 #include "../include/post.h"
+#include "../include/post_index.h"
+#include "../include/rcu.h"
 #include "../include/security.h"
+#include "../include/snapshot.h"
 #include "../include/stats.h"
 #include "../include/template.h"
+#include "../include/vfs.h"
+#include "../include/warm.h"
+#include "../include/zerocopy.h"
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,9 +34,11 @@
 
 // about page now uses templates/about.html exclusively
 
-static void handle_about_page(int client_fd, struct server_config *config);
+static void handle_about_page(int client_fd, struct server_config *config,
+                              const char *if_none_match);
 
-static volatile int keep_running = 1;
+static volatile sig_atomic_t keep_running = 1;
+static volatile sig_atomic_t stop_signal = 0;
 
 static int parse_page_param(const char *query) {
   if (!query || *query == '\0') {
@@ -57,20 +72,22 @@ static int parse_page_param(const char *query) {
   return 1;
 }
 
-void serve_static_file(int client_fd, const char *filepath) {
-  int fd = open(filepath, O_RDONLY);
-  if (fd == -1) {
+// Returns -1 (after sending a 404) if the file does not exist.
+static int serve_static_file(int client_fd, const char *filepath) {
+  struct vfs_file file;
+  if (vfs_open(filepath, &file) != 0) {
     logger_log(LOG_INFO, "File not found: %s", filepath);
-    send_error_page(client_fd, 404, "File not found");
-    return;
+    negcache_send_404(client_fd);
+    return -1;
   }
 
-  struct stat file_stat;
-  if (fstat(fd, &file_stat) != 0) {
-    logger_log(LOG_ERROR, "Failed to get file stats: %s", filepath);
-    close(fd);
-    send_error_page(client_fd, 500, "Internal Server Error");
-    return;
+  const struct mime_type *mime = mime_lookup(filepath);
+  char cache_control[64];
+  if (mime->max_age > 0) {
+    snprintf(cache_control, sizeof(cache_control),
+             "Cache-Control: public, max-age=%d\r\n", mime->max_age);
+  } else {
+    strcpy(cache_control, "Cache-Control: no-cache\r\n");
   }
 
   // Send headers
@@ -78,38 +95,48 @@ void serve_static_file(int client_fd, const char *filepath) {
   snprintf(headers, sizeof(headers),
            "HTTP/1.1 200 OK\r\n"
            "Content-Type: %s\r\n"
-           "Content-Length: %lld\r\n"
+           "Content-Length: %zu\r\n"
+           "%s"
            "Connection: close\r\n"
            "\r\n",
-           get_content_type(filepath), (long long)file_stat.st_size);
+           mime->content_type, file.len, cache_control);
 
   write(client_fd, headers, strlen(headers));
 
+  // Embedded files live for the whole process, so they can be sent
+  // zero-copy without pinning anything
+  if (!file.owned) {
+    zerocopy_send(client_fd, file.data, file.len, NULL, NULL);
+    return 0;
+  }
+
   // Send file content
-  char file_buffer[8192];
-  ssize_t bytes_read;
-  while ((bytes_read = read(fd, file_buffer, sizeof(file_buffer))) > 0) {
-    write(client_fd, file_buffer, bytes_read);
+  size_t sent = 0;
+  while (sent < file.len) {
+    ssize_t n = write(client_fd, file.data + sent, file.len - sent);
+    if (n <= 0) {
+      break;
+    }
+    sent += (size_t)n;
   }
 
-  close(fd);
+  vfs_close(&file);
+  return 0;
 }
 
+// Only records the signal; the accept loop logs and shuts down.
 void handle_signal(int signal) {
-  logger_log(LOG_INFO, "Received signal %d, shutting down...", signal);
+  stop_signal = signal;
   keep_running = 0;
 }
 void handle_health_check(int client_fd) {
-  const char *response = "HTTP/1.1 200 OK\r\n"
-                         "Content-Type: text/plain\r\n"
-                         "Content-Length: 2\r\n"
-                         "Connection: close\r\n"
-                         "\r\n"
-                         "OK";
-
-  write(client_fd, response, strlen(response));
+  send_canned(client_fd, CANNED_HEALTH_OK);
   logger_log(LOG_DEBUG, "Health check request handled");
 }
+// Ready for traffic once the page cache is warm (see warm.h).
+static void handle_readiness_check(int client_fd) {
+  send_canned(client_fd, warm_done() ? CANNED_HEALTH_OK : CANNED_NOT_READY);
+}
 #define BUFFER_SIZE 8192
 void handle_stats_request(int client_fd) {
   struct system_stats stats = get_system_stats();
@@ -147,7 +174,7 @@ void handle_client(int client_fd, struct server_config *config) {
     // Only check size limit for headers
     if (bytes_read >= BUFFER_SIZE - 1) {
       logger_log(LOG_WARN, "Request headers too large");
-      send_error_page(client_fd, 413, "Request headers too large");
+      send_canned(client_fd, CANNED_HEADERS_TOO_LARGE);
       return;
     }
   }
@@ -162,7 +189,7 @@ void handle_client(int client_fd, struct server_config *config) {
   if (!parse_http_request(buffer, &req)) {
     logger_log(LOG_WARN, "Malformed request: %.*s",
                (int)strcspn(buffer, "\r\n"), buffer);
-    send_error_page(client_fd, 400, "Malformed request");
+    send_canned(client_fd, CANNED_MALFORMED_REQUEST);
     return;
   }
 
@@ -194,25 +221,36 @@ void handle_client(int client_fd, struct server_config *config) {
     path_only[sizeof(path_only) - 1] = '\0';
   }
 
+  canned_refresh();
+  negcache_refresh(config);
+
   // Route handling
   if (strcmp(path_only, "/health") == 0) {
     handle_health_check(client_fd);
+  } else if (strcmp(path_only, "/health/ready") == 0) {
+    handle_readiness_check(client_fd);
   } else if (strcmp(path_only, "/") == 0) {
-    handle_index_page(client_fd, config);
+    handle_index_page(client_fd, config, req.if_none_match);
   } else if (strcmp(path_only, "/blog") == 0) {
     int page = parse_page_param(query);
-    handle_blog_page(client_fd, config, page);
+    handle_blog_page(client_fd, config, page, req.if_none_match);
   } else if (strcmp(path_only, "/api/stats") == 0) { // Add this condition
     handle_stats_request(client_fd);
   } else if (strcmp(path_only, "/about") == 0) {
-    handle_about_page(client_fd, config);
+    handle_about_page(client_fd, config, req.if_none_match);
+  } else if (negcache_is_miss(path_only)) {
+    // Known-missing path: no sanitizing, filesystem access or formatting
+    negcache_send_404(client_fd);
   } else if (strncmp(path_only, "/post/", 6) == 0) {
     char *clean_path = sanitize_path(path_only + 6);
     if (clean_path && is_path_safe(clean_path)) {
-      handle_markdown_post(client_fd, clean_path, config);
+      if (handle_markdown_post(client_fd, clean_path, req.version,
+                               req.if_none_match, config) != 0) {
+        negcache_remember_miss(path_only);
+      }
       free(clean_path);
     } else {
-      send_error_page(client_fd, 400, "Invalid path");
+      send_canned(client_fd, CANNED_INVALID_PATH);
     }
   } else {
     // Handle static files
@@ -221,36 +259,55 @@ void handle_client(int client_fd, struct server_config *config) {
       char filepath[512];
       snprintf(filepath, sizeof(filepath), "%s%s", config->static_dir,
                clean_path);
-      serve_static_file(client_fd, filepath);
+      if (serve_static_file(client_fd, filepath) != 0) {
+        negcache_remember_miss(path_only);
+      }
       free(clean_path);
     } else {
-      send_error_page(client_fd, 400, "Invalid path");
+      send_canned(client_fd, CANNED_INVALID_PATH);
     }
   }
 }
 
-static void handle_about_page(int client_fd, struct server_config *config) {
-  char *rendered = NULL;
+struct page_entry *render_about_page(struct server_config *config,
+                                     enum canned_response *error) {
+  struct page_entry *cached = page_cache_get("about");
+  if (cached) {
+    return cached;
+  }
+
   char path[512];
   snprintf(path, sizeof(path), "%s/about.html", config->templates_dir);
+  struct page_deps deps;
+  page_deps_init(&deps);
+  page_deps_source(&deps, path);
+
+  char *rendered = NULL;
   if (render_template_file(path, NULL, 0, &rendered) != 0 || !rendered) {
-    send_error_page(client_fd, 500, "Failed to render about page");
-    return;
+    page_deps_free(&deps);
+    *error = CANNED_ABOUT_FAILED;
+    return NULL;
   }
 
-  size_t body_length = strlen(rendered);
-  char headers[256];
-  snprintf(headers, sizeof(headers),
-           "HTTP/1.1 200 OK\r\n"
-           "Content-Type: text/html\r\n"
-           "Content-Length: %zu\r\n"
-           "Connection: close\r\n"
-           "\r\n",
-           body_length);
-
-  write(client_fd, headers, strlen(headers));
-  write(client_fd, rendered, body_length);
+  struct page_entry *entry =
+      page_cache_put("about", mime_html(), rendered, strlen(rendered), &deps);
+  page_deps_free(&deps);
   free_rendered_template(rendered);
+  if (!entry) {
+    *error = CANNED_ABOUT_FAILED;
+  }
+  return entry;
+}
+
+static void handle_about_page(int client_fd, struct server_config *config,
+                              const char *if_none_match) {
+  enum canned_response error = CANNED_ABOUT_FAILED;
+  struct page_entry *entry = render_about_page(config, &error);
+  if (entry) {
+    page_cache_send(client_fd, entry, if_none_match);
+  } else {
+    send_canned(client_fd, error);
+  }
 }
 
 // In start_server function in server.c
@@ -295,7 +352,42 @@ int start_server(struct server_config *config) {
 
   logger_log(LOG_INFO, "Server is ready to accept connections");
 
-  while (1) {
+  // This thread reads the post index; between requests it holds nothing
+  rcu_register_thread();
+  while (keep_running) {
+    rcu_quiescent();
+
+    // Wake up periodically while zero-copy sends await completion, and
+    // for the next snapshot
+    int timeout = zerocopy_reap();
+    int snapshot_ms = snapshot_timeout();
+    if (snapshot_ms >= 0 && (timeout < 0 || snapshot_ms < timeout)) {
+      timeout = snapshot_ms;
+    }
+    if (!warm_done()) {
+      timeout = 0; // keep warming between requests
+    }
+
+    // Negative descriptors are ignored by poll()
+    struct pollfd pfds[3] = {{server_fd, POLLIN, 0},
+                             {post_index_watch_fd(), POLLIN, 0},
+                             {post_index_rebuild_fd(), POLLIN, 0}};
+    int ready = poll(pfds, 3, timeout);
+    snapshot_tick();
+    warm_step();
+    if (ready <= 0) {
+      continue;
+    }
+
+    if ((pfds[1].revents | pfds[2].revents) & POLLIN) {
+      if (post_index_process_events() > 0) {
+        negcache_invalidate();
+      }
+    }
+    if (!(pfds[0].revents & POLLIN)) {
+      continue;
+    }
+
     struct sockaddr_in client_addr;
     socklen_t addr_len = sizeof(client_addr);
 
@@ -311,14 +403,45 @@ int start_server(struct server_config *config) {
     logger_log(LOG_INFO, "New connection from %s", client_ip);
 
     handle_client(client_fd, config);
-    close(client_fd);
+    zerocopy_close(client_fd);
   }
 
+  logger_log(LOG_INFO, "Received signal %d, shutting down...",
+             (int)stop_signal);
   close(server_fd);
+  snapshot_save();
   return EXIT_SUCCESS;
 }
 
-int main() {
+static void usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [--export <dir>] [--pack <file> [--pack-html]]\n",
+          argv0);
+}
+
+int main(int argc, char **argv) {
+  // --export <dir>: write the rendered site to <dir> and exit
+  // --pack <file>: compile blog_dir into a post pack and exit
+  const char *export_dir = NULL;
+  const char *pack_file = NULL;
+  int pack_html = 0;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+      export_dir = argv[++i];
+    } else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc) {
+      pack_file = argv[++i];
+    } else if (strcmp(argv[i], "--pack-html") == 0) {
+      pack_html = 1;
+    } else {
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (vfs_init() != 0) {
+    logger_log(LOG_ERROR, "Failed to load embedded site image");
+    return EXIT_FAILURE;
+  }
+
   struct server_config config = load_config("config.json");
   logger_init(NULL);
 
@@ -328,17 +451,54 @@ int main() {
   logger_log(LOG_INFO, "  Static Dir: %s", config.static_dir);
   logger_log(LOG_INFO, "  Blog Dir: %s", config.blog_dir);
 
+  vfs_set_disk_override(config.embed_override);
+
   // Verify directories exist
-  struct stat st;
-  if (stat(config.static_dir, &st) != 0) {
+  if (!vfs_dir_exists(config.static_dir)) {
     logger_log(LOG_ERROR, "Static directory does not exist: %s",
                config.static_dir);
     return EXIT_FAILURE;
   }
-  if (stat(config.blog_dir, &st) != 0) {
+  // Packing reads blog_dir; serving a pack does not need it
+  int use_pack = config.post_pack[0] && !pack_file;
+  if (!use_pack && !vfs_dir_exists(config.blog_dir)) {
     logger_log(LOG_ERROR, "Blog directory does not exist: %s", config.blog_dir);
     return EXIT_FAILURE;
   }
+  if (use_pack && pack_init(config.post_pack) != 0) {
+    return EXIT_FAILURE;
+  }
+
+  int serving = !export_dir && !pack_file;
+  zerocopy_init(config.zerocopy_threshold);
+  // Exported pages are written once; there is nothing to keep them for
+  page_cache_init(serving ? config.page_cache_mb * 1024 * 1024 : 0);
+  canned_init(config.templates_dir);
+  if (serving && config.snapshot_path[0]) {
+    snapshot_init(config.snapshot_path, config.snapshot_interval);
+  }
+  if (post_index_init(config.blog_dir) != 0) {
+    logger_log(LOG_ERROR, "Failed to build post index");
+    return EXIT_FAILURE;
+  }
+  if (pack_file) {
+    return pack_write(&config, pack_file, pack_html) == 0 ? EXIT_SUCCESS
+                                                          : EXIT_FAILURE;
+  }
+  if (export_dir) {
+    return export_site(&config, export_dir) == 0 ? EXIT_SUCCESS
+                                                 : EXIT_FAILURE;
+  }
+  negcache_rebuild(&config);
+  warm_init(&config);
+
+  // No SA_RESTART: poll() must return so the loop sees keep_running
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = handle_signal;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
 
   logger_log(LOG_INFO, "Directories verified, starting server...");
   return start_server(&config);
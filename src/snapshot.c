@@ -0,0 +1,829 @@
+// src/snapshot.c
+#include "../include/snapshot.h"
+#include "../include/logger.h"
+#include "../include/lz.h"
+#include "../include/mime.h"
+#include "../include/page_cache.h"
+#include "../include/post.h"
+#include "../include/post_index.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// File layout (native byte order, checked through `endian`):
+//
+//   header | posts | pages | bodies | tags | strings | body data
+//
+// The checksum covers everything from posts to the end of strings. Body
+// data is deduplicated by content hash, and each body is verified against
+// its hash when it is restored.
+#define SNAPSHOT_MAGIC "BLOGSNAP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ENDIAN 0x01020304u
+#define SAVER_POLL_MS 100 // while a background save runs
+
+struct snap_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t endian;
+  uint64_t file_size;
+  uint64_t checksum;
+  uint64_t meta_end; // end of the checksummed region
+  uint32_t post_count, page_count, body_count, tag_count;
+  uint64_t posts_off, pages_off, bodies_off, tags_off, strings_off;
+};
+
+struct snap_str {
+  uint32_t off, len; // into the strings region
+};
+
+struct snap_post { // sorted by slug
+  struct snap_str slug, title, date, preview;
+  uint64_t ino;
+  int64_t mtime;
+  uint64_t size;
+};
+
+struct snap_source {
+  struct snap_str path;
+  uint64_t ino;
+  int64_t mtime;
+  uint64_t size;
+};
+
+struct snap_page { // sorted by key
+  struct snap_str key, content_type;
+  struct snap_source sources[PAGE_CACHE_MAX_SOURCES];
+  uint32_t source_count;
+  uint32_t body;
+  uint32_t tags_first, tag_count;
+  uint64_t index_fingerprint; // listing pages: index they were built from
+};
+
+struct snap_body {
+  uint64_t hash; // fnv1a of the raw body
+  uint64_t off;  // absolute file offset
+  uint64_t stored_len, raw_len; // equal when stored uncompressed
+};
+
+static char g_path[512];
+static int g_interval = 0;
+static time_t g_next_save = 0;
+
+// The mapped snapshot from startup
+static const unsigned char *g_map = NULL;
+static size_t g_map_len = 0;
+static const struct snap_header *g_hdr = NULL;
+static unsigned char *g_page_used = NULL; // restored or rejected
+
+static uint64_t fnv1a(const void *data, size_t len) {
+  const unsigned char *p = data;
+  uint64_t h = 1469598103934665603ULL;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static const struct snap_post *snap_posts(void) {
+  return (const struct snap_post *)(g_map + g_hdr->posts_off);
+}
+
+static const struct snap_page *snap_pages(void) {
+  return (const struct snap_page *)(g_map + g_hdr->pages_off);
+}
+
+static const struct snap_body *snap_bodies(void) {
+  return (const struct snap_body *)(g_map + g_hdr->bodies_off);
+}
+
+static const uint64_t *snap_tags(void) {
+  return (const uint64_t *)(g_map + g_hdr->tags_off);
+}
+
+// Strings are stored NUL-terminated; `len` excludes the terminator.
+static const char *snap_str(struct snap_str s) {
+  if ((uint64_t)s.off + s.len >= g_hdr->meta_end - g_hdr->strings_off)
+    return "";
+  return (const char *)g_map + g_hdr->strings_off + s.off;
+}
+
+static int region_ok(uint64_t off, uint64_t count, size_t size,
+                     uint64_t end) {
+  return off % 8 == 0 && off <= end && count <= (end - off) / size;
+}
+
+static int validate(const unsigned char *map, size_t len) {
+  const struct snap_header *h = (const struct snap_header *)map;
+  if (len < sizeof(*h) || memcmp(h->magic, SNAPSHOT_MAGIC, 8) != 0 ||
+      h->version != SNAPSHOT_VERSION || h->endian != SNAPSHOT_ENDIAN ||
+      h->file_size != len || h->meta_end > len || h->meta_end < sizeof(*h))
+    return -1;
+  if (!region_ok(h->posts_off, h->post_count, sizeof(struct snap_post),
+                 h->meta_end) ||
+      !region_ok(h->pages_off, h->page_count, sizeof(struct snap_page),
+                 h->meta_end) ||
+      !region_ok(h->bodies_off, h->body_count, sizeof(struct snap_body),
+                 h->meta_end) ||
+      !region_ok(h->tags_off, h->tag_count, sizeof(uint64_t), h->meta_end) ||
+      h->strings_off > h->meta_end)
+    return -1;
+  if (fnv1a(map + sizeof(*h), h->meta_end - sizeof(*h)) != h->checksum)
+    return -1;
+  return 0;
+}
+
+static int compare_str(const char *s, struct snap_str ref) {
+  return strcmp(s, snap_str(ref));
+}
+
+static int identity_matches(const struct vfs_identity *id, uint64_t ino,
+                            int64_t mtime, uint64_t size) {
+  return id->ino == ino && (int64_t)id->mtime == mtime && id->size == size;
+}
+
+// post_hint_fn: reuses the recorded frontmatter of an unchanged post.
+static int post_hint(const char *slug, const struct vfs_identity *id,
+                     struct post_frontmatter *out) {
+  size_t lo = 0, hi = g_hdr->post_count;
+  const struct snap_post *posts = snap_posts();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int c = compare_str(slug, posts[mid].slug);
+    if (c == 0) {
+      const struct snap_post *p = &posts[mid];
+      if (!identity_matches(id, p->ino, p->mtime, p->size))
+        return 0;
+      out->title = (struct post_field){snap_str(p->title), p->title.len};
+      out->date = (struct post_field){snap_str(p->date), p->date.len};
+      out->preview = (struct post_field){snap_str(p->preview), p->preview.len};
+      return 1;
+    }
+    if (c < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return 0;
+}
+
+static long find_page(const char *key) {
+  size_t lo = 0, hi = g_hdr->page_count;
+  const struct snap_page *pages = snap_pages();
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int c = compare_str(key, pages[mid].key);
+    if (c == 0)
+      return (long)mid;
+    if (c < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return -1;
+}
+
+// Decompresses and verifies a body. Returns a malloc'd copy or NULL.
+static char *load_body(const struct snap_body *b) {
+  if (b->off > g_map_len || b->stored_len > g_map_len - b->off)
+    return NULL;
+  char *raw = malloc(b->raw_len + 1);
+  if (!raw)
+    return NULL;
+
+  const unsigned char *src = g_map + b->off;
+  int ok = b->stored_len == b->raw_len
+               ? (memcpy(raw, src, b->raw_len), 1)
+               : lz_decompress(src, b->stored_len, (unsigned char *)raw,
+                               b->raw_len) == 0;
+  if (!ok || fnv1a(raw, b->raw_len) != b->hash) {
+    free(raw);
+    return NULL;
+  }
+  return raw;
+}
+
+// Still valid if every source file is unchanged and, for pages built from
+// the post index, the index lists the same posts with the same metadata.
+static int page_fresh(const struct snap_page *page) {
+  if (page->index_fingerprint) {
+    struct blog_index *index = post_index_acquire();
+    int same = index && index->fingerprint == page->index_fingerprint;
+    post_index_release(index);
+    if (!same)
+      return 0;
+  }
+
+  for (uint32_t i = 0; i < page->source_count; i++) {
+    const struct snap_source *s = &page->sources[i];
+    struct vfs_identity id;
+    if (vfs_identity(snap_str(s->path), &id) != 0 ||
+        !identity_matches(&id, s->ino, s->mtime, s->size))
+      return 0;
+  }
+  return 1;
+}
+
+// page_loader_fn: restores a page on its first request after startup.
+static struct page_entry *restore_page(const char *key) {
+  long i = find_page(key);
+  if (i < 0 || g_page_used[i])
+    return NULL;
+  g_page_used[i] = 1; // one attempt; the live cache takes over from here
+
+  const struct snap_page *page = &snap_pages()[i];
+  if (page->body >= g_hdr->body_count || page->source_count >
+      PAGE_CACHE_MAX_SOURCES || page->tags_first > g_hdr->tag_count ||
+      page->tag_count > g_hdr->tag_count - page->tags_first || !page_fresh(page))
+    return NULL;
+
+  const struct snap_body *b = &snap_bodies()[page->body];
+  char *body = load_body(b);
+  if (!body) {
+    logger_log(LOG_WARN, "Snapshot body for %s is corrupt", key);
+    return NULL;
+  }
+
+  struct page_deps deps;
+  page_deps_init(&deps);
+  for (uint32_t s = 0; s < page->source_count; s++) {
+    struct page_source *src = &deps.sources[deps.source_count++];
+    snprintf(src->path, sizeof(src->path), "%s",
+             snap_str(page->sources[s].path));
+    src->id.ino = page->sources[s].ino;
+    src->id.mtime = (time_t)page->sources[s].mtime;
+    src->id.size = page->sources[s].size;
+  }
+  if (page->tag_count) {
+    deps.tags = malloc(page->tag_count * sizeof(uint64_t));
+    if (deps.tags) {
+      memcpy(deps.tags, snap_tags() + page->tags_first,
+             page->tag_count * sizeof(uint64_t));
+      deps.tag_count = deps.tag_cap = page->tag_count;
+    } else {
+      deps.failed = 1;
+    }
+  }
+
+  struct page_entry *entry =
+      page_cache_put(key, snap_str(page->content_type), body, b->raw_len, &deps);
+  page_deps_free(&deps);
+  free(body);
+  if (entry)
+    logger_log(LOG_DEBUG, "Restored %s from snapshot", key);
+  return entry;
+}
+
+void snapshot_init(const char *path, int interval) {
+  snprintf(g_path, sizeof(g_path), "%s", path);
+  g_interval = interval;
+  g_next_save = interval > 0 ? time(NULL) + interval : 0;
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1)
+    return;
+
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return;
+
+  if (validate(map, (size_t)st.st_size) != 0) {
+    logger_log(LOG_WARN, "Ignoring invalid snapshot %s", path);
+    munmap(map, (size_t)st.st_size);
+    return;
+  }
+
+  g_map = map;
+  g_map_len = (size_t)st.st_size;
+  g_hdr = map;
+  g_page_used = calloc(g_hdr->page_count ? g_hdr->page_count : 1, 1);
+  if (!g_page_used) {
+    munmap(map, g_map_len);
+    g_map = NULL;
+    g_hdr = NULL;
+    return;
+  }
+
+  post_index_set_hint(post_hint);
+  page_cache_set_loader(restore_page);
+  logger_log(LOG_INFO, "Snapshot %s: %u posts, %u pages", path,
+             g_hdr->post_count, g_hdr->page_count);
+}
+
+// Growable byte buffer; appends return the offset written at.
+struct buf {
+  unsigned char *data;
+  size_t len, cap;
+};
+
+static int buf_reserve(struct buf *b, size_t extra) {
+  if (b->len + extra <= b->cap)
+    return 0;
+  size_t cap = b->cap ? b->cap : 4096;
+  while (cap < b->len + extra)
+    cap *= 2;
+  unsigned char *data = realloc(b->data, cap);
+  if (!data)
+    return -1;
+  b->data = data;
+  b->cap = cap;
+  return 0;
+}
+
+static int buf_append(struct buf *b, const void *data, size_t len,
+                      size_t *off) {
+  if (buf_reserve(b, len) != 0)
+    return -1;
+  if (off)
+    *off = b->len;
+  memcpy(b->data + b->len, data, len);
+  b->len += len;
+  return 0;
+}
+
+static struct snap_str add_str(struct buf *strings, const char *s, int *err) {
+  size_t len = strlen(s), off = 0;
+  if (buf_append(strings, s, len + 1, &off) != 0 || off > UINT32_MAX)
+    *err = 1;
+  return (struct snap_str){(uint32_t)off, (uint32_t)len};
+}
+
+// A page to be written: from the live cache or carried over unrestored
+// from the mapped snapshot.
+struct save_page {
+  const char *key;
+  struct page_entry *entry;      // live page, reference held
+  const struct snap_page *old;   // or a snapshot page not yet requested
+};
+
+struct save_state {
+  struct save_page *pages;
+  size_t count, cap;
+  uint64_t index_fingerprint;
+  int err;
+};
+
+static void collect_entry(struct page_entry *entry, void *arg) {
+  struct save_state *st = arg;
+  if (st->count == st->cap) {
+    size_t cap = st->cap ? st->cap * 2 : 256;
+    struct save_page *pages = realloc(st->pages, cap * sizeof(*pages));
+    if (!pages) {
+      st->err = 1;
+      return;
+    }
+    st->pages = pages;
+    st->cap = cap;
+  }
+  entry->refcount++;
+  st->pages[st->count++] = (struct save_page){entry->key, entry, NULL};
+}
+
+static int compare_save_pages(const void *a, const void *b) {
+  return strcmp(((const struct save_page *)a)->key,
+                ((const struct save_page *)b)->key);
+}
+
+static int compare_post_slugs(const void *a, const void *b) {
+  return strcmp((*(const struct blog_post *const *)a)->filename,
+                (*(const struct blog_post *const *)b)->filename);
+}
+
+// Content-Type of a cached response, from its header block.
+static void entry_content_type(const struct page_entry *e, char *out,
+                               size_t size) {
+  snprintf(out, size, "%s", mime_html());
+  const char *end = e->data + e->header_len;
+  for (const char *p = e->data; p + 14 < end; p++) {
+    if (memcmp(p, "Content-Type: ", 14) == 0) {
+      p += 14;
+      size_t len = 0;
+      while (p + len < end && p[len] != '\r')
+        len++;
+      snprintf(out, size, "%.*s", (int)len, p);
+      return;
+    }
+  }
+}
+
+// Body table entry for the given content, deduplicated by hash.
+struct body_set {
+  uint64_t *hashes; // slot -> hash (0 = empty)
+  uint32_t *ids;
+  size_t slots;
+};
+
+static int write_all(int fd, const void *data, size_t len) {
+  const unsigned char *p = data;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= (size_t)n;
+  }
+  return 0;
+}
+
+static size_t align8(struct buf *b) {
+  static const unsigned char zeros[8];
+  size_t pad = (8 - b->len % 8) % 8;
+  buf_append(b, zeros, pad, NULL);
+  return b->len;
+}
+
+static uint64_t mix(uint64_t h, uint64_t v) {
+  return (h ^ v) * 1099511628211ULL;
+}
+
+// What a page contributes to the fingerprint of a save: everything of it
+// that ends up in the file, bar the compressed body.
+static uint64_t page_fingerprint(const struct save_page *sp) {
+  uint64_t h = fnv1a(sp->key, strlen(sp->key));
+  if (!sp->entry)
+    return mix(h, snap_bodies()[sp->old->body].hash);
+
+  const struct page_entry *e = sp->entry;
+  h = mix(h, fnv1a(e->etag, strlen(e->etag)));
+  h = mix(h, fnv1a(e->data, e->header_len));
+  for (int s = 0; s < e->source_count; s++) {
+    h = mix(h, fnv1a(e->sources[s].path, strlen(e->sources[s].path)));
+    h = mix(h, e->sources[s].id.ino);
+    h = mix(h, (uint64_t)e->sources[s].id.mtime);
+    h = mix(h, e->sources[s].id.size);
+  }
+  for (size_t t = 0; t < e->tag_count; t++)
+    h = mix(h, e->tags[t]);
+  return h;
+}
+
+// A save, collected on the main thread and written out, possibly on the
+// saver thread. It holds references to the live pages but nothing of the
+// post index, whose records are copied in.
+struct save_job {
+  struct save_state st;
+  struct buf meta, strings; // post records written so far
+  struct snap_header hdr;
+  uint64_t fingerprint;     // of everything collected
+  int rc;
+};
+
+// Background save: the thread sets `done` when the file is written, and
+// the main thread joins it on its next tick.
+static struct {
+  pthread_t thread;
+  int running;
+  int done;
+  struct save_job *job;
+} g_saver;
+static uint64_t g_saved_fingerprint = 0; // of the last snapshot written
+
+static void free_job(struct save_job *job) {
+  for (size_t i = 0; i < job->st.count; i++) {
+    if (job->st.pages[i].entry)
+      page_cache_release(job->st.pages[i].entry);
+  }
+  free(job->st.pages);
+  free(job->meta.data);
+  free(job->strings.data);
+  free(job);
+}
+
+// Gathers the pages and post records to save. Cheap next to writing them:
+// no body is compressed here. Returns NULL if out of memory.
+static struct save_job *collect_save(void) {
+  struct save_job *job = calloc(1, sizeof(*job));
+  if (!job)
+    return NULL;
+  struct save_state *st = &job->st;
+
+  struct blog_index *index = post_index_acquire();
+  st->index_fingerprint = index ? index->fingerprint : 0;
+  page_cache_foreach(collect_entry, st);
+  size_t live = st->count;
+  qsort(st->pages, live, sizeof(*st->pages), compare_save_pages);
+
+  // Snapshot pages nobody asked for yet are still worth keeping
+  for (uint32_t i = 0; g_hdr && !st->err && i < g_hdr->page_count; i++) {
+    const struct snap_page *old = &snap_pages()[i];
+    struct save_page probe = {snap_str(old->key), NULL, NULL};
+    if (g_page_used[i] || old->body >= g_hdr->body_count ||
+        (old->index_fingerprint &&
+         old->index_fingerprint != st->index_fingerprint) ||
+        (live && bsearch(&probe, st->pages, live, sizeof(probe),
+                         compare_save_pages)))
+      continue;
+    if (st->count == st->cap) {
+      size_t cap = st->cap ? st->cap * 2 : 256;
+      struct save_page *pages = realloc(st->pages, cap * sizeof(*pages));
+      if (!pages) {
+        st->err = 1;
+        break;
+      }
+      st->pages = pages;
+      st->cap = cap;
+    }
+    st->pages[st->count++] = (struct save_page){probe.key, NULL, old};
+  }
+  qsort(st->pages, st->count, sizeof(*st->pages), compare_save_pages);
+
+  struct snap_header *hdr = &job->hdr;
+  memcpy(hdr->magic, SNAPSHOT_MAGIC, 8);
+  hdr->version = SNAPSHOT_VERSION;
+  hdr->endian = SNAPSHOT_ENDIAN;
+
+  // Posts, sorted by slug for lookup
+  int post_count = index ? index->post_count : 0;
+  const struct blog_post **by_slug =
+      calloc(post_count ? (size_t)post_count : 1, sizeof(*by_slug));
+  st->err |= !by_slug;
+  for (int i = 0; by_slug && i < post_count; i++)
+    by_slug[i] = &index->posts[i];
+  if (by_slug)
+    qsort(by_slug, (size_t)post_count, sizeof(*by_slug), compare_post_slugs);
+
+  hdr->posts_off = sizeof(*hdr);
+  for (int i = 0; !st->err && i < post_count; i++) {
+    const struct blog_post *p = by_slug[i];
+    struct snap_post rec = {add_str(&job->strings, p->filename, &st->err),
+                            add_str(&job->strings, p->title, &st->err),
+                            add_str(&job->strings, p->date, &st->err),
+                            add_str(&job->strings, p->preview, &st->err),
+                            p->id.ino, (int64_t)p->id.mtime, p->id.size};
+    st->err |= buf_append(&job->meta, &rec, sizeof(rec), NULL);
+  }
+  hdr->post_count = (uint32_t)post_count;
+  free(by_slug);
+  post_index_release(index);
+
+  uint64_t h = mix(fnv1a(job->meta.data, job->meta.len),
+                   fnv1a(job->strings.data, job->strings.len));
+  h = mix(h, st->index_fingerprint);
+  for (size_t i = 0; i < st->count; i++)
+    h = mix(h, page_fingerprint(&st->pages[i]));
+  job->fingerprint = h;
+
+  if (st->err) {
+    free_job(job);
+    return NULL;
+  }
+  return job;
+}
+
+// Writes the snapshot file: compresses the page bodies and renames the
+// result into place. Touches only the job and the mapped snapshot, so it
+// runs on the saver thread. Sets job->rc to 0 on success.
+static void write_job(struct save_job *job) {
+  struct save_state st = job->st;
+  struct snap_header hdr = job->hdr;
+  struct buf meta = job->meta, strings = job->strings, data = {0};
+
+  // Pages, with bodies deduplicated by content hash
+  struct buf bodies = {0}, tags = {0};
+  struct body_set set = {NULL, NULL, 64};
+  while (set.slots < st.count * 2)
+    set.slots *= 2;
+  set.hashes = calloc(set.slots, sizeof(*set.hashes));
+  set.ids = calloc(set.slots, sizeof(*set.ids));
+  st.err |= !set.hashes || !set.ids;
+
+  hdr.pages_off = hdr.posts_off + meta.len;
+  for (size_t i = 0; !st.err && i < st.count; i++) {
+    struct save_page *sp = &st.pages[i];
+    struct snap_page rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.key = add_str(&strings, sp->key, &st.err);
+
+    const char *body = NULL;
+    size_t raw_len;
+    uint64_t hash;
+    if (sp->entry) {
+      struct page_entry *e = sp->entry;
+      char content_type[128];
+      entry_content_type(e, content_type, sizeof(content_type));
+      rec.content_type = add_str(&strings, content_type, &st.err);
+      for (int s = 0; s < e->source_count; s++) {
+        rec.sources[s] = (struct snap_source){
+            add_str(&strings, e->sources[s].path, &st.err),
+            e->sources[s].id.ino, (int64_t)e->sources[s].id.mtime,
+            e->sources[s].id.size};
+      }
+      rec.source_count = (uint32_t)e->source_count;
+      rec.tags_first = (uint32_t)(tags.len / sizeof(uint64_t));
+      rec.tag_count = (uint32_t)e->tag_count;
+      st.err |= buf_append(&tags, e->tags, e->tag_count * sizeof(uint64_t),
+                           NULL);
+      if (page_entry_has_tag(e, "index", ""))
+        rec.index_fingerprint = st.index_fingerprint;
+      body = e->data + e->header_len;
+      raw_len = e->len - e->header_len;
+      hash = fnv1a(body, raw_len);
+    } else {
+      const struct snap_page *old = sp->old;
+      rec = *old;
+      rec.key = add_str(&strings, sp->key, &st.err);
+      rec.content_type = add_str(&strings, snap_str(old->content_type),
+                                 &st.err);
+      for (uint32_t s = 0; s < old->source_count && s < PAGE_CACHE_MAX_SOURCES;
+           s++)
+        rec.sources[s].path =
+            add_str(&strings, snap_str(old->sources[s].path), &st.err);
+      rec.tags_first = (uint32_t)(tags.len / sizeof(uint64_t));
+      if (old->tags_first <= g_hdr->tag_count &&
+          old->tag_count <= g_hdr->tag_count - old->tags_first)
+        st.err |= buf_append(&tags, snap_tags() + old->tags_first,
+                             old->tag_count * sizeof(uint64_t), NULL);
+      else
+        rec.tag_count = 0;
+      const struct snap_body *ob = &snap_bodies()[old->body];
+      raw_len = ob->raw_len;
+      hash = ob->hash;
+    }
+
+    // Reuse an identical body, else compress and append a new one
+    uint64_t set_key = hash ? hash : 1; // 0 marks an empty slot
+    size_t slot = set_key & (set.slots - 1);
+    while (set.hashes[slot] && set.hashes[slot] != set_key)
+      slot = (slot + 1) & (set.slots - 1);
+    if (!set.hashes[slot]) {
+      struct snap_body b = {hash, data.len, 0, raw_len};
+      if (body) {
+        if (buf_reserve(&data, lz_bound(raw_len)) == 0) {
+          b.stored_len = lz_compress((const unsigned char *)body, raw_len,
+                                     data.data + data.len);
+          if (b.stored_len >= raw_len) {
+            memcpy(data.data + data.len, body, raw_len);
+            b.stored_len = raw_len;
+          }
+          data.len += b.stored_len;
+        } else {
+          st.err = 1;
+        }
+      } else {
+        const struct snap_body *ob = &snap_bodies()[sp->old->body];
+        b.stored_len = ob->stored_len;
+        st.err |= buf_append(&data, g_map + ob->off, ob->stored_len, NULL);
+      }
+      set.hashes[slot] = set_key;
+      set.ids[slot] = (uint32_t)(bodies.len / sizeof(b));
+      st.err |= buf_append(&bodies, &b, sizeof(b), NULL);
+    }
+    rec.body = set.ids[slot];
+    st.err |= buf_append(&meta, &rec, sizeof(rec), NULL);
+  }
+  hdr.page_count = (uint32_t)st.count;
+  hdr.body_count = (uint32_t)(bodies.len / sizeof(struct snap_body));
+  hdr.tag_count = (uint32_t)(tags.len / sizeof(uint64_t));
+
+  // Assemble: bodies, tags and strings follow the records in `meta`
+  hdr.bodies_off = hdr.posts_off + meta.len;
+  st.err |= buf_append(&meta, bodies.data, bodies.len, NULL);
+  hdr.tags_off = hdr.posts_off + meta.len;
+  st.err |= buf_append(&meta, tags.data, tags.len, NULL);
+  hdr.strings_off = hdr.posts_off + meta.len;
+  st.err |= buf_append(&meta, strings.data, strings.len, NULL);
+  align8(&meta);
+  hdr.meta_end = hdr.posts_off + meta.len;
+  hdr.file_size = hdr.meta_end + data.len;
+
+  // Body offsets become absolute now that the metadata size is known
+  struct snap_body *table =
+      (struct snap_body *)(meta.data + (hdr.bodies_off - hdr.posts_off));
+  for (uint32_t i = 0; !st.err && i < hdr.body_count; i++)
+    table[i].off += hdr.meta_end;
+  if (!st.err)
+    hdr.checksum = fnv1a(meta.data, meta.len);
+
+  char tmp[600];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", g_path);
+  int rc = -1;
+  int fd = st.err ? -1 : open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                               0644);
+  if (fd != -1) {
+    rc = write_all(fd, &hdr, sizeof(hdr)) || write_all(fd, meta.data, meta.len) ||
+                 write_all(fd, data.data, data.len) || fsync(fd)
+             ? -1
+             : 0;
+    if (close(fd) != 0)
+      rc = -1;
+    if (rc == 0 && rename(tmp, g_path) != 0)
+      rc = -1;
+    if (rc != 0)
+      unlink(tmp);
+  }
+
+  if (rc == 0)
+    logger_log(LOG_INFO, "Snapshot saved: %u posts, %u pages, %zu bytes",
+               hdr.post_count, hdr.page_count, (size_t)hdr.file_size);
+  else
+    logger_log(LOG_ERROR, "Failed to save snapshot %s", g_path);
+
+  // The buffers may have moved; the job frees them
+  job->meta = meta;
+  job->strings = strings;
+  job->rc = rc;
+  free(set.hashes);
+  free(set.ids);
+  free(data.data);
+  free(bodies.data);
+  free(tags.data);
+}
+
+static void *saver_main(void *arg) {
+  write_job(arg);
+  __atomic_store_n(&g_saver.done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+// Reaps a background save once it is done, or waits for it if `wait`.
+static void finish_save(int wait) {
+  if (!g_saver.running ||
+      (!wait && !__atomic_load_n(&g_saver.done, __ATOMIC_ACQUIRE)))
+    return;
+  pthread_join(g_saver.thread, NULL);
+  g_saver.running = 0;
+  if (g_saver.job->rc == 0)
+    g_saved_fingerprint = g_saver.job->fingerprint;
+  free_job(g_saver.job);
+  g_saver.job = NULL;
+}
+
+// Writes `job` on this thread and frees it.
+static int save_now(struct save_job *job) {
+  write_job(job);
+  int rc = job->rc;
+  if (rc == 0)
+    g_saved_fingerprint = job->fingerprint;
+  free_job(job);
+  return rc;
+}
+
+int snapshot_save(void) {
+  if (!g_path[0])
+    return 0;
+
+  finish_save(1);
+  struct save_job *job = collect_save();
+  if (!job) {
+    logger_log(LOG_ERROR, "Failed to save snapshot %s", g_path);
+    return -1;
+  }
+  if (job->fingerprint == g_saved_fingerprint) {
+    free_job(job);
+    return 0;
+  }
+  return save_now(job);
+}
+
+
+int snapshot_timeout(void) {
+  if (!g_path[0] || g_interval <= 0)
+    return -1;
+  if (g_saver.running)
+    return SAVER_POLL_MS; // to reap it
+  time_t now = time(NULL);
+  return g_next_save > now ? (int)(g_next_save - now) * 1000 : 0;
+}
+
+void snapshot_tick(void) {
+  if (!g_path[0] || g_interval <= 0)
+    return;
+  finish_save(0);
+  if (g_saver.running || time(NULL) < g_next_save)
+    return;
+  g_next_save = time(NULL) + g_interval;
+
+  struct save_job *job = collect_save();
+  if (!job) {
+    logger_log(LOG_ERROR, "Failed to save snapshot %s", g_path);
+    return;
+  }
+  if (job->fingerprint == g_saved_fingerprint) {
+    logger_log(LOG_DEBUG, "Snapshot unchanged since the last save");
+    free_job(job);
+    return;
+  }
+
+  // Compressing and writing runs on its own thread; requests keep being
+  // served meanwhile
+  g_saver.job = job;
+  g_saver.done = 0;
+  if (pthread_create(&g_saver.thread, NULL, saver_main, job) == 0) {
+    g_saver.running = 1;
+    return;
+  }
+  g_saver.job = NULL;
+  save_now(job);
+}
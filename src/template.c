@@ -1,9 +1,9 @@
 // Minimal file-based template renderer
 #include "../include/template.h"
+#include "../include/vfs.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 #include <time.h>
 
 // Basic source cache: caches template file contents by path and mtime
@@ -12,6 +12,7 @@ struct tpl_cache_entry {
   char *data;
   size_t len;
   time_t mtime;
+  time_t checked; // last time mtime was compared against the file
   int in_use;
 };
 
@@ -19,36 +20,36 @@ struct tpl_cache_entry {
 static struct tpl_cache_entry g_tpl_cache[TPL_CACHE_CAP];
 
 static int stat_mtime(const char *path, time_t *out) {
-  struct stat st;
-  if (stat(path, &st) != 0) return -1;
-  if (out) *out = st.st_mtime;
-  return 0;
+  return vfs_stat(path, NULL, out);
 }
 
 static char *read_file_all_uncached(const char *path, size_t *out_len) {
-  FILE *f = fopen(path, "rb");
-  if (!f) return NULL;
-  if (fseek(f, 0, SEEK_END) != 0) { fclose(f); return NULL; }
-  long sz = ftell(f);
-  if (sz < 0) { fclose(f); return NULL; }
-  if (fseek(f, 0, SEEK_SET) != 0) { fclose(f); return NULL; }
-  char *buf = (char *)malloc((size_t)sz + 1);
-  if (!buf) { fclose(f); return NULL; }
-  size_t n = fread(buf, 1, (size_t)sz, f);
-  fclose(f);
-  buf[n] = '\0';
-  if (out_len) *out_len = n;
+  struct vfs_file file;
+  if (vfs_open(path, &file) != 0) return NULL;
+  char *buf = (char *)malloc(file.len + 1);
+  if (!buf) { vfs_close(&file); return NULL; }
+  memcpy(buf, file.data, file.len);
+  buf[file.len] = '\0';
+  if (out_len) *out_len = file.len;
+  vfs_close(&file);
   return buf;
 }
 
 static char *read_file_all(const char *path, size_t *out_len) {
+  time_t now = time(NULL);
   time_t mtime = 0;
-  if (stat_mtime(path, &mtime) != 0) return NULL;
 
   int free_slot = -1;
   for (int i = 0; i < TPL_CACHE_CAP; ++i) {
     if (g_tpl_cache[i].in_use) {
       if (strncmp(g_tpl_cache[i].path, path, sizeof(g_tpl_cache[i].path)) == 0) {
+        // Stat the template at most once per second
+        if (g_tpl_cache[i].checked == now) {
+          mtime = g_tpl_cache[i].mtime;
+        } else if (stat_mtime(path, &mtime) != 0) {
+          return NULL;
+        }
+        g_tpl_cache[i].checked = now;
         if (g_tpl_cache[i].mtime == mtime && g_tpl_cache[i].data) {
           if (out_len) *out_len = g_tpl_cache[i].len;
           char *copy = (char *)malloc(g_tpl_cache[i].len + 1);
@@ -75,6 +76,8 @@ static char *read_file_all(const char *path, size_t *out_len) {
     }
   }
 
+  if (stat_mtime(path, &mtime) != 0) return NULL;
+
   int slot = (free_slot != -1) ? free_slot : 0;
   if (free_slot == -1 && g_tpl_cache[slot].in_use) {
     free(g_tpl_cache[slot].data);
@@ -89,6 +92,7 @@ static char *read_file_all(const char *path, size_t *out_len) {
   g_tpl_cache[slot].data = ndata;
   g_tpl_cache[slot].len = nlen;
   g_tpl_cache[slot].mtime = mtime;
+  g_tpl_cache[slot].checked = now;
   g_tpl_cache[slot].in_use = 1;
   if (out_len) *out_len = nlen;
   char *copy = (char *)malloc(nlen + 1);
@@ -97,7 +101,7 @@ static char *read_file_all(const char *path, size_t *out_len) {
   return copy;
 }
 
-static char *html_escape(const char *s) {
+char *html_escape(const char *s) {
   if (!s)
     return strdup("");
   size_t extra = 0;
@@ -168,8 +172,11 @@ static const struct template_kv *find_kv(const struct template_kv *vars,
   return NULL;
 }
 
-int render_template_file(const char *filepath, const struct template_kv *vars,
-                         size_t nvars, char **out) {
+// Renders the template; if `split_key` is given, its {{{KEY}}} slot is left
+// empty and its offset in the output stored in `*split_at`.
+static int render(const char *filepath, const struct template_kv *vars,
+                  size_t nvars, char **out, const char *split_key,
+                  size_t *split_at) {
   if (!out)
     return -1;
   *out = NULL;
@@ -203,6 +210,13 @@ int render_template_file(const char *filepath, const struct template_kv *vars,
             if (j + 2 < tlen && tpl[j + 2] == '}') {
               // found {{{KEY}}}
               size_t key_len = j - key_start;
+              if (split_key && strlen(split_key) == key_len &&
+                  strncmp(split_key, tpl + key_start, key_len) == 0) {
+                if (*split_at == (size_t)-1)
+                  *split_at = off;
+                i = j + 3;
+                goto continue_outer;
+              }
               const struct template_kv *kv =
                   find_kv(vars, nvars, tpl + key_start, key_len);
               const char *val = kv ? kv->value : "";
@@ -279,4 +293,21 @@ int render_template_file(const char *filepath, const struct template_kv *vars,
   return 0;
 }
 
+int render_template_file(const char *filepath, const struct template_kv *vars,
+                         size_t nvars, char **out) {
+  return render(filepath, vars, nvars, out, NULL, NULL);
+}
+
+int render_template_split(const char *filepath,
+                          const struct template_kv *vars, size_t nvars,
+                          const char *slot, char **out, size_t *slot_at) {
+  *slot_at = (size_t)-1; // the first placeholder is the slot
+  int rc = render(filepath, vars, nvars, out, slot, slot_at);
+  if (rc == 0 && *slot_at == (size_t)-1) {
+    // No slot: everything goes before it
+    *slot_at = strlen(*out);
+  }
+  return rc;
+}
+
 void free_rendered_template(char *buf) { free(buf); }
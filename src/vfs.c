@@ -0,0 +1,508 @@
+// src/vfs.c
+#include "../include/vfs.h"
+#include "../include/logger.h"
+#include "../include/lz.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#ifdef SITE_EMBED
+// Generated by tools/mkembed.c into $(BUILD_DIR)/site_image.c
+extern const unsigned char vfs_site_blob[];
+extern const struct vfs_embedded_file vfs_site_files[];
+extern const size_t vfs_site_file_count;
+#else
+static const unsigned char vfs_site_blob[1];
+static const struct vfs_embedded_file vfs_site_files[1];
+static const size_t vfs_site_file_count = 0;
+#endif
+
+static const char **g_embedded_data = NULL; // decompressed contents
+static int g_disk_override = 0;
+
+static const char *normalize(const char *path, char *buf, size_t size) {
+  while (path[0] == '.' && path[1] == '/') {
+    path += 2;
+    while (*path == '/')
+      path++;
+  }
+
+  size_t o = 0;
+  for (const char *p = path; *p && o + 1 < size; p++) {
+    if (*p == '/' && o > 0 && buf[o - 1] == '/')
+      continue;
+    buf[o++] = *p;
+  }
+  while (o > 0 && buf[o - 1] == '/')
+    o--;
+  buf[o] = '\0';
+  return buf;
+}
+
+// Index of the first embedded entry whose path is >= key.
+static size_t lower_bound(const char *key) {
+  size_t lo = 0, hi = vfs_site_file_count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (strcmp(vfs_site_files[mid].path, key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static const struct vfs_embedded_file *find_embedded(const char *path,
+                                                     size_t *index) {
+  if (!g_embedded_data)
+    return NULL;
+  char key[512];
+  normalize(path, key, sizeof(key));
+  size_t i = lower_bound(key);
+  if (i < vfs_site_file_count && strcmp(vfs_site_files[i].path, key) == 0) {
+    if (index)
+      *index = i;
+    return &vfs_site_files[i];
+  }
+  return NULL;
+}
+
+static int use_disk(void) { return !g_embedded_data || g_disk_override; }
+
+void vfs_set_disk_override(int enabled) {
+  g_disk_override = enabled;
+  if (g_embedded_data && enabled)
+    logger_log(LOG_INFO, "Disk override enabled for embedded site image");
+}
+
+int vfs_disk_override(void) { return g_disk_override; }
+
+int vfs_init(void) {
+  if (vfs_site_file_count == 0 || g_embedded_data)
+    return 0;
+
+  const char **data = calloc(vfs_site_file_count, sizeof(*data));
+  if (!data)
+    return -1;
+
+  size_t total = 0;
+  for (size_t i = 0; i < vfs_site_file_count; i++) {
+    const struct vfs_embedded_file *f = &vfs_site_files[i];
+    if (f->size == f->raw_size) {
+      data[i] = (const char *)vfs_site_blob + f->offset;
+    } else {
+      unsigned char *raw = malloc(f->raw_size + 1);
+      if (!raw || lz_decompress(vfs_site_blob + f->offset, f->size, raw,
+                                f->raw_size) != 0) {
+        logger_log(LOG_ERROR, "Corrupt embedded file: %s", f->path);
+        free(raw);
+        for (size_t j = 0; j < i; j++) {
+          if (vfs_site_files[j].size != vfs_site_files[j].raw_size)
+            free((void *)data[j]);
+        }
+        free(data);
+        return -1;
+      }
+      raw[f->raw_size] = '\0';
+      data[i] = (const char *)raw;
+    }
+    total += f->raw_size;
+  }
+
+  g_embedded_data = data;
+  logger_log(LOG_INFO, "Embedded site image: %zu files, %zu bytes",
+             vfs_site_file_count, total);
+  return 0;
+}
+
+int vfs_is_embedded(void) { return g_embedded_data != NULL; }
+
+static int open_disk(const char *path, struct vfs_file *out) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+
+  char *buf = malloc((size_t)st.st_size + 1);
+  if (!buf) {
+    close(fd);
+    return -1;
+  }
+
+  size_t total = 0;
+  while (total < (size_t)st.st_size) {
+    ssize_t n = read(fd, buf + total, (size_t)st.st_size - total);
+    if (n <= 0)
+      break;
+    total += (size_t)n;
+  }
+  close(fd);
+  buf[total] = '\0';
+
+  out->data = buf;
+  out->len = total;
+  out->mtime = st.st_mtime;
+  out->owned = 1;
+  return 0;
+}
+
+static int open_embedded(const char *path, struct vfs_file *out) {
+  size_t i;
+  const struct vfs_embedded_file *f = find_embedded(path, &i);
+  if (!f)
+    return -1;
+  out->data = g_embedded_data[i];
+  out->len = f->raw_size;
+  out->mtime = (time_t)f->mtime;
+  out->owned = 0;
+  return 0;
+}
+
+int vfs_open(const char *path, struct vfs_file *out) {
+  memset(out, 0, sizeof(*out));
+  if (g_disk_override && open_disk(path, out) == 0)
+    return 0;
+  if (open_embedded(path, out) == 0)
+    return 0;
+  if (!g_embedded_data)
+    return open_disk(path, out);
+  return -1;
+}
+
+static int map_disk(const char *path, struct vfs_file *out) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+
+  out->data = "";
+  out->len = (size_t)st.st_size;
+  out->mtime = st.st_mtime;
+  if (out->len > 0) {
+    void *data = mmap(NULL, out->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    madvise(data, out->len, MADV_SEQUENTIAL);
+    out->data = data;
+    out->mapped = 1;
+  }
+  close(fd);
+  return 0;
+}
+
+int vfs_map(const char *path, struct vfs_file *out) {
+  memset(out, 0, sizeof(*out));
+  if (g_disk_override && map_disk(path, out) == 0)
+    return 0;
+  if (open_embedded(path, out) == 0)
+    return 0;
+  if (!g_embedded_data)
+    return map_disk(path, out);
+  return -1;
+}
+
+static ssize_t pread_disk(const char *path, void *buf, size_t size,
+                          size_t offset) {
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return -1;
+  }
+
+  size_t total = 0;
+  while (total < size) {
+    ssize_t n = pread(fd, (char *)buf + total, size - total,
+                      (off_t)(offset + total));
+    if (n <= 0)
+      break;
+    total += (size_t)n;
+  }
+  close(fd);
+  return (ssize_t)total;
+}
+
+static ssize_t pread_embedded(const char *path, void *buf, size_t size,
+                              size_t offset) {
+  size_t i;
+  const struct vfs_embedded_file *f = find_embedded(path, &i);
+  if (!f)
+    return -1;
+  if (offset >= f->raw_size)
+    return 0;
+  if (size > f->raw_size - offset)
+    size = f->raw_size - offset;
+  memcpy(buf, g_embedded_data[i] + offset, size);
+  return (ssize_t)size;
+}
+
+ssize_t vfs_pread(const char *path, void *buf, size_t size, size_t offset) {
+  ssize_t n;
+  if (g_disk_override && (n = pread_disk(path, buf, size, offset)) >= 0)
+    return n;
+  if ((n = pread_embedded(path, buf, size, offset)) >= 0)
+    return n;
+  if (!g_embedded_data)
+    return pread_disk(path, buf, size, offset);
+  return -1;
+}
+
+void vfs_close(struct vfs_file *file) {
+  if (file->owned)
+    free((void *)file->data);
+  if (file->mapped)
+    munmap((void *)file->data, file->len);
+  memset(file, 0, sizeof(*file));
+}
+
+int vfs_stat(const char *path, size_t *size, time_t *mtime) {
+  if (use_disk()) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+      if (size)
+        *size = (size_t)st.st_size;
+      if (mtime)
+        *mtime = st.st_mtime;
+      return 0;
+    }
+  }
+
+  const struct vfs_embedded_file *f = find_embedded(path, NULL);
+  if (!f)
+    return -1;
+  if (size)
+    *size = f->raw_size;
+  if (mtime)
+    *mtime = (time_t)f->mtime;
+  return 0;
+}
+
+int vfs_identity(const char *path, struct vfs_identity *id) {
+  if (use_disk()) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+      id->ino = (unsigned long long)st.st_ino;
+      id->mtime = st.st_mtime;
+      id->size = (size_t)st.st_size;
+      return 0;
+    }
+  }
+
+  size_t i;
+  const struct vfs_embedded_file *f = find_embedded(path, &i);
+  if (!f)
+    return -1;
+  id->ino = (unsigned long long)i + 1;
+  id->mtime = (time_t)f->mtime;
+  id->size = f->raw_size;
+  return 0;
+}
+
+// Calls `fn` for every embedded file directly under `prefix` ("dir/").
+static int list_embedded(const char *prefix,
+                         int (*fn)(const char *name, void *arg), void *arg) {
+  size_t plen = strlen(prefix);
+  for (size_t i = lower_bound(prefix); i < vfs_site_file_count; i++) {
+    const char *p = vfs_site_files[i].path;
+    if (strncmp(p, prefix, plen) != 0)
+      break;
+    if (strchr(p + plen, '/'))
+      continue;
+    int rc = fn(p + plen, arg);
+    if (rc)
+      return rc;
+  }
+  return 0;
+}
+
+int vfs_dir_exists(const char *dir) {
+  struct stat st;
+  if (use_disk() && stat(dir, &st) == 0 && S_ISDIR(st.st_mode))
+    return 1;
+  if (!g_embedded_data)
+    return 0;
+
+  char prefix[512];
+  normalize(dir, prefix, sizeof(prefix) - 1);
+  strcat(prefix, "/");
+  size_t i = lower_bound(prefix);
+  return i < vfs_site_file_count &&
+         strncmp(vfs_site_files[i].path, prefix, strlen(prefix)) == 0;
+}
+
+int vfs_list(const char *dir, int (*cb)(const char *name, void *arg),
+             void *arg) {
+  char prefix[512];
+  normalize(dir, prefix, sizeof(prefix) - 1);
+  strcat(prefix, "/");
+
+  if (g_embedded_data) {
+    int rc = list_embedded(prefix, cb, arg);
+    if (rc)
+      return rc;
+  }
+  if (!use_disk())
+    return 0;
+
+  DIR *d = opendir(dir);
+  if (!d)
+    return 0;
+
+  struct dirent *entry;
+  int rc = 0;
+  while (rc == 0 && (entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s%s", prefix, entry->d_name);
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode))
+      continue;
+    if (find_embedded(path, NULL))
+      continue; // already listed from the image
+    rc = cb(entry->d_name, arg);
+  }
+  closedir(d);
+  return rc;
+}
+
+struct disk_walk {
+  char prefix[512]; // normalized root with trailing slash
+  int (*cb)(const struct vfs_entry *entry, void *arg);
+  void *arg;
+};
+
+static int walk_disk(struct disk_walk *w, const char *rel);
+
+// Reports one directory entry and descends into subdirectories. `type` is
+// a DT_* value; DT_UNKNOWN falls back to fstatat() on `dirfd`.
+static int walk_entry(struct disk_walk *w, int dirfd, const char *rel,
+                      const char *name, unsigned char type) {
+  if (name[0] == '.')
+    return 0;
+
+  if (type == DT_UNKNOWN || type == DT_LNK) {
+    struct stat st;
+    if (fstatat(dirfd, name, &st, 0) != 0)
+      return 0;
+    type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : 0;
+  }
+  if (type != DT_DIR && type != DT_REG)
+    return 0;
+
+  char child_rel[1024];
+  snprintf(child_rel, sizeof(child_rel), "%s%s%s", rel, *rel ? "/" : "",
+           name);
+  struct vfs_entry e = {child_rel, type == DT_DIR};
+  if (type == DT_DIR) {
+    int rc = w->cb(&e, w->arg);
+    return rc ? rc : walk_disk(w, child_rel);
+  }
+
+  char child[1536];
+  snprintf(child, sizeof(child), "%s%s", w->prefix, child_rel);
+  if (find_embedded(child, NULL))
+    return 0; // already reported from the image
+  return w->cb(&e, w->arg);
+}
+
+#ifdef __linux__
+struct linux_dirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+static int walk_disk(struct disk_walk *w, const char *rel) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s%s", w->prefix, rel);
+
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1)
+    return 0;
+
+  // One getdents64 call returns hundreds of entries
+  char buf[32768] __attribute__((aligned(8)));
+  int rc = 0;
+  long n;
+  while (rc == 0 && (n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+    for (long off = 0; rc == 0 && off < n;) {
+      struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+      off += d->d_reclen;
+      rc = walk_entry(w, fd, rel, d->d_name, d->d_type);
+    }
+  }
+  close(fd);
+  return rc;
+}
+#else
+static int walk_disk(struct disk_walk *w, const char *rel) {
+  char path[1024];
+  snprintf(path, sizeof(path), "%s%s", w->prefix, rel);
+
+  DIR *d = opendir(path);
+  if (!d)
+    return 0;
+
+  struct dirent *entry;
+  int rc = 0;
+  while (rc == 0 && (entry = readdir(d)) != NULL)
+    rc = walk_entry(w, dirfd(d), rel, entry->d_name, DT_UNKNOWN);
+  closedir(d);
+  return rc;
+}
+#endif
+
+int vfs_walk(const char *dir,
+             int (*cb)(const struct vfs_entry *entry, void *arg), void *arg) {
+  struct disk_walk w;
+  normalize(dir, w.prefix, sizeof(w.prefix) - 1);
+  strcat(w.prefix, "/");
+  w.cb = cb;
+  w.arg = arg;
+
+  if (g_embedded_data) {
+    size_t plen = strlen(w.prefix);
+    for (size_t i = lower_bound(w.prefix); i < vfs_site_file_count; i++) {
+      const struct vfs_embedded_file *f = &vfs_site_files[i];
+      if (strncmp(f->path, w.prefix, plen) != 0)
+        break;
+      struct vfs_entry e = {f->path + plen, 0};
+      int rc = cb(&e, arg);
+      if (rc)
+        return rc;
+    }
+  }
+  if (!use_disk())
+    return 0;
+
+  return walk_disk(&w, "");
+}
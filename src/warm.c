@@ -0,0 +1,261 @@
+// src/warm.c
+#include "../include/warm.h"
+#include "../include/logger.h"
+#include "../include/page_cache.h"
+#include "../include/post.h"
+#include "../include/post_index.h"
+#include "../include/security.h"
+#include "../include/server.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WARM_BATCH 256          // posts rendered per step
+#define WARM_LOG_MAX_URLS 65536 // distinct pages counted from the log
+#define WARM_LOG_TOP 1024       // most requested pages warmed first
+
+enum warm_kind { WARM_BLOG, WARM_ABOUT, WARM_POST };
+
+struct warm_item {
+  enum warm_kind kind;
+  int page;   // WARM_BLOG
+  char *slug; // WARM_POST
+};
+
+static struct server_config *g_config = NULL;
+static struct warm_item *g_plan = NULL;
+static size_t g_plan_count = 0, g_plan_next = 0;
+static int g_all_posts = 0;
+static int g_post_cursor = 0;
+static int g_done = 1;
+static int g_warmed = 0;
+static struct timespec g_started;
+
+// Page cache key of a request path ("blog:2", "about", "post:<slug>"),
+// or 0 if the path is not a rendered page.
+static int page_key(const char *path, char *key, size_t size) {
+  size_t path_len = strcspn(path, "?");
+  const char *query = path[path_len] == '?' ? path + path_len + 1 : "";
+
+  if (path_len == 1 && path[0] == '/') {
+    snprintf(key, size, "blog:1");
+  } else if (path_len == 5 && strncmp(path, "/blog", 5) == 0) {
+    const char *param = strstr(query, "page=");
+    int page = param ? atoi(param + 5) : 1;
+    snprintf(key, size, "blog:%d", page > 1 ? page : 1);
+  } else if (path_len == 6 && strncmp(path, "/about", 6) == 0) {
+    snprintf(key, size, "about");
+  } else if (path_len > 6 && strncmp(path, "/post/", 6) == 0) {
+    char slug[320];
+    snprintf(slug, sizeof(slug), "%.*s", (int)(path_len - 6), path + 6);
+    char *clean = sanitize_path(slug);
+    int ok = clean && is_path_safe(clean);
+    if (ok)
+      snprintf(key, size, "post:%s", clean);
+    free(clean);
+    return ok;
+  } else {
+    return 0;
+  }
+  return 1;
+}
+
+struct url_count {
+  char *key;
+  unsigned long hits;
+};
+
+static int compare_hits(const void *a, const void *b) {
+  const struct url_count *ua = a, *ub = b;
+  if (ua->hits != ub->hits)
+    return ua->hits < ub->hits ? 1 : -1;
+  return strcmp(ua->key, ub->key);
+}
+
+static uint64_t hash_key(const char *s) {
+  uint64_t h = 1469598103934665603ULL;
+  for (; *s; s++) {
+    h ^= (unsigned char)*s;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static void plan_add(enum warm_kind kind, int page, const char *slug) {
+  if (g_plan_count % 64 == 0) {
+    struct warm_item *plan =
+        realloc(g_plan, (g_plan_count + 64) * sizeof(*plan));
+    if (!plan)
+      return;
+    g_plan = plan;
+  }
+  char *copy = slug ? strdup(slug) : NULL;
+  if (slug && !copy)
+    return;
+  g_plan[g_plan_count++] = (struct warm_item){kind, page, copy};
+}
+
+// Counts GET requests for pages in `path`, in the server's own log format
+// or a common/combined access log (anything with "GET <path> HTTP/"), and
+// plans the most requested ones.
+static void plan_from_log(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    logger_log(LOG_WARN, "Cannot read access log %s", path);
+    return;
+  }
+
+  size_t slot_count = 2 * WARM_LOG_MAX_URLS;
+  struct url_count *slots = calloc(slot_count, sizeof(*slots));
+  size_t distinct = 0;
+  char *line = NULL;
+  size_t cap = 0;
+  while (slots && getline(&line, &cap, fp) != -1) {
+    const char *get = strstr(line, "GET /");
+    if (!get)
+      continue;
+    const char *url = get + 4;
+    const char *end = strchr(url, ' ');
+    if (!end || strncmp(end, " HTTP/", 6) != 0 || end - url >= 1024)
+      continue;
+
+    char request[1024], key[384];
+    snprintf(request, sizeof(request), "%.*s", (int)(end - url), url);
+    if (!page_key(request, key, sizeof(key)))
+      continue;
+
+    size_t i = hash_key(key) & (slot_count - 1);
+    while (slots[i].key && strcmp(slots[i].key, key) != 0)
+      i = (i + 1) & (slot_count - 1);
+    if (!slots[i].key) {
+      if (distinct == WARM_LOG_MAX_URLS || !(slots[i].key = strdup(key)))
+        continue;
+      distinct++;
+    }
+    slots[i].hits++;
+  }
+  free(line);
+  fclose(fp);
+  if (!slots)
+    return;
+
+  // Pack the used slots to the front, most requested first
+  size_t used = 0;
+  for (size_t i = 0; i < slot_count; i++) {
+    if (slots[i].key)
+      slots[used++] = slots[i];
+  }
+  qsort(slots, used, sizeof(*slots), compare_hits);
+
+  for (size_t i = 0; i < used; i++) {
+    const char *key = slots[i].key;
+    if (i < WARM_LOG_TOP) {
+      if (strncmp(key, "blog:", 5) == 0)
+        plan_add(WARM_BLOG, atoi(key + 5), NULL);
+      else if (strcmp(key, "about") == 0)
+        plan_add(WARM_ABOUT, 0, NULL);
+      else
+        plan_add(WARM_POST, 0, key + 5);
+    }
+    free(slots[i].key);
+  }
+  free(slots);
+  logger_log(LOG_INFO, "Access log %s: %zu pages, warming the top %zu", path,
+             used, used < WARM_LOG_TOP ? used : (size_t)WARM_LOG_TOP);
+}
+
+void warm_init(struct server_config *config) {
+  g_config = config;
+  if (config->page_cache_mb == 0)
+    return;
+
+  if (config->warm_log[0])
+    plan_from_log(config->warm_log);
+  for (int page = 1; page <= config->prerender_pages; page++)
+    plan_add(WARM_BLOG, page, NULL);
+  g_all_posts = config->prerender_posts;
+
+  g_done = g_plan_count == 0 && !g_all_posts;
+  clock_gettime(CLOCK_MONOTONIC, &g_started);
+}
+
+int warm_done(void) { return g_done; }
+
+// post_render_all() skip callback: the page is already cached.
+static int cached(const struct blog_post *post, void *arg) {
+  (void)arg;
+  char key[320];
+  snprintf(key, sizeof(key), "post:%s", post->filename);
+  struct page_entry *entry = page_cache_get(key);
+  if (entry)
+    page_cache_release(entry);
+  return entry != NULL;
+}
+
+static void warm_page(const struct warm_item *item) {
+  enum canned_response error;
+  struct page_entry *entry =
+      item->kind == WARM_ABOUT ? render_about_page(g_config, &error)
+                               : render_blog_page(g_config, item->page, &error);
+  if (entry) {
+    page_cache_release(entry);
+    g_warmed++;
+  }
+}
+
+static void finish(void) {
+  for (size_t i = 0; i < g_plan_count; i++)
+    free(g_plan[i].slug);
+  free(g_plan);
+  g_plan = NULL;
+  g_plan_count = g_plan_next = 0;
+  g_done = 1;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  double secs = (double)(now.tv_sec - g_started.tv_sec) +
+                (double)(now.tv_nsec - g_started.tv_nsec) / 1e9;
+  logger_log(LOG_INFO, "Page cache warm: %d pages in %.2fs", g_warmed, secs);
+}
+
+void warm_step(void) {
+  if (g_done)
+    return;
+
+  struct blog_index *index = post_index_acquire();
+  struct blog_post posts[WARM_BATCH];
+  struct blog_index view;
+  memset(&view, 0, sizeof(view));
+  view.posts = posts;
+  view.pack = index ? index->pack : NULL;
+
+  // Planned pages in order; planned posts are gathered and converted
+  // together
+  while (g_plan_next < g_plan_count && view.post_count < WARM_BATCH) {
+    const struct warm_item *item = &g_plan[g_plan_next++];
+    if (item->kind == WARM_POST) {
+      memset(&posts[view.post_count], 0, sizeof(posts[0]));
+      posts[view.post_count++].filename = item->slug;
+    } else {
+      warm_page(item);
+    }
+  }
+
+  if (view.post_count == 0 && g_plan_next == g_plan_count && g_all_posts &&
+      index && g_post_cursor < index->post_count) {
+    // Then every post, a window of the index at a time
+    view.posts = index->posts + g_post_cursor;
+    view.post_count = index->post_count - g_post_cursor;
+    if (view.post_count > WARM_BATCH)
+      view.post_count = WARM_BATCH;
+    g_post_cursor += view.post_count;
+  }
+
+  if (view.post_count > 0)
+    g_warmed += post_render_all(g_config, &view, cached, NULL, NULL);
+  else if (g_plan_next == g_plan_count)
+    finish();
+  post_index_release(index);
+}
@@ -0,0 +1,170 @@
+// src/workers.c
+#include "../include/workers.h"
+#include "../include/logger.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define WORKERS_MAX 32
+#define WORKERS_BATCH 16 // items claimed per counter increment
+
+struct worker_job {
+  size_t total;
+  size_t next; // atomically advanced by WORKERS_BATCH
+  worker_fn fn;
+  void *arg;
+  int threads; // workers taking part, the caller included
+};
+
+struct worker_thread {
+  pthread_t thread;
+  struct worker_job *job;
+  int id;
+};
+
+// Helper threads are started on first use and then park between runs, so
+// what they keep per thread (md4c parse contexts) is reused by every run
+// instead of being built and freed again each time. One run uses the pool
+// at a time.
+static struct {
+  pthread_mutex_t lock;
+  pthread_cond_t work; // a new job was posted
+  pthread_cond_t idle; // the last helper finished the job
+  struct worker_job *job;
+  unsigned long generation; // bumped for every job
+  int started;              // helpers, with ids 1..started
+  int active;               // helpers not yet done with the job
+} g_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+            PTHREAD_COND_INITIALIZER, NULL, 0, 0, 0};
+static pthread_mutex_t g_pool_owner = PTHREAD_MUTEX_INITIALIZER;
+
+struct pool_helper {
+  int id;
+  unsigned long seen; // last generation handled
+};
+
+int workers_for(size_t total) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t batches = (total + WORKERS_BATCH - 1) / WORKERS_BATCH;
+  size_t n = cpus > 0 ? (size_t)cpus : 1;
+  if (n > WORKERS_MAX)
+    n = WORKERS_MAX;
+  if (n > batches)
+    n = batches;
+  return n > 0 ? (int)n : 1;
+}
+
+static void run_batches(struct worker_job *job, int id) {
+  for (;;) {
+    size_t first =
+        __atomic_fetch_add(&job->next, WORKERS_BATCH, __ATOMIC_RELAXED);
+    if (first >= job->total)
+      return;
+    size_t last = first + WORKERS_BATCH;
+    if (last > job->total)
+      last = job->total;
+    for (size_t i = first; i < last; i++)
+      job->fn(i, id, job->arg);
+  }
+}
+
+static void *worker_main(void *arg) {
+  struct worker_thread *w = arg;
+  run_batches(w->job, w->id);
+  return NULL;
+}
+
+// Runs `job` on threads started for it alone: when the pool is busy with
+// another caller's run.
+static void run_spawned(struct worker_job *job) {
+  // The caller is worker 0; helpers take the remaining ids
+  struct worker_thread threads[WORKERS_MAX];
+  int started = 0;
+  for (int i = 1; i < job->threads; i++) {
+    threads[started].job = job;
+    threads[started].id = i;
+    if (pthread_create(&threads[started].thread, NULL, worker_main,
+                       &threads[started]) != 0) {
+      logger_log(LOG_WARN, "Could not start worker thread %d", i);
+      break;
+    }
+    started++;
+  }
+
+  run_batches(job, 0);
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i].thread, NULL);
+}
+
+static void *pool_main(void *arg) {
+  struct pool_helper self = *(struct pool_helper *)arg;
+  free(arg);
+
+  pthread_mutex_lock(&g_pool.lock);
+  for (;;) {
+    while (g_pool.generation == self.seen)
+      pthread_cond_wait(&g_pool.work, &g_pool.lock);
+    self.seen = g_pool.generation;
+    struct worker_job *job = g_pool.job;
+    if (self.id < job->threads) {
+      pthread_mutex_unlock(&g_pool.lock);
+      run_batches(job, self.id);
+      pthread_mutex_lock(&g_pool.lock);
+    }
+    if (--g_pool.active == 0)
+      pthread_cond_signal(&g_pool.idle);
+  }
+  return NULL;
+}
+
+// Starts helpers until there are `count`, or as many as can be started.
+// Call with g_pool_owner held.
+static void pool_grow(int count) {
+  while (g_pool.started < count) {
+    struct pool_helper *h = malloc(sizeof(*h));
+    pthread_t thread;
+    if (!h)
+      return;
+    // The generation is read before the next job is posted, so a helper
+    // that starts running late still sees that job as new
+    h->id = g_pool.started + 1;
+    h->seen = g_pool.generation;
+    if (pthread_create(&thread, NULL, pool_main, h) != 0) {
+      logger_log(LOG_WARN, "Could not start worker thread %d", h->id);
+      free(h);
+      return;
+    }
+    pthread_detach(thread);
+    g_pool.started++;
+  }
+}
+
+void workers_run(size_t total, worker_fn fn, void *arg) {
+  struct worker_job job = {total, 0, fn, arg, workers_for(total)};
+  if (job.threads <= 1) {
+    run_batches(&job, 0);
+    return;
+  }
+  if (pthread_mutex_trylock(&g_pool_owner) != 0) {
+    run_spawned(&job);
+    return;
+  }
+
+  pool_grow(job.threads - 1);
+  pthread_mutex_lock(&g_pool.lock);
+  g_pool.job = &job;
+  g_pool.active = g_pool.started;
+  g_pool.generation++;
+  pthread_cond_broadcast(&g_pool.work);
+  pthread_mutex_unlock(&g_pool.lock);
+
+  // The caller is worker 0
+  run_batches(&job, 0);
+
+  pthread_mutex_lock(&g_pool.lock);
+  while (g_pool.active > 0)
+    pthread_cond_wait(&g_pool.idle, &g_pool.lock);
+  g_pool.job = NULL;
+  pthread_mutex_unlock(&g_pool.lock);
+  pthread_mutex_unlock(&g_pool_owner);
+}
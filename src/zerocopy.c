@@ -0,0 +1,217 @@
+// src/zerocopy.c
+#include "../include/zerocopy.h"
+#include "../include/logger.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#endif
+
+#define ZC_MAX_RELEASES 4
+#define ZC_REAP_INTERVAL_MS 10
+#define ZC_MAX_WAIT_SECONDS 10
+
+struct zc_conn {
+  int fd;
+  uint32_t issued;    // MSG_ZEROCOPY sends made on this socket
+  uint32_t completed; // sends acknowledged by the kernel
+  int closing;        // caller is done with the connection
+  time_t started;
+  size_t release_count;
+  zc_release_fn release[ZC_MAX_RELEASES];
+  void *release_arg[ZC_MAX_RELEASES];
+};
+
+static size_t g_threshold = 0;
+static struct zc_conn *g_conns = NULL;
+static size_t g_conn_count = 0, g_conn_cap = 0;
+static int g_copied_logged = 0;
+
+void zerocopy_init(size_t threshold) {
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+  g_threshold = threshold;
+  if (threshold > 0)
+    logger_log(LOG_INFO, "MSG_ZEROCOPY enabled for bodies >= %zu bytes",
+               threshold);
+#else
+  (void)threshold;
+  g_threshold = 0;
+#endif
+}
+
+static ssize_t write_all(int fd, const char *data, size_t len, int flags) {
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t n = send(fd, data + sent, len - sent, flags | MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return sent > 0 ? (ssize_t)sent : -1;
+    sent += (size_t)n;
+  }
+  return (ssize_t)sent;
+}
+
+static struct zc_conn *find_conn(int fd) {
+  for (size_t i = 0; i < g_conn_count; i++) {
+    if (g_conns[i].fd == fd)
+      return &g_conns[i];
+  }
+  return NULL;
+}
+
+static struct zc_conn *track_conn(int fd) {
+  struct zc_conn *conn = find_conn(fd);
+  if (conn)
+    return conn;
+  if (g_conn_count == g_conn_cap) {
+    size_t cap = g_conn_cap ? g_conn_cap * 2 : 16;
+    struct zc_conn *conns = realloc(g_conns, cap * sizeof(*conns));
+    if (!conns)
+      return NULL;
+    g_conns = conns;
+    g_conn_cap = cap;
+  }
+  conn = &g_conns[g_conn_count++];
+  memset(conn, 0, sizeof(*conn));
+  conn->fd = fd;
+  conn->started = time(NULL);
+  return conn;
+}
+
+static void finish_conn(size_t index) {
+  struct zc_conn *conn = &g_conns[index];
+  close(conn->fd);
+  for (size_t i = 0; i < conn->release_count; i++)
+    conn->release[i](conn->release_arg[i]);
+  g_conns[index] = g_conns[--g_conn_count];
+}
+
+ssize_t zerocopy_send(int fd, const void *data, size_t len,
+                      zc_release_fn release, void *arg) {
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+  if (g_threshold > 0 && len >= g_threshold) {
+    struct zc_conn *conn = find_conn(fd);
+    int one = 1;
+    if (!conn &&
+        setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) != 0) {
+      logger_log(LOG_WARN, "SO_ZEROCOPY unavailable (%s), disabling",
+                 strerror(errno));
+      g_threshold = 0;
+    } else if ((conn = track_conn(fd)) != NULL &&
+               (!release || conn->release_count < ZC_MAX_RELEASES)) {
+      // Every successful send() call is one notification id
+      const char *p = data;
+      size_t sent = 0;
+      while (sent < len) {
+        ssize_t n = send(fd, p + sent, len - sent, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+          continue;
+        if (n < 0 && errno == ENOBUFS) {
+          // Over the optmem limit: copy the rest
+          ssize_t rest = write_all(fd, p + sent, len - sent, 0);
+          if (rest > 0)
+            sent += (size_t)rest;
+          break;
+        }
+        if (n <= 0)
+          break;
+        conn->issued++;
+        sent += (size_t)n;
+      }
+      if (release) {
+        conn->release[conn->release_count] = release;
+        conn->release_arg[conn->release_count] = arg;
+        conn->release_count++;
+      }
+      return sent > 0 ? (ssize_t)sent : -1;
+    }
+  }
+#endif
+
+  ssize_t sent = write_all(fd, data, len, 0);
+  if (release)
+    release(arg);
+  return sent;
+}
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+// Drains completion notifications queued on the socket's error queue.
+static void read_completions(struct zc_conn *conn) {
+  for (;;) {
+    char control[128];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(conn->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+      return;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+         cm = CMSG_NXTHDR(&msg, cm)) {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+            (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+        continue;
+
+      struct sock_extended_err err;
+      memcpy(&err, CMSG_DATA(cm), sizeof(err));
+      if (err.ee_errno != 0 || err.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+        continue;
+
+      // [ee_info, ee_data] is an inclusive range of completed send ids
+      conn->completed += err.ee_data - err.ee_info + 1;
+      if ((err.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && !g_copied_logged) {
+        logger_log(LOG_INFO, "Kernel copied a MSG_ZEROCOPY send "
+                             "(expected on loopback)");
+        g_copied_logged = 1;
+      }
+    }
+  }
+}
+#endif
+
+void zerocopy_close(int fd) {
+  struct zc_conn *conn = find_conn(fd);
+  if (!conn) {
+    close(fd);
+    return;
+  }
+  conn->closing = 1;
+  zerocopy_reap();
+}
+
+int zerocopy_reap(void) {
+  time_t now = time(NULL);
+  for (size_t i = 0; i < g_conn_count;) {
+    struct zc_conn *conn = &g_conns[i];
+#if defined(__linux__) && defined(MSG_ZEROCOPY)
+    read_completions(conn);
+#endif
+    if (!conn->closing) {
+      i++;
+      continue;
+    }
+    if (conn->completed < conn->issued &&
+        now - conn->started < ZC_MAX_WAIT_SECONDS) {
+      i++;
+      continue;
+    }
+
+    if (conn->completed < conn->issued) {
+      // Peer stopped reading: reset so the kernel drops the pinned pages
+      struct linger lin = {1, 0};
+      setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+      logger_log(LOG_WARN, "Zero-copy send timed out, resetting connection");
+    }
+    finish_conn(i);
+  }
+  return g_conn_count > 0 ? ZC_REAP_INTERVAL_MS : -1;
+}
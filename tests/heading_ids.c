@@ -0,0 +1,156 @@
+// tests/heading_ids.c
+// Renders documents with MD_HTML_FLAG_HEADING_IDS and checks the ids given
+// to duplicate headings: each must be unique, get the first free "-N"
+// suffix, and cost no more than a unique heading does.
+//
+//   heading_ids
+#include "md4c-html.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DUPLICATES 5000
+#define TIME_LIMIT 2.0 // seconds; quadratic or worse takes minutes
+
+struct output {
+  char *data;
+  size_t size;
+  size_t alloc;
+};
+
+static void collect(const MD_CHAR *text, MD_SIZE size, void *userdata) {
+  struct output *out = userdata;
+
+  if (out->size + size + 1 > out->alloc) {
+    while (out->size + size + 1 > out->alloc)
+      out->alloc = out->alloc ? out->alloc * 2 : 4096;
+    out->data = realloc(out->data, out->alloc);
+    if (!out->data) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  memcpy(out->data + out->size, text, size);
+  out->size += size;
+  out->data[out->size] = '\0';
+}
+
+static char *render(const char *md) {
+  struct output out = {0};
+
+  if (md_html_ex(md, (MD_SIZE)strlen(md), collect, &out, 0,
+                 MD_HTML_FLAG_HEADING_IDS, NULL) != 0) {
+    fprintf(stderr, "md_html_ex failed\n");
+    exit(1);
+  }
+  return out.data;
+}
+
+// Checks that the ids in 'html' are exactly 'expected', in order.
+static int check_ids(const char *name, const char *html,
+                     const char *const *expected, int count) {
+  const char *p = html;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    size_t len = strlen(expected[i]);
+
+    p = strstr(p, "id=\"");
+    if (!p) {
+      fprintf(stderr, "%s: heading %d has no id\n", name, i);
+      return 1;
+    }
+    p += 4;
+    if (strncmp(p, expected[i], len) != 0 || p[len] != '"') {
+      fprintf(stderr, "%s: heading %d: expected id \"%s\", got \"%.*s\"\n",
+              name, i, expected[i], (int)strcspn(p, "\""), p);
+      return 1;
+    }
+  }
+  if (strstr(p, "id=\"")) {
+    fprintf(stderr, "%s: more ids than headings\n", name);
+    return 1;
+  }
+  return 0;
+}
+
+// Suffixes skip ids that headings already have, whichever came first.
+static int test_collisions(void) {
+  static const char md[] = "# Notes\n"
+                           "## Notes 1\n"
+                           "## Notes\n"
+                           "## Notes\n"
+                           "## Notes 3\n"
+                           "## Notes\n"
+                           "## Notes 1\n"
+                           "## !!\n"
+                           "## Section\n";
+  static const char *const ids[] = {"notes",   "notes-1",   "notes-2",
+                                    "notes-3", "notes-3-1", "notes-4",
+                                    "notes-1-1", "section", "section-1"};
+  char *html = render(md);
+  int failed = check_ids("collisions", html, ids, sizeof(ids) / sizeof(ids[0]));
+
+  free(html);
+  return failed;
+}
+
+static int test_many_duplicates(void) {
+  static const char line[] = "## Notes\n\n";
+  char *md = malloc(DUPLICATES * (sizeof(line) - 1) + 1);
+  char **ids = malloc(DUPLICATES * sizeof(*ids));
+  char *html;
+  clock_t start;
+  double elapsed;
+  int failed;
+  int i;
+
+  if (!md || !ids) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < DUPLICATES; i++) {
+    memcpy(md + i * (sizeof(line) - 1), line, sizeof(line) - 1);
+    ids[i] = malloc(32);
+    if (!ids[i]) {
+      perror("malloc");
+      exit(1);
+    }
+    if (i == 0)
+      strcpy(ids[i], "notes");
+    else
+      snprintf(ids[i], 32, "notes-%d", i);
+  }
+  md[DUPLICATES * (sizeof(line) - 1)] = '\0';
+
+  start = clock();
+  html = render(md);
+  elapsed = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  failed = check_ids("many duplicates", html, (const char *const *)ids,
+                     DUPLICATES);
+  if (elapsed > TIME_LIMIT) {
+    fprintf(stderr, "many duplicates: %d headings took %.2fs\n", DUPLICATES,
+            elapsed);
+    failed = 1;
+  }
+
+  for (i = 0; i < DUPLICATES; i++)
+    free(ids[i]);
+  free(ids);
+  free(html);
+  free(md);
+  return failed;
+}
+
+int main(void) {
+  int failed = 0;
+
+  failed |= test_collisions();
+  failed |= test_many_duplicates();
+  if (failed)
+    return 1;
+  printf("heading_ids: ok\n");
+  return 0;
+}
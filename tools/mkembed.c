@@ -0,0 +1,169 @@
+// tools/mkembed.c
+// Packs site files into a C source that links into blog_server as the
+// embedded site image (see include/vfs.h).
+//
+//   mkembed <out.c> <dir-or-file>...
+#include "../include/lz.h"
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+struct input_file {
+  char *path;
+  long long mtime;
+};
+
+static struct input_file *files = NULL;
+static size_t file_count = 0, file_cap = 0;
+
+static void add_file(const char *path, long long mtime) {
+  if (file_count == file_cap) {
+    file_cap = file_cap ? file_cap * 2 : 64;
+    files = realloc(files, file_cap * sizeof(*files));
+    if (!files) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  while (path[0] == '.' && path[1] == '/')
+    path += 2;
+  files[file_count].path = strdup(path);
+  files[file_count].mtime = mtime;
+  file_count++;
+}
+
+static void walk(const char *path) {
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    fprintf(stderr, "mkembed: cannot stat %s\n", path);
+    exit(1);
+  }
+  if (S_ISREG(st.st_mode)) {
+    add_file(path, (long long)st.st_mtime);
+    return;
+  }
+  if (!S_ISDIR(st.st_mode))
+    return;
+
+  DIR *dir = opendir(path);
+  if (!dir) {
+    fprintf(stderr, "mkembed: cannot open %s\n", path);
+    exit(1);
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.')
+      continue;
+    char child[1024];
+    snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+    walk(child);
+  }
+  closedir(dir);
+}
+
+static int compare_files(const void *a, const void *b) {
+  return strcmp(((const struct input_file *)a)->path,
+                ((const struct input_file *)b)->path);
+}
+
+static unsigned char *read_all(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return NULL;
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char *buf = malloc(size > 0 ? (size_t)size : 1);
+  *len = buf ? fread(buf, 1, (size_t)size, f) : 0;
+  fclose(f);
+  return buf;
+}
+
+static void emit_c_string(FILE *out, const char *s) {
+  fputc('"', out);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fputc('\\', out);
+    fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <out.c> <dir-or-file>...\n", argv[0]);
+    return 1;
+  }
+
+  for (int i = 2; i < argc; i++)
+    walk(argv[i]);
+  qsort(files, file_count, sizeof(*files), compare_files);
+
+  FILE *out = fopen(argv[1], "w");
+  if (!out) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  size_t *offsets = calloc(file_count + 1, sizeof(size_t));
+  size_t *stored = calloc(file_count + 1, sizeof(size_t));
+  size_t *raw_sizes = calloc(file_count + 1, sizeof(size_t));
+  size_t offset = 0, total_raw = 0;
+
+  fprintf(out, "// Generated by tools/mkembed.c. Do not edit.\n");
+  fprintf(out, "#include \"vfs.h\"\n\n");
+  fprintf(out, "const unsigned char vfs_site_blob[] = {\n");
+
+  for (size_t i = 0; i < file_count; i++) {
+    size_t len = 0;
+    unsigned char *raw = read_all(files[i].path, &len);
+    if (!raw) {
+      fprintf(stderr, "mkembed: cannot read %s\n", files[i].path);
+      return 1;
+    }
+
+    unsigned char *packed = malloc(lz_bound(len));
+    size_t packed_len = lz_compress(raw, len, packed);
+    const unsigned char *body = raw;
+    size_t body_len = len;
+    if (packed_len < len) {
+      body = packed;
+      body_len = packed_len;
+    }
+
+    for (size_t k = 0; k < body_len; k++) {
+      fprintf(out, "%u,%s", body[k], (k % 24 == 23) ? "\n" : "");
+    }
+    // Keep a NUL after stored-raw files so text can be used as C strings.
+    if (body == raw)
+      fprintf(out, "0,");
+    fprintf(out, "\n");
+
+    offsets[i] = offset;
+    stored[i] = body_len;
+    raw_sizes[i] = len;
+    offset += body_len + (body == raw ? 1 : 0);
+    total_raw += len;
+
+    free(packed);
+    free(raw);
+  }
+  fprintf(out, "0};\n\n");
+
+  fprintf(out, "const struct vfs_embedded_file vfs_site_files[] = {\n");
+  for (size_t i = 0; i < file_count; i++) {
+    fprintf(out, "  {");
+    emit_c_string(out, files[i].path);
+    fprintf(out, ", %zu, %zu, %zu, %lld},\n", offsets[i], stored[i],
+            raw_sizes[i], files[i].mtime);
+  }
+  fprintf(out, "  {0, 0, 0, 0, 0}};\n\n");
+  fprintf(out, "const size_t vfs_site_file_count = %zu;\n", file_count);
+
+  fclose(out);
+  fprintf(stderr, "mkembed: %zu files, %zu bytes -> %zu bytes\n", file_count,
+          total_raw, offset);
+  return 0;
+}
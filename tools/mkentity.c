@@ -0,0 +1,176 @@
+// tools/mkentity.c
+// Builds a minimal perfect hash over the named entities in
+// lib/md4c/entity_map.def (hash and displace: the name's hash picks a
+// bucket, and the bucket's displacement seeds a second hash that picks the
+// slot), and writes the slot table for lib/md4c/entity.c.
+//
+//   mkentity <out.h>
+#include "../lib/md4c/entity.h"
+#include <stdio.h>
+#include <string.h>
+
+struct entity {
+  const char *name;
+  unsigned codepoints[2];
+};
+
+static const struct entity entities[] = {
+#define ENTITY(name, cp0, cp1) {name, {cp0, cp1}},
+#include "../lib/md4c/entity_map.def"
+#undef ENTITY
+};
+
+#define COUNT (sizeof(entities) / sizeof(entities[0]))
+#define KEYS_PER_BUCKET 4
+#define BUCKETS ((COUNT + KEYS_PER_BUCKET - 1) / KEYS_PER_BUCKET)
+#define MAX_SECONDS 16
+
+static unsigned bucket_of[COUNT];
+static unsigned bucket_size[BUCKETS];
+static unsigned order[BUCKETS];
+static uint16_t displacement[BUCKETS];
+static int slot_entity[COUNT];
+
+// Name without the '&' and ';'
+static const char *inner(size_t i, size_t *len) {
+  *len = strlen(entities[i].name) - 2;
+  return entities[i].name + 1;
+}
+
+static uint32_t slot_of(size_t i, uint32_t seed) {
+  size_t len;
+  const char *name = inner(i, &len);
+  return entity_reduce(entity_hash(name, len, seed), COUNT);
+}
+
+static int compare_size(const void *a, const void *b) {
+  unsigned ba = *(const unsigned *)a, bb = *(const unsigned *)b;
+  if (bucket_size[ba] != bucket_size[bb])
+    return bucket_size[ba] < bucket_size[bb] ? 1 : -1;
+  return ba < bb ? -1 : ba > bb;
+}
+
+// Finds a displacement that puts every key of bucket `b` in a free slot.
+static int place(unsigned b) {
+  size_t keys[64], count = 0;
+  for (size_t i = 0; i < COUNT && count < 64; i++) {
+    if (bucket_of[i] == b)
+      keys[count++] = i;
+  }
+
+  for (uint32_t d = 1; d <= UINT16_MAX; d++) {
+    uint32_t slots[64];
+    size_t k;
+    for (k = 0; k < count; k++) {
+      slots[k] = slot_of(keys[k], d);
+      if (slot_entity[slots[k]] >= 0)
+        break;
+      size_t j;
+      for (j = 0; j < k && slots[j] != slots[k]; j++)
+        ;
+      if (j < k)
+        break;
+    }
+    if (k < count)
+      continue;
+
+    for (k = 0; k < count; k++)
+      slot_entity[slots[k]] = (int)keys[k];
+    displacement[b] = (uint16_t)d;
+    return 0;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <out.h>\n", argv[0]);
+    return 1;
+  }
+
+  for (size_t i = 0; i < COUNT; i++) {
+    size_t len;
+    const char *name = inner(i, &len);
+    bucket_of[i] = entity_reduce(entity_hash(name, len, 0), BUCKETS);
+    bucket_size[bucket_of[i]]++;
+    slot_entity[i] = -1;
+  }
+
+  // Largest buckets first, while most slots are still free
+  for (unsigned b = 0; b < BUCKETS; b++)
+    order[b] = b;
+  qsort(order, BUCKETS, sizeof(order[0]), compare_size);
+  for (unsigned b = 0; b < BUCKETS && bucket_size[order[b]] > 0; b++) {
+    if (place(order[b]) != 0) {
+      fprintf(stderr, "mkentity: no displacement for bucket %u\n", order[b]);
+      return 1;
+    }
+  }
+
+  // Second codepoints are few; slots store an index into this list
+  unsigned seconds[MAX_SECONDS] = {0};
+  unsigned second_count = 1;
+  for (size_t i = 0; i < COUNT; i++) {
+    unsigned cp = entities[i].codepoints[1], k;
+    for (k = 0; k < second_count && seconds[k] != cp; k++)
+      ;
+    if (k == second_count) {
+      if (second_count == MAX_SECONDS) {
+        fprintf(stderr, "mkentity: too many second codepoints\n");
+        return 1;
+      }
+      seconds[second_count++] = cp;
+    }
+  }
+
+  FILE *out = fopen(argv[1], "w");
+  if (!out) {
+    perror(argv[1]);
+    return 1;
+  }
+  fprintf(out, "/* Generated by tools/mkentity.c. Do not edit. */\n");
+  fprintf(out, "#define ENTITY_COUNT %zu\n", COUNT);
+  fprintf(out, "#define ENTITY_BUCKETS %zu\n", BUCKETS);
+
+  fprintf(out, "static const uint16_t ENTITY_DISPLACEMENT[ENTITY_BUCKETS] = {");
+  for (size_t b = 0; b < BUCKETS; b++)
+    fprintf(out, "%s%u,", (b % 12) ? " " : "\n    ", displacement[b]);
+  fprintf(out, "\n};\n");
+
+  fprintf(out, "static const unsigned ENTITY_SECOND[] = {");
+  for (unsigned k = 0; k < second_count; k++)
+    fprintf(out, "%s%u", k ? ", " : " ", seconds[k]);
+  fprintf(out, " };\n");
+
+  // Names in slot order, without '&' and ';', back to back
+  fprintf(out, "static const char ENTITY_NAMES[] =");
+  for (size_t s = 0; s < COUNT; s++) {
+    size_t len;
+    const char *name = inner((size_t)slot_entity[s], &len);
+    fprintf(out, "%s\"%.*s\"", (s % 8) ? " " : "\n    ", (int)len, name);
+  }
+  fprintf(out, ";\n");
+
+  fprintf(out, "static const ENTITY_SLOT ENTITY_SLOTS[ENTITY_COUNT] = {\n");
+  size_t name_off = 0;
+  for (size_t s = 0; s < COUNT; s++) {
+    const struct entity *e = &entities[slot_entity[s]];
+    size_t len;
+    inner((size_t)slot_entity[s], &len);
+    unsigned k;
+    for (k = 0; seconds[k] != e->codepoints[1]; k++)
+      ;
+    fprintf(out, "    { %zu, %zu, %u, %u },\n", name_off, len, k,
+            e->codepoints[0]);
+    name_off += len;
+  }
+  fprintf(out, "};\n");
+  fclose(out);
+
+  if (name_off > UINT16_MAX) {
+    fprintf(stderr, "mkentity: names do not fit 16-bit offsets\n");
+    remove(argv[1]);
+    return 1;
+  }
+  return 0;
+}
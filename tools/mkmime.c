@@ -0,0 +1,64 @@
+// tools/mkmime.c
+// Finds a seed for mime_hash() that maps every extension in
+// include/mime_types.def to its own slot, and writes the slot table.
+//
+//   mkmime <out.h>
+#include "../include/mime.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *extensions[] = {
+#define MIME_TYPE(ext, type, charset, compressible, max_age) ext,
+#include "../include/mime_types.def"
+#undef MIME_TYPE
+};
+
+#define COUNT (sizeof(extensions) / sizeof(extensions[0]))
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <out.h>\n", argv[0]);
+    return 1;
+  }
+
+  unsigned bits = 1;
+  while ((1u << bits) < COUNT * 2)
+    bits++;
+
+  for (;; bits++) {
+    unsigned size = 1u << bits;
+    unsigned char slots[1024];
+    for (uint32_t seed = 1; seed < 1000000; seed++) {
+      memset(slots, 0, size);
+      size_t i;
+      for (i = 0; i < COUNT; i++) {
+        uint32_t slot = mime_hash(extensions[i], seed) & (size - 1);
+        if (slots[slot])
+          break;
+        slots[slot] = (unsigned char)(i + 1);
+      }
+      if (i < COUNT)
+        continue;
+
+      FILE *out = fopen(argv[1], "w");
+      if (!out) {
+        perror(argv[1]);
+        return 1;
+      }
+      fprintf(out, "// Generated by tools/mkmime.c. Do not edit.\n");
+      fprintf(out, "#define MIME_HASH_SEED %uu\n", seed);
+      fprintf(out, "#define MIME_HASH_BITS %u\n", bits);
+      fprintf(out, "// Registry index + 1 per slot, 0 = empty\n");
+      fprintf(out, "static const unsigned char mime_slots[%u] = {", size);
+      for (unsigned k = 0; k < size; k++)
+        fprintf(out, "%s%u,", (k % 16) ? "" : "\n  ", slots[k]);
+      fprintf(out, "\n};\n");
+      fclose(out);
+      return 0;
+    }
+    if (bits >= 10) {
+      fprintf(stderr, "mkmime: no perfect hash found\n");
+      return 1;
+    }
+  }
+}